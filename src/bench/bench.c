@@ -0,0 +1,438 @@
+#include "cpu/cpu.h"
+#include "cpu/instruction.h"
+#include "cpu/sched.h"
+#include "hle/applesoft.h"
+#include "hle/console.h"
+#include "run/headless.h"
+
+// Fixed workloads run headless and unthrottled on a freshly booted machine.
+// Machine code workloads are loaded at BENCH_ORG and end with a JAM opcode;
+// BASIC workloads are typed into Integer BASIC or Applesoft and end on a
+// marker string
+
+#define BENCH_ORG 0x0300
+#define BENCH_MAX_CYCLES 4000000000ULL
+#define BENCH_MIX_TOP 10
+
+#ifdef THREADED_DISPATCH
+#define BENCH_CORE "threaded"
+#else
+#define BENCH_CORE "switch"
+#endif
+
+typedef struct
+{
+    const char *name;
+    const u8 *code;          // Loaded at BENCH_ORG and started directly
+    size_t code_len;
+    const char *input;       // Typed at the Wozmon prompt instead
+    const char *stop_output; // Marker that ends an input driven workload
+    bool applesoft;          // Boot Applesoft instead of Wozmon
+    bool native;             // With the native ROM routines, as -E
+    bool translate;          // With hot code translated to host code, as -J
+    bool predecode;          // With the predecoded instruction cache, as -D
+} workload_t;
+
+typedef struct
+{
+    const char *mnemonic;
+    u64 count;
+} mix_entry_t;
+
+typedef struct
+{
+    headless_result_t run;
+    u64 best_ns;
+    mix_entry_t mix[256];
+    int mix_len;
+    u64 mix_total;
+} bench_result_t;
+
+// 16 x 65536 iterations of transfer/ALU/shift ops
+static const u8 alu_loop[] = {
+    0xA9, 0x10,       // LDA #16
+    0x85, 0x10,       // STA $10
+    0xA2, 0x00,       // LDX #0
+    0xA0, 0x00,       // LDY #0
+    0x8A,             // loop: TXA
+    0x69, 0x03,       // ADC #3
+    0x49, 0x55,       // EOR #$55
+    0x29, 0x7F,       // AND #$7F
+    0x09, 0x01,       // ORA #1
+    0x0A,             // ASL A
+    0x4A,             // LSR A
+    0xE8,             // INX
+    0xD0, 0xF2,       // BNE loop
+    0x88,             // DEY
+    0xD0, 0xEF,       // BNE loop
+    0xC6, 0x10,       // DEC $10
+    0xD0, 0xEB,       // BNE loop
+    0x02,             // JAM
+};
+
+// Copy 4K from $2000 to $4000 through (zp),Y, 256 times
+static const u8 memcpy_loop[] = {
+    0xA9, 0x00,       // LDA #0
+    0x85, 0x10,       // STA $10
+    0xA9, 0x00,       // outer: LDA #0
+    0x85, 0x00,       // STA $00
+    0x85, 0x02,       // STA $02
+    0xA9, 0x20,       // LDA #$20
+    0x85, 0x01,       // STA $01
+    0xA9, 0x40,       // LDA #$40
+    0x85, 0x03,       // STA $03
+    0xA2, 0x10,       // LDX #16
+    0xA0, 0x00,       // LDY #0
+    0xB1, 0x00,       // copy: LDA ($00),Y
+    0x91, 0x02,       // STA ($02),Y
+    0xC8,             // INY
+    0xD0, 0xF9,       // BNE copy
+    0xE6, 0x01,       // INC $01
+    0xE6, 0x03,       // INC $03
+    0xCA,             // DEX
+    0xD0, 0xF2,       // BNE copy
+    0xC6, 0x10,       // DEC $10
+    0xD0, 0xDC,       // BNE outer
+    0x02,             // JAM
+};
+
+// 65536 iterations of a 16-bit BCD counter plus a BCD subtraction
+static const u8 decimal_loop[] = {
+    0xF8,             // SED
+    0xA9, 0x00,       // LDA #0
+    0x85, 0x10,       // STA $10
+    0xA2, 0x00,       // outer: LDX #0
+    0x18,             // inner: CLC
+    0xA5, 0x20,       // LDA $20
+    0x69, 0x01,       // ADC #$01
+    0x85, 0x20,       // STA $20
+    0xA5, 0x21,       // LDA $21
+    0x69, 0x00,       // ADC #$00
+    0x85, 0x21,       // STA $21
+    0x38,             // SEC
+    0xA5, 0x22,       // LDA $22
+    0xE9, 0x07,       // SBC #$07
+    0x85, 0x22,       // STA $22
+    0xCA,             // DEX
+    0xD0, 0xE9,       // BNE inner
+    0xC6, 0x10,       // DEC $10
+    0xD0, 0xE3,       // BNE outer
+    0xD8,             // CLD
+    0x02,             // JAM
+};
+
+static const char basic_sieve[] =
+    "E000R\n"
+    "10 DIM F(600)\n"
+    "20 N=600:C=0\n"
+    "30 FOR I=2 TO N:F(I)=1:NEXT I\n"
+    "40 FOR I=2 TO N\n"
+    "50 IF F(I)=0 THEN 80\n"
+    "60 C=C+1:IF I+I>N THEN 80\n"
+    "70 FOR J=I+I TO N STEP I:F(J)=0:NEXT J\n"
+    "80 NEXT I\n"
+    "90 PRINT C:PRINT \"SIEVE \";\"DONE\"\n"
+    "RUN\n";
+
+// Mostly Integer BASIC's string output and COUT
+static const char basic_print[] =
+    "E000R\n"
+    "10 FOR I=1 TO 500\n"
+    "20 PRINT \"THE QUICK BROWN FOX JUMPS OVER THE DOG\"\n"
+    "30 NEXT I\n"
+    "40 PRINT \"PRINT \";\"DONE\"\n"
+    "RUN\n";
+
+// Nearly all of its time is spent in the floating point routines
+static const char applesoft_fp[] =
+    "10 X=0\n"
+    "20 FOR I=1 TO 200\n"
+    "30 X=X+SQR(I)*LOG(I)/EXP(I/100)-I^1.5\n"
+    "40 NEXT I\n"
+    "50 PRINT X:PRINT \"FP \";\"DONE\"\n"
+    "RUN\n";
+
+static const workload_t workloads[] = {
+    {"alu_loop", alu_loop, sizeof(alu_loop), NULL, NULL, false, false, false, false},
+    {"alu_loop_jit", alu_loop, sizeof(alu_loop), NULL, NULL, false, false, true, false},
+    {"alu_loop_pre", alu_loop, sizeof(alu_loop), NULL, NULL, false, false, false, true},
+    {"memcpy_loop", memcpy_loop, sizeof(memcpy_loop), NULL, NULL, false, false, false, false},
+    {"memcpy_loop_jit", memcpy_loop, sizeof(memcpy_loop), NULL, NULL, false, false, true, false},
+    {"decimal_loop", decimal_loop, sizeof(decimal_loop), NULL, NULL, false, false, false, false},
+    {"basic_sieve", NULL, 0, basic_sieve, "SIEVE DONE", false, false, false, false},
+    {"basic_sieve_jit", NULL, 0, basic_sieve, "SIEVE DONE", false, false, true, false},
+    {"basic_sieve_pre", NULL, 0, basic_sieve, "SIEVE DONE", false, false, false, true},
+    {"basic_print", NULL, 0, basic_print, "PRINT DONE", false, false, false, false},
+    {"basic_print_hle", NULL, 0, basic_print, "PRINT DONE", false, true, false, false},
+    {"basic_print_jit", NULL, 0, basic_print, "PRINT DONE", false, true, true, false},
+    {"applesoft_fp", NULL, 0, applesoft_fp, "FP DONE", true, false, false, false},
+    {"applesoft_pre", NULL, 0, applesoft_fp, "FP DONE", true, false, false, true},
+    {"applesoft_hle", NULL, 0, applesoft_fp, "FP DONE", true, true, false, false},
+    {"applesoft_jit", NULL, 0, applesoft_fp, "FP DONE", true, true, true, false},
+};
+
+#define WORKLOAD_COUNT (sizeof(workloads) / sizeof(workloads[0]))
+
+static bool run_workload(const workload_t *wl, FILE *sink, u64 *opcode_counts,
+                         headless_result_t *result, u64 *elapsed_ns)
+{
+    cpu_t cpu;
+    cpu_init(&cpu);
+
+    if (!init_software(&cpu) || (wl->applesoft && !init_applesoft(&cpu)))
+        return false;
+
+    if (wl->native)
+    {
+        cpu.hle = hle_create();
+        if (cpu.hle == NULL || !console_hle_install(&cpu) ||
+            (wl->applesoft && !applesoft_hle_install(&cpu)))
+            return false;
+    }
+
+    if (wl->translate)
+    {
+        cpu.jit = jit_create();
+        if (cpu.jit == NULL)
+            return false;
+    }
+
+    if (wl->predecode)
+    {
+        cpu.decode = decode_create();
+        if (cpu.decode == NULL)
+            return false;
+    }
+
+    headless_opts_t opts = {0};
+    opts.output = sink;
+    opts.max_cycles = BENCH_MAX_CYCLES;
+    opts.opcode_counts = opcode_counts;
+
+    if (wl->code)
+    {
+        memcpy(cpu.memory + BENCH_ORG, wl->code, wl->code_len);
+        cpu.PC = BENCH_ORG;
+    }
+    else
+    {
+        opts.input = fmemopen((void *)wl->input, strlen(wl->input), "r");
+        opts.stop_output = wl->stop_output;
+        if (opts.input == NULL)
+            return false;
+    }
+
+    // Only the run itself is timed, not booting and loading the machine
+    u64 start = sched_now_ns();
+    *result = headless_run(&cpu, &opts);
+    *elapsed_ns = sched_now_ns() - start;
+
+    if (opts.input)
+        fclose(opts.input);
+    hle_destroy(cpu.hle);
+    jit_destroy(cpu.jit);
+    decode_destroy(cpu.decode);
+
+    headless_stop_t expected = wl->code ? HEADLESS_STOP_TRAP : HEADLESS_STOP_OUTPUT;
+    return result->reason == expected;
+}
+
+static int compare_mix(const void *a, const void *b)
+{
+    const mix_entry_t *x = a, *y = b;
+    return (x->count < y->count) - (x->count > y->count);
+}
+
+static void build_mix(bench_result_t *res, const u64 *counts)
+{
+    res->mix_len = 0;
+    res->mix_total = 0;
+
+    for (int op = 0; op < 256; op++)
+    {
+        if (!counts[op])
+            continue;
+
+        int i;
+        for (i = 0; i < res->mix_len; i++)
+        {
+            if (strcmp(res->mix[i].mnemonic, opcode_names[op]) == 0)
+                break;
+        }
+        if (i == res->mix_len)
+            res->mix[res->mix_len++] = (mix_entry_t){opcode_names[op], 0};
+
+        res->mix[i].count += counts[op];
+        res->mix_total += counts[op];
+    }
+
+    qsort(res->mix, res->mix_len, sizeof(mix_entry_t), compare_mix);
+}
+
+static double emulated_mhz(const bench_result_t *res)
+{
+    return res->best_ns ? (double)res->run.cycles * 1000.0 / res->best_ns : 0;
+}
+
+static double mips(const bench_result_t *res)
+{
+    return res->best_ns ? (double)res->run.instructions * 1000.0 / res->best_ns : 0;
+}
+
+static double ns_per_instruction(const bench_result_t *res)
+{
+    return res->run.instructions ? (double)res->best_ns / res->run.instructions : 0;
+}
+
+static void print_text(const bench_result_t *results, int repeat)
+{
+    printf("core: %s, best of %d run(s)\n\n", BENCH_CORE, repeat);
+    printf("%-16s %13s %13s %10s %9s %9s %9s\n", "workload", "instructions", "cycles",
+           "host ms", "MHz", "MIPS", "ns/instr");
+
+    for (size_t w = 0; w < WORKLOAD_COUNT; w++)
+    {
+        const bench_result_t *res = &results[w];
+
+        printf("%-16s %13llu %13llu %10.2f %9.2f %9.2f %9.2f\n", workloads[w].name,
+               (unsigned long long)res->run.instructions, (unsigned long long)res->run.cycles,
+               res->best_ns / 1e6, emulated_mhz(res), mips(res), ns_per_instruction(res));
+
+        printf("  mix:");
+        for (int i = 0; i < res->mix_len && i < BENCH_MIX_TOP; i++)
+            printf(" %s %.1f%%", res->mix[i].mnemonic, 100.0 * res->mix[i].count / res->mix_total);
+        printf("\n");
+    }
+}
+
+static void print_csv(const bench_result_t *results)
+{
+    printf("core,workload,instructions,cycles,host_ns,emulated_mhz,mips,ns_per_instruction,mix\n");
+
+    for (size_t w = 0; w < WORKLOAD_COUNT; w++)
+    {
+        const bench_result_t *res = &results[w];
+
+        printf("%s,%s,%llu,%llu,%llu,%.3f,%.3f,%.3f,", BENCH_CORE, workloads[w].name,
+               (unsigned long long)res->run.instructions, (unsigned long long)res->run.cycles,
+               (unsigned long long)res->best_ns, emulated_mhz(res), mips(res),
+               ns_per_instruction(res));
+
+        for (int i = 0; i < res->mix_len; i++)
+            printf("%s%s:%.4f", i ? ";" : "", res->mix[i].mnemonic,
+                   (double)res->mix[i].count / res->mix_total);
+        printf("\n");
+    }
+}
+
+static void print_json(const bench_result_t *results, int repeat)
+{
+    printf("{\"core\":\"%s\",\"repeat\":%d,\"workloads\":[", BENCH_CORE, repeat);
+
+    for (size_t w = 0; w < WORKLOAD_COUNT; w++)
+    {
+        const bench_result_t *res = &results[w];
+
+        printf("%s{\"name\":\"%s\",\"instructions\":%llu,\"cycles\":%llu,\"host_ns\":%llu,"
+               "\"emulated_mhz\":%.3f,\"mips\":%.3f,\"ns_per_instruction\":%.3f,\"mix\":{",
+               w ? "," : "", workloads[w].name, (unsigned long long)res->run.instructions,
+               (unsigned long long)res->run.cycles, (unsigned long long)res->best_ns,
+               emulated_mhz(res), mips(res), ns_per_instruction(res));
+
+        for (int i = 0; i < res->mix_len; i++)
+            printf("%s\"%s\":%llu", i ? "," : "", res->mix[i].mnemonic,
+                   (unsigned long long)res->mix[i].count);
+        printf("}}");
+    }
+    printf("]}\n");
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-r repeat] [-f text|csv|json]\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+    int repeat = 3;
+    const char *format = "text";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:f:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r':
+            repeat = atoi(optarg);
+            if (repeat < 1) {
+                fprintf(stderr, "Invalid repeat count: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'f':
+            format = optarg;
+            if (strcmp(format, "text") && strcmp(format, "csv") && strcmp(format, "json")) {
+                fprintf(stderr, "Unknown format: %s\n", optarg);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? EXIT_SUCCESS : 1;
+        }
+    }
+
+    FILE *sink = fopen("/dev/null", "w");
+    if (sink == NULL) {
+        fprintf(stderr, "Could not open /dev/null\n");
+        return 1;
+    }
+
+    static bench_result_t results[WORKLOAD_COUNT];
+
+    for (size_t w = 0; w < WORKLOAD_COUNT; w++)
+    {
+        const workload_t *wl = &workloads[w];
+        bench_result_t *res = &results[w];
+        headless_result_t run;
+
+        for (int r = 0; r < repeat; r++)
+        {
+            u64 elapsed;
+            bool ok = run_workload(wl, sink, NULL, &run, &elapsed);
+
+            if (!ok) {
+                fprintf(stderr, "%s: did not finish (%s)\n", wl->name, headless_stop_name(run.reason));
+                return 1;
+            }
+
+            if (r == 0 || elapsed < res->best_ns)
+                res->best_ns = elapsed;
+            res->run = run;
+        }
+
+        // Untimed pass that single steps to collect the instruction mix
+        u64 counts[256] = {0};
+        u64 elapsed;
+        if (!run_workload(wl, sink, counts, &run, &elapsed)) {
+            fprintf(stderr, "%s: mix pass did not finish\n", wl->name);
+            return 1;
+        }
+
+        if (run.instructions != res->run.instructions || run.cycles != res->run.cycles)
+            fprintf(stderr, "%s: warning: mix pass diverged from the timed runs\n", wl->name);
+
+        build_mix(res, counts);
+    }
+
+    fclose(sink);
+
+    if (strcmp(format, "csv") == 0)
+        print_csv(results);
+    else if (strcmp(format, "json") == 0)
+        print_json(results, repeat);
+    else
+        print_text(results, repeat);
+
+    return EXIT_SUCCESS;
+}
@@ -1,36 +1,234 @@
 #include "cpu.h"
 #include "instruction.h"
+#include "decimal.h"
+#include "mem/loader.h"
+#include "mem/rom.h"
+#include "hle/applesoft.h"
+
+static u8 pia_read(void *ctx, u16 address);
+static void pia_write(void *ctx, u16 address, u8 value);
+static void cpu_code_written(void *ctx, u16 address);
 
 void cpu_init(cpu_t *cpu)
 {
     // Clear Memory
     memset(cpu->memory, 0, sizeof(cpu->memory));
 
+    decimal_init();
+
+    cpu->pia = (mem_device_t){"pia", 0xD010, 0xD013, pia_read, pia_write, cpu};
+    aci_init(&cpu->aci, cpu);
+    timer_init(&cpu->timer, cpu);
+    cpu->jit = NULL;
+    cpu->decode = NULL;
+    cpu_map_memory(cpu, 64);
+
     // Registers
     cpu->SP = 0xFF;
     cpu->A = cpu->X = cpu->Y = 0;
 
     // Status flags
-    cpu->N = cpu->V = cpu->D = cpu->C = 0;
-    cpu->B = cpu->I = cpu->Z = 1;
+    cpu_set_status(cpu, INTERRUPT_FLAG | ZERO_FLAG);
 
     cpu->temp_cycles = 0;
+    cpu->page_crossed = 0;
 
     // PIA State
     cpu->key_ready = false;
     cpu->key_value = 0;
-    cpu->cursor_pos = 0;
+    keyboard_init(&cpu->keyboard);
+    display_init(&cpu->display, false);
 
     cpu->running = true;
+    cpu->yield = 0;
     cpu->global_cycles = 0;
+
+    interrupt_init(&cpu->interrupt);
+    cpu->next_event = UINT64_MAX;
+
+    cpu->idle = false;
+    cpu->idle_polls = 0;
+    cpu->last_poll = 0;
+
+    cpu->emulate_illegal = true;
+    cpu->halt = HALT_NONE;
+    cpu->halt_pc = 0;
+    cpu->halt_opcode = 0;
+
+    cpu->profile = NULL;
+    cpu->profile_dump = false;
+    cpu->trace = NULL;
+    cpu->hle = NULL;
+    cpu->save_state = false;
+
+    cpu->display_out = NULL;
+    cpu->host = NULL;
+    cpu->recording = NULL;
 }
 
-void cpu_cycle(cpu_t *cpu)
+// Lay out RAM for one of the supported configurations. 64K keeps everything
+// outside the PIA, the cassette interface, the timer and the Wozmon page as
+// RAM; the smaller ones map RAM from 0x0000 plus the 4K bank at 0xE000 that
+// Integer BASIC is loaded into
+bool cpu_map_memory(cpu_t *cpu, u32 ram_kb)
 {
-    struct timespec ts;
-    u8 opcode_byte = read_memory(cpu, cpu->PC++);
-    opcode_t opcode = opcodes[opcode_byte];
+    memmap_t *map = &cpu->mem;
+
+    if (ram_kb != 4 && ram_kb != 8 && ram_kb != 32 && ram_kb != 48 && ram_kb != 64)
+        return false;
+
+    // Translated and predecoded code assumed the old layout; they unwatch
+    // their pages before the page table goes
+    if (cpu->jit)
+        jit_flush(cpu);
+    if (cpu->decode)
+        decode_flush(cpu);
+
+    switch (ram_kb)
+    {
+    case 4:
+    case 8:
+    case 32:
+    case 48:
+        mem_init(map);
+        mem_map_ram(map, cpu->memory, 0x0000, ram_kb * 1024);
+        mem_map_ram(map, cpu->memory + 0xE000, 0xE000, 0x1000);
+        break;
+    case 64:
+        mem_init(map);
+        mem_map_ram(map, cpu->memory, 0x0000, MEMORY_SIZE);
+        break;
+    }
+
+    mem_map_rom(map, cpu->memory + 0xFF00, 0xFF00, 0x100);
+    mem_map_rom(map, cpu->memory + ACI_ROM_START, ACI_ROM_START, 0x100);
+    mem_map_device(map, &cpu->pia);
+    mem_map_device(map, &cpu->aci.device);
+    mem_map_device(map, &cpu->timer.device);
+    map->watch_write = cpu_code_written;
+    map->watch_ctx = cpu;
+
+    cpu->ram_kb = ram_kb;
+    return true;
+}
+
+static void cpu_trace(cpu_t *cpu, u16 pc, u8 opcode, u8 mode, u16 addr)
+{
+    trace_record_t *record = trace_next(cpu->trace, pc, cpu->global_cycles);
+    if (record == NULL)
+        return;
+
+    record->cycles = cpu->global_cycles;
+    record->pc = pc;
+    record->addr = addr;
+    record->opcode = opcode;
+    record->operand[0] = mem_peek(&cpu->mem, pc + 1);
+    record->operand[1] = mem_peek(&cpu->mem, pc + 2);
+    record->mode = mode;
+    record->value = mem_peek(&cpu->mem, addr);
+    record->A = cpu->A;
+    record->X = cpu->X;
+    record->Y = cpu->Y;
+    record->SP = cpu->SP;
+    record->P = cpu_status(cpu);
+    record->reserved = 0;
+}
+
+// Operand address of a predecoded instruction, worked out the way the
+// addressing mode functions do, in the same order of reads. Indexed modes
+// that cross a page set extra when the opcode takes a cycle for it
+static inline u16 decoded_address(cpu_t *cpu, const decoded_t *decoded, u8 *extra)
+{
+    u16 operand = decoded->operand;
+    u16 base, addr;
+
+    switch (decoded->mode)
+    {
+    case ZPX:
+        return (u8)(operand + cpu->X);
+    case ZPY:
+        return (u8)(operand + cpu->Y);
+    case ABX:
+        base = operand;
+        addr = base + cpu->X;
+        break;
+    case ABY:
+        base = operand;
+        addr = base + cpu->Y;
+        break;
+    case IND:
+    {
+        // Same page-boundary bug as ind_address
+        u8 lo = read_memory(cpu, operand);
+        u8 hi = read_memory(cpu, (operand & 0xFF) == 0xFF ? operand & 0xFF00 : operand + 1);
+        return (hi << 8) | lo;
+    }
+    case IDX:
+    {
+        u8 ptr = operand + cpu->X;
+        u8 lo = read_memory(cpu, ptr);
+        u8 hi = read_memory(cpu, (u8)(ptr + 1));
+        return (hi << 8) | lo;
+    }
+    case IDY:
+    {
+        u8 lo = read_memory(cpu, operand);
+        u8 hi = read_memory(cpu, (u8)(operand + 1));
+        base = (hi << 8) | lo;
+        addr = base + cpu->Y;
+        break;
+    }
+    default: // IMM, ZP, ABS and REL were resolved when decoded, IMP has none
+        return operand;
+    }
+
+    cpu->page_crossed = (base & 0xFF00) != (addr & 0xFF00);
+    *extra = opcodes[decoded->opcode].xpage & cpu->page_crossed;
+    return addr;
+}
+
+// Execute one instruction, returns the cycles it took (0 if none ran). A
+// native routine counts as one instruction, its cycles capped at 255 here
+u8 cpu_cycle(cpu_t *cpu)
+{
+    if (cpu->halt)
+        return 0;
+
+    if (__builtin_expect(cpu->hle != NULL, 0) && cpu->hle->pages[cpu->PC >> 8])
+    {
+        u32 cycles = hle_dispatch(cpu);
+        if (cycles)
+            return cycles > UINT8_MAX ? UINT8_MAX : (u8)cycles;
+    }
+
+    u16 pc = cpu->PC;
+    u8 opcode_byte;
+    void (*operation)(cpu_t *cpu, u16 addr);
+    u8 mode;
+    u8 cycles;
+    u8 extra = 0;
     u16 addr = 0;
+    const decoded_t *decoded = cpu->decode ? decode_find(cpu->decode, pc) : NULL;
+
+    if (decoded)
+    {
+        opcode_byte = decoded->opcode;
+        operation = decoded->operation;
+        mode = decoded->mode;
+        cycles = decoded->cycles;
+        cpu->PC = pc + decoded->length;
+        addr = decoded_address(cpu, decoded, &extra);
+        goto execute;
+    }
+
+    opcode_byte = read_memory(cpu, cpu->PC++);
+    opcode_t opcode = opcodes[opcode_byte];
+
+    if (opcode.illegal && !cpu->emulate_illegal)
+    {
+        cpu_halt(cpu, HALT_ILLEGAL);
+        return 0;
+    }
 
     switch (opcode.addr_mode)
     {
@@ -72,69 +270,162 @@ void cpu_cycle(cpu_t *cpu)
         break;
     }
 
-    opcode.operation(cpu, addr);
+    operation = opcode.operation;
+    mode = opcode.addr_mode;
+    cycles = opcode.cycles;
+    extra = opcode.xpage & cpu->page_crossed;
 
-    ts.tv_sec = 0;
-    ts.tv_nsec = 10000 * (opcode.cycles + cpu->temp_cycles);
+    if (cpu->decode)
+        decode_fill(cpu, pc, opcode_byte);
 
-    nanosleep(&ts, NULL);
+execute:
+    if (__builtin_expect(cpu->trace != NULL, 0))
+        cpu_trace(cpu, pc, opcode_byte, mode, addr);
 
-    cpu->global_cycles += (opcode.cycles + cpu->temp_cycles);
+    operation(cpu, addr);
+
+    cycles += extra + cpu->temp_cycles;
+    cpu->global_cycles += cycles;
     cpu->temp_cycles = 0;
+
+    if (__builtin_expect(cpu->profile != NULL, 0))
+        profile_record(cpu->profile, pc, opcode_byte, mode, cycles, addr);
+
+    return cycles;
 }
 
-u8 load_program(cpu_t *cpu, const char *rom_path, u16 address)
+// Run instructions one cpu_cycle at a time. This is the switch core, and the
+// path the threaded core falls back to while profiling or tracing. Like the
+// threaded core it stops at any yield and leaves clearing it to cpu_run
+u64 cpu_run_stepped(cpu_t *cpu, u64 cycle_target, u64 max_instructions)
 {
-    // Load File
-    FILE *fptr = fopen(rom_path, "rb");
-    if (fptr == NULL)
-        return 1;
+    u64 count = 0;
 
-    if (fseek(fptr, 0, SEEK_END) != 0)
+    while (cpu->running && !cpu->yield && !cpu->halt && count < max_instructions &&
+           cpu->global_cycles < cycle_target)
     {
-        fprintf(stderr, "Error seeking to end of file\n");
-        fclose(fptr);
-        return 1;
+        // A trapped opcode was not executed
+        if (cpu_cycle(cpu))
+            count++;
     }
 
-    long size = ftell(fptr);
-    if (size == -1)
+    return count;
+}
+
+#ifdef THREADED_DISPATCH
+#define cpu_run_core cpu_run_threaded
+#else
+#define cpu_run_core cpu_run_stepped
+#endif
+
+// Run until cycle_target or max_instructions, a halt or a host yield. The
+// core only ever runs up to the next device event; events and interrupts
+// are handled here between bursts, so the per-instruction loop never looks
+// at the interrupt lines
+u64 cpu_run(cpu_t *cpu, u64 cycle_target, u64 max_instructions)
+{
+    u64 count = 0;
+
+    while (cpu->running && !cpu->halt && !(cpu->yield & CPU_YIELD_HOST) &&
+           count < max_instructions && cpu->global_cycles < cycle_target)
     {
-        fprintf(stderr, "Error getting file position\n");
-        fclose(fptr);
-        return 1;
+        interrupt_service(cpu);
+
+        // An IRQ still held with I clear was let in by CLI or PLP just now:
+        // one more instruction, then the next pass takes it
+        u64 budget = max_instructions - count;
+        if (cpu->interrupt.irq_lines && !(cpu->P & INTERRUPT_FLAG))
+            budget = 1;
+
+        u64 target = cpu->next_event < cycle_target ? cpu->next_event : cycle_target;
+        if (cpu->jit)
+            count += jit_run(cpu, target, budget);
+        else
+            count += cpu_run_core(cpu, target, budget);
     }
-    fseek(fptr, 0, SEEK_SET);
 
-    // Load File into CPU Memory
-    size_t bytes_read = fread(cpu->memory + address, sizeof(u8), size, fptr);
-    fclose(fptr);
+    cpu->yield = 0;
+    return count;
+}
+
+void cpu_reset(cpu_t *cpu)
+{
+    cpu->PC = cpu->RESET_LOC;
+    cpu->halt = HALT_NONE;
+    cpu->idle_polls = 0;
+    keyboard_clear(&cpu->keyboard);
+
+    // RESET also reaches the timer; NMIs latched before it are lost
+    cpu->P |= INTERRUPT_FLAG;
+    timer_reset(&cpu->timer);
+    cpu->interrupt.nmi_pending = false;
+    cpu->interrupt.i_until = UINT64_MAX;
+}
 
-    // Nothing Loaded
-    if (!bytes_read)
+// Stop executing; PC must point just past the offending opcode
+void cpu_halt(cpu_t *cpu, halt_t reason)
+{
+    cpu->PC--;
+    cpu->halt = reason;
+    cpu->halt_pc = cpu->PC;
+    cpu->halt_opcode = read_memory(cpu, cpu->PC);
+    cpu->yield |= CPU_YIELD_HOST;
+}
+
+void cpu_halt_message(cpu_t *cpu, char *buf, size_t len)
+{
+    switch (cpu->halt)
     {
-        fprintf(stderr, "Nothing was loaded\n");
+    case HALT_JAM:
+        snprintf(buf, len, "CPU jammed by opcode $%02X at $%04X", cpu->halt_opcode, cpu->halt_pc);
+        break;
+    case HALT_ILLEGAL:
+        snprintf(buf, len, "Trapped undocumented opcode $%02X at $%04X", cpu->halt_opcode, cpu->halt_pc);
+        break;
+    default:
+        snprintf(buf, len, "CPU running");
+        break;
+    }
+}
+
+// Raw binary at address; see loader_load for the other image formats
+u8 load_program(cpu_t *cpu, const char *rom_path, u16 address)
+{
+    char error[160];
+
+    if (!loader_load(&cpu->mem, rom_path, LOAD_RAW, address, NULL, error, sizeof(error)))
+    {
+        fprintf(stderr, "%s\n", error);
         return 1;
     }
 
     return 0;
 }
 
-bool init_software(cpu_t *cpu)
+// Copy a built-in (or overridden) ROM image into the backing store
+static bool install_rom(cpu_t *cpu, const char *name, u16 address, size_t max_size)
 {
-    if (load_program(cpu, "./roms/wozmon.bin", 0xFF00) != 0)
-    {
-        fprintf(stderr, "Error: Could not load Wozmon\n");
-        return EXIT_FAILURE;
-    }
+    const rom_image_t *rom = rom_find(name);
 
-    // Load Basic
-    if (load_program(cpu, "./roms/a1basic.bin", 0xE000) != 0)
+    if (rom == NULL || rom->size > max_size)
     {
-        fprintf(stderr, "Error: Could not load Wozmon\n");
-        return EXIT_FAILURE;
+        fprintf(stderr, "Error: ROM image '%s' is missing or larger than %zu bytes\n", name, max_size);
+        return false;
     }
 
+    memcpy(cpu->memory + address, rom->data, rom->size);
+    return true;
+}
+
+bool init_software(cpu_t *cpu)
+{
+    // Wozmon lives in the read-only page at 0xFF00, BASIC in the 0xE000 bank,
+    // the cassette interface ROM at 0xC100
+    if (!install_rom(cpu, "wozmon", 0xFF00, 0x100) ||
+        !install_rom(cpu, "a1basic", 0xE000, 0x1000) ||
+        !install_rom(cpu, "wozaci", ACI_ROM_START, 0x100))
+        return false;
+
     // Set NMI, Reset, & BRK Locations
     cpu->NMI_LOC = (cpu->memory[NMI_HIGH_ADDR] << 8) | cpu->memory[NMI_LOW_ADDR];
     cpu->RESET_LOC = (cpu->memory[RESET_HIGH_ADDR] << 8) | cpu->memory[RESET_LOW_ADDR];
@@ -144,117 +435,103 @@ bool init_software(cpu_t *cpu)
     return true;
 }
 
-u8 read_memory(cpu_t *cpu, u16 address)
+// Applesoft Lite next to Wozmon and Integer BASIC, started at its cold
+// start instead of the reset vector. It lives in RAM, like on a Replica-1
+bool init_applesoft(cpu_t *cpu)
 {
-    if (address >= 0xD010 && address <= 0xD013)
+    if (cpu->ram_kb < APPLESOFT_MIN_RAM_KB)
     {
-        switch (address)
-        {
-        case 0xD010: // keyboard data
-            if (cpu->key_ready)
-            {
-                cpu->key_ready = false; // clear ready after read
-                return cpu->key_value | NEGATIVE_FLAG;
-            }
-            return 0;
-        case 0xD011: // keyboard status
-            return cpu->key_ready ? NEGATIVE_FLAG : 0x00;
-        case 0xD012: // video data
-            return 0;
-        case 0xD013: // video status
-            return 0;
-        }
+        fprintf(stderr, "Error: Applesoft needs at least %dK of RAM\n", APPLESOFT_MIN_RAM_KB);
+        return false;
     }
 
-    return cpu->memory[address];
+    if (!install_rom(cpu, "applesoft", APPLESOFT_START, APPLESOFT_SIZE))
+        return false;
+
+    cpu->PC = APPLESOFT_START;
+    return true;
+}
+
+// Latch the next queued key once the 6502 has consumed the previous one
+static inline void pia_latch_key(cpu_t *cpu)
+{
+    if (!cpu->key_ready && keyboard_pop(&cpu->keyboard, &cpu->key_value))
+        cpu->key_ready = true;
 }
 
-void write_memory(cpu_t *cpu, u16 address, u8 value)
+// Count empty status reads; a run of them close together is a program waiting
+// for a key, so leave cpu_run and let the frontend decide how to wait
+static inline void pia_idle_poll(cpu_t *cpu)
 {
-    if (address == 0xD012)
+    if (cpu->global_cycles - cpu->last_poll > PIA_IDLE_WINDOW)
+        cpu->idle_polls = 0;
+    cpu->last_poll = cpu->global_cycles;
+
+    if (++cpu->idle_polls >= PIA_IDLE_POLLS)
     {
-        u8 ch = value & 0x7F;
+        cpu->idle = true;
+        cpu->yield |= CPU_YIELD_HOST;
+    }
+}
 
-        if (ch == 0x7F)
-        {
-            if (cpu->cursor_pos > 0)
-            {
-                cpu->cursor_pos--;
-                addch('\b');
-            }
-        }
-        else if (ch == '\n' || ch == '\r')
+static u8 pia_read(void *ctx, u16 address)
+{
+    cpu_t *cpu = ctx;
+
+    switch (address)
+    {
+    case 0xD010: // keyboard data
+        pia_latch_key(cpu);
+        if (cpu->key_ready)
         {
-            cpu->cursor_pos = 0;
-            addch('\n');
+            cpu->key_ready = false; // clear ready after read
+            return cpu->key_value | NEGATIVE_FLAG;
         }
-        else if (ch >= 0x20 && ch <= 0x7E)
+        return 0;
+    case 0xD011: // keyboard status
+        pia_latch_key(cpu);
+        if (cpu->key_ready)
         {
-            cpu->cursor_pos++;
-            addch(ch);
-
-            if (cpu->cursor_pos >= 40)
-            {
-                cpu->cursor_pos = 0;
-                addch('\n');
-            }
+            cpu->idle_polls = 0;
+            return NEGATIVE_FLAG;
         }
-
-        refresh();
-        return;
+        pia_idle_poll(cpu);
+        return 0x00;
+    case 0xD012: // video data, bit 7 set while the display is busy
+        return display_busy(&cpu->display, cpu->global_cycles) ? NEGATIVE_FLAG : 0;
+    default: // video status
+        return 0;
     }
+}
+
+// Memory map watch hook: a page with translated or predecoded code was
+// written
+static void cpu_code_written(void *ctx, u16 address)
+{
+    cpu_t *cpu = ctx;
 
-    if (address < 0xFF00)
-        cpu->memory[address] = value;
+    if (cpu->jit)
+        jit_write(cpu, address);
+    if (cpu->decode)
+        decode_write(cpu->decode, address);
 }
 
-void poll_keyboard(cpu_t *cpu)
+static void pia_write(void *ctx, u16 address, u8 value)
 {
-    int key_hit = getch();
-    if (key_hit == ERR) return;
-
-    switch (key_hit) {
-        case KEY_F(1):
-            cpu->PC = cpu->RESET_LOC;
-            return; // Don't set key_ready for control keys
-        case KEY_F(2):
-            clear(); // Clears terminal screen
-            return;
-        case KEY_F(3):
-            cpu->running = false;
-            return; // Immediately exit Emulator
-        case '\n':
-        case '\r':
-        case KEY_ENTER:
-            key_hit = '\r';
-            break;
-        default:
-            if (key_hit >= 'a' && key_hit <= 'z')
-                key_hit += 'A' - 'a';
-            break;
-    }
+    cpu_t *cpu = ctx;
+
+    if (address != 0xD012)
+        return;
 
-    cpu->key_value = key_hit & 0x7F;
-    cpu->key_ready = true;
+    display_write(&cpu->display, value, cpu->global_cycles);
+    if (cpu->display_out)
+        cpu->display_out(cpu, value);
 }
 
-void cpu_display_registers(cpu_t *cpu)
+void cpu_display_registers(cpu_t *cpu, FILE *out)
 {
-    u8 value = 0;
-
-    value |= cpu->C ? CARRY_FLAG : 0;
-    value |= cpu->Z ? ZERO_FLAG : 0;
-    value |= cpu->I ? INTERRUPT_FLAG : 0;
-    value |= cpu->D ? DECIMAL_FLAG : 0;
-    value |= BREAK_FLAG;
-    value |= 0x20;
-    value |= cpu->V ? OVERFLOW_FLAG : 0;
-    value |= cpu->N ? NEGATIVE_FLAG : 0;
-
-    FILE *log = fopen("trace.log", "a");
-    fprintf(log, "A: %02X, X: %02X, Y: %02X, PC: %04X, SP: %02X, SR: %02X\n",
-            cpu->A, cpu->X, cpu->Y, cpu->PC, cpu->SP, value);
-    fclose(log);
+    fprintf(out, "A: %02X, X: %02X, Y: %02X, PC: %04X, SP: %02X, SR: %02X\n",
+            cpu->A, cpu->X, cpu->Y, cpu->PC, cpu->SP, cpu_status(cpu) | BREAK_FLAG);
 }
 
 void print_memory(cpu_t *cpu, u16 start, u16 end)
@@ -1,47 +1,205 @@
 #ifndef CPU_H
 #define CPU_H
 
+#include <stddef.h>
+
 #include "utils/util.h"
+#include "io/keyboard.h"
+#include "io/display.h"
+#include "io/aci.h"
+#include "io/timer.h"
+#include "mem/memory.h"
+#include "profile.h"
+#include "trace.h"
+#include "interrupt.h"
+#include "decode.h"
+#include "hle/hle.h"
+#include "jit/jit.h"
+#include "state/replay.h"
+
+typedef enum
+{
+    HALT_NONE,
+    HALT_JAM,     // KIL/JAM opcode locked up the CPU
+    HALT_ILLEGAL  // Undocumented opcode trapped by policy
+} halt_t;
 
-typedef struct
+// Reasons to leave the interpreter loop at the next instruction boundary.
+// SERVICE only stops the core: cpu_run takes the interrupt or runs the
+// device event and carries on
+#define CPU_YIELD_HOST 0x01
+#define CPU_YIELD_SERVICE 0x02
+
+typedef struct cpu_t
 {
-    u8 A;   // 8-bit Accumlator
+    // Everything the cores touch on every instruction comes first and fits
+    // in one cache line, ahead of the page table and the 64K memory array
     u16 PC; // 16 bit Program Counter
-    u8 SP;  // Stack Pointer
+    u8 A;   // 8-bit Accumulator
     u8 X;   // 'X' Index Register
     u8 Y;   // 'Y' Index Register
-    u8 memory[MEMORY_SIZE];
-    u8 N; // Negative Flag
-    u8 V; // Overflow Flag
-    u8 B; // B Flag
-    u8 D; // Decimal Flag
-    u8 I; // Interrupt Disable
-    u8 Z; // Zero Flag
-    u8 C; // Carry Flag
-    u8 temp_cycles;
+    u8 SP;  // Stack Pointer
+    u8 P;   // C, I, D and V at their status register bits (see cpu_status)
+    u16 nz; // Last result for the lazy N and Z flags (see cpu_set_nz)
+    u8 temp_cycles;  // Extra cycles added by the operation (taken branches)
+    u8 page_crossed; // Set by indexed addressing modes when they cross a page
+    bool running;
+    u8 yield; // CPU_YIELD_* bits, see above
+    bool emulate_illegal; // Undocumented opcodes: execute them, or halt (trap) when false
+    u8 halt;        // Why the CPU stopped executing (halt_t), until the next reset
+    decode_t *decode;   // Predecoded instructions, NULL when off
+    u64 global_cycles;
+    profile_t *profile; // Execution profile, NULL when profiling is off
+    trace_t *trace;     // Execution trace, NULL when tracing is off
+    hle_t *hle;         // Native ROM routines, NULL when off
+    jit_t *jit;         // Translated code, NULL when off
+
+    memmap_t mem;
+    mem_device_t pia; // Keyboard/display PIA at 0xD010-0xD013
+    aci_t aci;        // Cassette interface at 0xC000-0xC1FF
+    itimer_t timer;   // Interval timer at 0xC200-0xC203
+    u32 ram_kb;
+
+    interrupt_t interrupt;
+    u64 next_event; // global_cycles of the next device event (timer expiry)
 
     // BRK/RESET/NMI Locations
     u16 BRK_LOC;
     u16 RESET_LOC;
     u16 NMI_LOC;
 
+    keyboard_t keyboard; // Keys waiting to be latched into the PIA
     u8 key_value;
-    u8 cursor_pos;
-    bool running;
+    display_t display;
     bool key_ready;
-    u64 global_cycles;
+
+    // Keyboard polling with nothing to read: the frontend may sleep until
+    // input arrives and skip global_cycles ahead instead of running the loop
+    bool idle;
+    u32 idle_polls;  // Back-to-back empty reads of 0xD011
+    u64 last_poll;   // global_cycles of the last one
+
+    u16 halt_pc;
+    u8 halt_opcode;
+
+    bool profile_dump;  // F4 pressed: the frontend writes a profile report
+    bool save_state;    // F5 pressed: the frontend writes a snapshot
+
+    // Optional host stream for characters written to 0xD012
+    void (*display_out)(struct cpu_t *cpu, u8 value);
+    void *host; // Frontend state for the host hooks
+    recording_t *recording; // Input log being written, NULL when off
+
+    u8 memory[MEMORY_SIZE]; // Backing store, visible through the page table in mem
 } cpu_t;
 
+_Static_assert(offsetof(cpu_t, jit) + sizeof(jit_t *) <= 64, "hot CPU state spans cache lines");
+
 void cpu_init(cpu_t *cpu);
-void cpu_cycle(cpu_t *cpu);
+bool cpu_map_memory(cpu_t *cpu, u32 ram_kb);
+u8 cpu_cycle(cpu_t *cpu);
+u64 cpu_run(cpu_t *cpu, u64 cycle_target, u64 max_instructions);
+u64 cpu_run_stepped(cpu_t *cpu, u64 cycle_target, u64 max_instructions);
+u64 cpu_run_threaded(cpu_t *cpu, u64 cycle_target, u64 max_instructions);
+void cpu_reset(cpu_t *cpu);
+void cpu_halt(cpu_t *cpu, halt_t reason);
+void cpu_halt_message(cpu_t *cpu, char *buf, size_t len);
 u8 load_program(cpu_t *cpu, const char* rom_path, u16 address);
 bool init_software(cpu_t *cpu_);
-u8 read_memory(cpu_t *cpu, u16 address);
-void write_memory(cpu_t *cpu, u16 address, u8 value);
-void poll_keyboard(cpu_t *cpu);
+bool init_applesoft(cpu_t *cpu);
 
 // Displaying Register & Memory
-void cpu_display_registers(cpu_t *cpu);
+void cpu_display_registers(cpu_t *cpu, FILE *out);
 void print_memory(cpu_t *cpu, u16 start, u16 end);
 
+// A poll loop is tight when 0xD011 comes round again within this many cycles
+// (7 for Wozmon, about 20 for BASIC); this many empty polls in a row is idle
+#define PIA_IDLE_WINDOW 32
+#define PIA_IDLE_POLLS 8
+
+// Status flags. C, I, D and V are stored in P; N and Z are only worked out
+// when something looks at them, from the result kept in nz: Z is set when
+// its low byte is zero, N is its bit 15. Most instructions set both from the
+// same value, which costs a single store
+static inline void cpu_set_nz(cpu_t *cpu, u8 value)
+{
+    cpu->nz = value | (value << 8);
+}
+
+static inline bool cpu_zero(const cpu_t *cpu)
+{
+    return (cpu->nz & 0xFF) == 0;
+}
+
+static inline bool cpu_negative(const cpu_t *cpu)
+{
+    return (cpu->nz & 0x8000) != 0;
+}
+
+static inline u8 cpu_carry(const cpu_t *cpu)
+{
+    return cpu->P & CARRY_FLAG;
+}
+
+static inline void cpu_set_flag(cpu_t *cpu, u8 mask, bool on)
+{
+    cpu->P = (cpu->P & ~mask) | (on ? mask : 0);
+}
+
+// Processor status byte as pushed by PHP, minus the B flag
+static inline u8 cpu_status(const cpu_t *cpu)
+{
+    return cpu->P | 0x20 | (cpu_zero(cpu) ? ZERO_FLAG : 0) | (cpu_negative(cpu) ? NEGATIVE_FLAG : 0);
+}
+
+// Load the status register from a byte, as PLP and RTI do (B is not a flag)
+static inline void cpu_set_status(cpu_t *cpu, u8 value)
+{
+    cpu->P = value & (CARRY_FLAG | INTERRUPT_FLAG | DECIMAL_FLAG | OVERFLOW_FLAG);
+    cpu->nz = (value & ZERO_FLAG ? 0 : 1) | ((value & NEGATIVE_FLAG) << 8);
+}
+
+// RTI clearing I lets a held IRQ in before the next instruction. Nothing
+// is checked per instruction while no line is asserted
+static inline void cpu_check_irq(cpu_t *cpu)
+{
+    if (cpu->interrupt.irq_lines && !(cpu->P & INTERRUPT_FLAG))
+        cpu->yield |= CPU_YIELD_SERVICE;
+}
+
+// CLI, SEI and PLP change I on their last cycle, after the NMOS 6502 has
+// polled for interrupts, so the poll at their end still sees old_p's I: a
+// held IRQ gets in one instruction after CLI, and still gets in after SEI
+static inline void cpu_delay_irq(cpu_t *cpu, u8 old_p, u8 cycles)
+{
+    if (!((old_p ^ cpu->P) & INTERRUPT_FLAG) || !cpu->interrupt.irq_lines)
+        return;
+
+    cpu->interrupt.i_before = old_p & INTERRUPT_FLAG;
+    cpu->interrupt.i_until = cpu->global_cycles + cycles;
+    cpu->yield |= CPU_YIELD_SERVICE;
+}
+
+// Make sure cpu_run stops for a device event at cycle
+static inline void cpu_schedule(cpu_t *cpu, u64 cycle)
+{
+    if (cycle < cpu->next_event)
+    {
+        cpu->next_event = cycle;
+        cpu->yield |= CPU_YIELD_SERVICE;
+    }
+}
+
+// Memory access is inlined into every instruction: one page table lookup,
+// devices and ROM write protection only on the slow path
+static inline u8 read_memory(cpu_t *cpu, u16 address)
+{
+    return mem_read(&cpu->mem, address);
+}
+
+static inline void write_memory(cpu_t *cpu, u16 address, u8 value)
+{
+    mem_write(&cpu->mem, address, value);
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,81 @@
+#include "decimal.h"
+
+#include <pthread.h>
+
+u16 decimal_adc_table[2][256][256];
+u16 decimal_sbc_table[2][256][256];
+
+static pthread_once_t decimal_once = PTHREAD_ONCE_INIT;
+
+static u16 decimal_entry(u8 result, bool n, bool v, bool z, bool c)
+{
+    u8 flags = (n ? NEGATIVE_FLAG : 0) | (v ? OVERFLOW_FLAG : 0) |
+               (z ? ZERO_FLAG : 0) | (c ? CARRY_FLAG : 0);
+    return result | (flags << 8);
+}
+
+// Nibble by nibble, as the NMOS ALU does it. Z comes from the binary sum,
+// N and V from the high nibble before its decimal adjust, C after it.
+// Invalid BCD operands give the same results as real chips
+u16 decimal_adc(u8 a, u8 value, u8 carry)
+{
+    unsigned lo = (a & 0x0F) + (value & 0x0F) + carry;
+    if (lo > 0x09)
+        lo += 0x06;
+
+    unsigned hi = (a >> 4) + (value >> 4) + (lo > 0x0F);
+
+    bool z = ((a + value + carry) & 0xFF) == 0;
+    bool n = (hi & 0x08) != 0;
+    bool v = ((((hi << 4) ^ a) & 0x80) != 0) && !((a ^ value) & 0x80);
+
+    if (hi > 0x09)
+        hi += 0x06;
+
+    return decimal_entry((u8)((hi << 4) | (lo & 0x0F)), n, v, z, hi > 0x0F);
+}
+
+// Flags are those of the binary subtraction; only the result is adjusted
+u16 decimal_sbc(u8 a, u8 value, u8 carry)
+{
+    unsigned binary = a - value - (1 - carry);
+
+    bool z = (binary & 0xFF) == 0;
+    bool n = (binary & 0x80) != 0;
+    bool v = ((a ^ value) & (a ^ binary) & 0x80) != 0;
+    bool c = binary < 0x100;
+
+    unsigned lo = (a & 0x0F) - (value & 0x0F) - (1 - carry);
+    unsigned hi = (a >> 4) - (value >> 4);
+
+    if (lo & 0x10)
+    {
+        lo -= 0x06;
+        hi--;
+    }
+    if (hi & 0x10)
+        hi -= 0x06;
+
+    return decimal_entry((u8)((hi << 4) | (lo & 0x0F)), n, v, z, c);
+}
+
+static void decimal_build(void)
+{
+    for (unsigned carry = 0; carry < 2; carry++)
+    {
+        for (unsigned a = 0; a < 256; a++)
+        {
+            for (unsigned value = 0; value < 256; value++)
+            {
+                decimal_adc_table[carry][a][value] = decimal_adc(a, value, carry);
+                decimal_sbc_table[carry][a][value] = decimal_sbc(a, value, carry);
+            }
+        }
+    }
+}
+
+// Safe to call from any number of threads; the tables are built once
+void decimal_init(void)
+{
+    pthread_once(&decimal_once, decimal_build);
+}
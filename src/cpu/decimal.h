@@ -0,0 +1,18 @@
+#ifndef DECIMAL_H
+#define DECIMAL_H
+
+#include "utils/util.h"
+
+// NMOS 6502 decimal mode ADC/SBC for every (carry, A, operand), built once
+// by decimal_init(). An entry is the accumulator in the low byte and the
+// N, V, Z and C flags (status register bit positions) in the high byte
+#define DECIMAL_FLAGS (NEGATIVE_FLAG | OVERFLOW_FLAG | ZERO_FLAG | CARRY_FLAG)
+
+extern u16 decimal_adc_table[2][256][256];
+extern u16 decimal_sbc_table[2][256][256];
+
+void decimal_init(void);
+u16 decimal_adc(u8 a, u8 value, u8 carry);
+u16 decimal_sbc(u8 a, u8 value, u8 carry);
+
+#endif
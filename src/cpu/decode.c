@@ -0,0 +1,87 @@
+#include "decode.h"
+#include "cpu.h"
+#include "instruction.h"
+
+decode_t *decode_create(void)
+{
+    return calloc(1, sizeof(decode_t));
+}
+
+void decode_destroy(decode_t *decode)
+{
+    free(decode);
+}
+
+// Drop every entry and stop watching: memory was remapped
+void decode_flush(cpu_t *cpu)
+{
+    decode_t *decode = cpu->decode;
+
+    for (unsigned page = 0; page < MEM_PAGES; page++)
+    {
+        if (decode->watching[page])
+            mem_watch(&cpu->mem, page, false);
+    }
+
+    memset(decode->entries, 0, sizeof(decode->entries));
+    memset(decode->gen, 0, sizeof(decode->gen));
+    memset(decode->watching, 0, sizeof(decode->watching));
+}
+
+// Keep the instruction cpu_cycle has just decoded at pc, before it runs,
+// so a write it makes to its own page already counts against the entry
+void decode_fill(cpu_t *cpu, u16 pc, u8 opcode)
+{
+    decode_t *decode = cpu->decode;
+    const opcode_t *op = &opcodes[opcode];
+    unsigned page = pc >> 8;
+    const u8 *base = cpu->mem.read[page];
+    u8 length = addr_mode_lengths[op->addr_mode];
+
+    // Devices have no read pointer: fetching from them stays a device read
+    if (page < 2 || base == NULL || (pc & 0xFF) + length > MEM_PAGE_SIZE)
+        return;
+
+    if (!decode->watching[page])
+    {
+        mem_watch(&cpu->mem, page, true);
+        decode->watching[page] = true;
+    }
+
+    const u8 *bytes = base + (pc & 0xFF);
+    u16 operand = length == 1 ? 0 : length == 2 ? bytes[1] : bytes[1] | bytes[2] << 8;
+
+    switch (op->addr_mode)
+    {
+    case IMM:
+        operand = pc + 1;
+        break;
+    case REL:
+        operand = (u16)(i8)operand;
+        break;
+    default:
+        break;
+    }
+
+    decode->entries[pc] = (decoded_t){op->operation, operand, decode->gen[page], opcode,
+                                      op->addr_mode, length, op->cycles};
+    decode->decoded++;
+}
+
+// Watch hook: a byte of a page with entries was written. When the
+// generation comes round again the old entries could look current, so they
+// go
+void decode_write(decode_t *decode, u16 address)
+{
+    unsigned page = address >> 8;
+
+    decode->invalidations++;
+    if (++decode->gen[page] == 0)
+        memset(&decode->entries[page * MEM_PAGE_SIZE], 0, MEM_PAGE_SIZE * sizeof(decoded_t));
+}
+
+void decode_report(const decode_t *decode, FILE *out)
+{
+    fprintf(out, "Predecode: %llu instructions decoded, %llu page invalidations\n",
+            (unsigned long long)decode->decoded, (unsigned long long)decode->invalidations);
+}
@@ -0,0 +1,55 @@
+#ifndef DECODE_H
+#define DECODE_H
+
+#include "utils/util.h"
+#include "mem/memory.h"
+
+struct cpu_t;
+
+// An instruction as cpu_cycle decoded it the last time it ran. ZP, ABS,
+// IMM and REL operands are stored as the address the operation gets;
+// indexed and indirect modes keep the operand bytes and add the registers
+// or read the pointer when they run
+typedef struct
+{
+    void (*operation)(struct cpu_t *cpu, u16 addr); // NULL when not decoded
+    u16 operand;
+    u16 gen;    // Write generation of the page it was decoded in
+    u8 opcode;
+    u8 mode;    // enum ADDR_MODES
+    u8 length;  // Bytes, PC moves on by this much
+    u8 cycles;  // Base cycles, before page crossings and taken branches
+} decoded_t;
+
+// Predecoded instruction cache, by PC. Every page with an entry is
+// watched, and each write to it moves the page to a new generation, which
+// makes all its entries stale at once. Only instructions wholly inside one
+// RAM or ROM page are kept, outside the zero page and the stack
+typedef struct decode_t
+{
+    decoded_t entries[MEMORY_SIZE];
+    u16 gen[MEM_PAGES];
+    bool watching[MEM_PAGES];
+
+    u64 decoded;       // Entries filled
+    u64 invalidations; // Writes to pages with entries
+} decode_t;
+
+decode_t *decode_create(void);
+void decode_destroy(decode_t *decode);
+void decode_flush(struct cpu_t *cpu);
+void decode_fill(struct cpu_t *cpu, u16 pc, u8 opcode);
+void decode_write(decode_t *decode, u16 address);
+void decode_report(const decode_t *decode, FILE *out);
+
+// The entry for pc, or NULL if it has to be decoded from memory
+static inline const decoded_t *decode_find(const decode_t *decode, u16 pc)
+{
+    const decoded_t *entry = &decode->entries[pc];
+
+    if (entry->operation && entry->gen == decode->gen[pc >> 8])
+        return entry;
+    return NULL;
+}
+
+#endif
@@ -1,4 +1,5 @@
 #include "instruction.h"
+#include "decimal.h"
 
 u16 imm_address(cpu_t *cpu) {
     return cpu->PC++;
@@ -31,7 +32,7 @@ u16 abx_address(cpu_t *cpu) {
     u16 base = (hi << 8) | lo;
     u16 effective = base + cpu->X;
 
-    if ((base & 0xFF00) != (effective & 0xFF00)) cpu->temp_cycles++;
+    cpu->page_crossed = (base & 0xFF00) != (effective & 0xFF00);
 
     return effective; 
 }
@@ -42,7 +43,7 @@ u16 aby_address(cpu_t *cpu) {
     u16 base = (hi << 8) | lo;
     u16 effective = base + cpu->Y;
 
-    if ((base & 0xFF00) != (effective & 0xFF00)) cpu->temp_cycles++;
+    cpu->page_crossed = (base & 0xFF00) != (effective & 0xFF00);
 
     return effective; 
 }
@@ -79,7 +80,7 @@ u16 indy_address(cpu_t *cpu) {
     u16 base = ((hi << 8) | lo);
     u16 effective = base + cpu->Y;
 
-    if ((base & 0xFF00) != (effective & 0xFF00)) cpu->temp_cycles++;
+    cpu->page_crossed = (base & 0xFF00) != (effective & 0xFF00);
 
     return effective;
 }
@@ -97,8 +98,7 @@ void LDA(cpu_t *cpu, u16 addr)
     u8 value = read_memory(cpu, addr);
     cpu->A = value;
 
-    cpu->Z = (cpu->A == 0);
-  	cpu->N = (cpu->A >> 7) & 1;  
+    cpu_set_nz(cpu, cpu->A);
 }
 
 void LDX(cpu_t *cpu, u16 addr)
@@ -106,8 +106,7 @@ void LDX(cpu_t *cpu, u16 addr)
     u8 value = read_memory(cpu, addr);
     cpu->X = value;
 
-    cpu->Z = (cpu->X == 0);
-	cpu->N = (cpu->X >> 7) & 1;  
+    cpu_set_nz(cpu, cpu->X);
 }
 
 void LDY(cpu_t *cpu, u16 addr)
@@ -115,8 +114,7 @@ void LDY(cpu_t *cpu, u16 addr)
     u8 value = read_memory(cpu, addr);
     cpu->Y = value;
 
-    cpu->Z = (cpu->Y == 0);
-	cpu->N = (cpu->Y >> 7) & 1;  
+    cpu_set_nz(cpu, cpu->Y);
 }
 
 void STA(cpu_t *cpu, u16 addr)
@@ -140,22 +138,19 @@ void INC(cpu_t *cpu, u16 addr)
     value = (value + 1) & 0xFF;
     write_memory(cpu, addr, value);
 
-    cpu->Z = (value == 0);
-    cpu->N = (value >> 7) & 1;
+    cpu_set_nz(cpu, value);
 }
 
 void INX(cpu_t *cpu, u16 addr)
 {
     cpu->X = (cpu->X + 1) & 0xFF;
-    cpu->Z = (cpu->X == 0);
-    cpu->N = (cpu->X >> 7) & 1;
+    cpu_set_nz(cpu, cpu->X);
 }
 
 void INY(cpu_t *cpu, u16 addr)
 {
     cpu->Y = (cpu->Y + 1) & 0xFF;
-    cpu->Z = (cpu->Y == 0);
-    cpu->N = (cpu->Y >> 7) & 1;
+    cpu_set_nz(cpu, cpu->Y);
 }
 
 void DEC(cpu_t *cpu, u16 addr)
@@ -164,22 +159,19 @@ void DEC(cpu_t *cpu, u16 addr)
     value = (value - 1) & 0xFF;
     write_memory(cpu, addr, value);
 
-    cpu->Z = (value == 0);
-    cpu->N = (value >> 7) & 1;
+    cpu_set_nz(cpu, value);
 }
 
 void DEX(cpu_t *cpu, u16 addr)
 {
     cpu->X = (cpu->X - 1) & 0xFF;
-    cpu->Z = (cpu->X == 0);
-    cpu->N = (cpu->X >> 7) & 1;
+    cpu_set_nz(cpu, cpu->X);
 }
 
 void DEY(cpu_t *cpu, u16 addr)
 {
     cpu->Y = (cpu->Y - 1) & 0xFF;
-    cpu->Z = (cpu->Y == 0);
-    cpu->N = (cpu->Y >> 7) & 1;
+    cpu_set_nz(cpu, cpu->Y);
 }
 
 void PHA(cpu_t *cpu, u16 addr)
@@ -190,17 +182,7 @@ void PHA(cpu_t *cpu, u16 addr)
 
 void PHP(cpu_t *cpu, u16 addr)
 {
-    u8 value = 0;
-    value |= cpu->C ? CARRY_FLAG : 0;  
-    value |= cpu->Z ? ZERO_FLAG : 0;  
-    value |= cpu->I ? INTERRUPT_FLAG : 0;  
-    value |= cpu->D ? DECIMAL_FLAG : 0;  
-    value |= BREAK_FLAG;               
-    value |= 0x20;               
-    value |= cpu->V ? OVERFLOW_FLAG : 0;  
-    value |= cpu->N ? NEGATIVE_FLAG : 0;  
-
-    write_memory(cpu, (0x100 | cpu->SP), value);
+    write_memory(cpu, (0x100 | cpu->SP), cpu_status(cpu) | BREAK_FLAG);
     cpu->SP--;
 }
 
@@ -209,61 +191,67 @@ void PLA(cpu_t *cpu, u16 addr)
     cpu->SP++;
     cpu->A = read_memory(cpu, (0x0100 | cpu->SP));
     
-    cpu->Z = (cpu->A == 0);
-    cpu->N = (cpu->A >> 7) & 1;
+    cpu_set_nz(cpu, cpu->A);
 }
 
 void PLP(cpu_t *cpu, u16 addr)
 {
+    u8 old_p = cpu->P;
+
     cpu->SP++;
-    u8 value = read_memory(cpu, (0x100 | cpu->SP));
+    cpu_set_status(cpu, read_memory(cpu, (0x100 | cpu->SP)));
+    cpu_delay_irq(cpu, old_p, 4);
+}
+
+// Taken branches cost one extra cycle, two if the target is on another page
+static inline void branch(cpu_t *cpu, bool taken, u16 addr)
+{
+    if (!taken)
+        return;
 
-    cpu->C = (value & CARRY_FLAG);
-    cpu->Z = (value & ZERO_FLAG);
-    cpu->I = (value & INTERRUPT_FLAG);
-    cpu->D = (value & DECIMAL_FLAG);
-    cpu->V = (value & OVERFLOW_FLAG);
-    cpu->N = (value & NEGATIVE_FLAG);
+    u16 target = cpu->PC + (i8)addr;
+    cpu->temp_cycles += ((cpu->PC ^ target) & 0xFF00) ? 2 : 1;
+    cpu->PC = target;
 }
 
 void BCC(cpu_t *cpu, u16 addr)
 {
-    if (cpu->C == 0) cpu->PC += (i8)addr;
+    branch(cpu, !(cpu->P & CARRY_FLAG), addr);
 }
 
 void BCS(cpu_t *cpu, u16 addr)
 {
-    if (cpu->C == 1) cpu->PC += (i8)addr;
+    branch(cpu, cpu->P & CARRY_FLAG, addr);
 }
 
 void BEQ(cpu_t *cpu, u16 addr)
 {
-    if (cpu->Z == 1) cpu->PC += (i8)addr;
+    branch(cpu, cpu_zero(cpu), addr);
 }
 
 void BNE(cpu_t *cpu, u16 addr)
 {
-    if (cpu->Z == 0) cpu->PC += (i8)addr;
+    branch(cpu, !cpu_zero(cpu), addr);
 }
 
 void BMI(cpu_t *cpu, u16 addr)
 {
-    if (cpu->N == 1) cpu->PC += (i8)addr;
+    branch(cpu, cpu_negative(cpu), addr);
 }
 
 void BPL(cpu_t *cpu, u16 addr)
 {
-    if (cpu->N == 0) cpu->PC += (i8)addr;
+    branch(cpu, !cpu_negative(cpu), addr);
 }
 
 void BVC(cpu_t *cpu, u16 addr)
 {
-    if (cpu->V == 0) cpu->PC += (i8)addr;
+    branch(cpu, !(cpu->P & OVERFLOW_FLAG), addr);
 }
 
 void BVS(cpu_t *cpu, u16 addr)
 {
-    if (cpu->V == 1) cpu->PC += (i8)addr;
+    branch(cpu, cpu->P & OVERFLOW_FLAG, addr);
 }
 
 // Jump
@@ -297,17 +285,9 @@ void RTS(cpu_t *cpu, u16 addr)
 
 void RTI(cpu_t *cpu, u16 addr)
 {
-    // Resotre Processor Status
+    // Restore Processor Status
     cpu->SP++;
-    u8 value = read_memory(cpu, (0x100 | cpu->SP));
-
-    cpu->C = (value & CARRY_FLAG);
-    cpu->Z = (value & ZERO_FLAG);
-    cpu->I = (value & INTERRUPT_FLAG);
-    cpu->D = (value & DECIMAL_FLAG);
-    cpu->B = (value & BREAK_FLAG);
-    cpu->V = (value & OVERFLOW_FLAG);
-    cpu->N = (value & NEGATIVE_FLAG);
+    cpu_set_status(cpu, read_memory(cpu, (0x100 | cpu->SP)));
 
     // Low Byte of Return Address
     cpu->SP++;
@@ -318,45 +298,41 @@ void RTI(cpu_t *cpu, u16 addr)
     u8 hi = read_memory(cpu, (0x100 | cpu->SP));
 
     cpu->PC = (hi << 8) | lo;
+    cpu_check_irq(cpu);
 }
 
 void TAX(cpu_t *cpu, u16 addr)
 {
     cpu->X = cpu->A;
 
-    cpu->Z = (cpu->X == 0);
-  	cpu->N = (cpu->X >> 7) & 1;    
+    cpu_set_nz(cpu, cpu->X);
 }
 
 void TAY(cpu_t *cpu, u16 addr)
 {
     cpu->Y = cpu->A;
     
-    cpu->Z = (cpu->Y == 0);
-  	cpu->N = (cpu->Y >> 7) & 1;    
+    cpu_set_nz(cpu, cpu->Y);
 }
 
 void TXA(cpu_t *cpu, u16 addr)
 {
     cpu->A = cpu->X;
     
-    cpu->Z = (cpu->A == 0);
-  	cpu->N = (cpu->A >> 7) & 1;    
+    cpu_set_nz(cpu, cpu->A);
 } 
 
 void TYA(cpu_t *cpu, u16 addr)
 {
     cpu->A = cpu->Y;
     
-    cpu->Z = (cpu->A == 0);
-  	cpu->N = (cpu->A >> 7) & 1;    
+    cpu_set_nz(cpu, cpu->A);
 }
 
 void TSX(cpu_t *cpu, u16 addr)
 {
     cpu->X = cpu->SP;
-    cpu->Z = (cpu->X == 0);
-  	cpu->N = (cpu->X >> 7) & 1;    
+    cpu_set_nz(cpu, cpu->X);
 }
 
 void TXS(cpu_t *cpu, u16 addr)
@@ -365,233 +341,215 @@ void TXS(cpu_t *cpu, u16 addr)
 }
 
 // Arithmetic & Logic
+// Decimal mode result and flags come from the tables in decimal.c
+static inline void decimal_apply(cpu_t *cpu, u16 entry)
+{
+    u8 flags = entry >> 8;
+
+    cpu->A = entry & 0xFF;
+    cpu->P = (cpu->P & ~(CARRY_FLAG | OVERFLOW_FLAG)) | (flags & (CARRY_FLAG | OVERFLOW_FLAG));
+    cpu->nz = (flags & ZERO_FLAG ? 0 : 1) | ((flags & NEGATIVE_FLAG) << 8);
+}
+
 void ADC(cpu_t *cpu, u16 addr)
 {
     u8 value = read_memory(cpu, addr);
-    u16 result = cpu->A + value + cpu->C;
 
-    if (cpu->D) {
-        u16 tmp = (cpu->A & 0x0F) + (value & 0x0F) + cpu->C;
-
-        if (tmp > 9) {
-            result += 6;
-        }
-        if (result > 0x99) {
-            result += 0x60;
-        }
+    if (cpu->P & DECIMAL_FLAG) {
+        decimal_apply(cpu, decimal_adc_table[cpu_carry(cpu)][cpu->A][value]);
+        return;
     }
 
-    cpu->C = (result & 0x100) != 0;
-  	cpu->V = ((cpu->A ^ result) & (value ^ result) & NEGATIVE_FLAG) != 0;
+    u16 result = cpu->A + value + cpu_carry(cpu);
+
+    // Carry is bit 8 of the sum, overflow lands on bit 6 from bit 7
+    cpu->P = (cpu->P & ~(CARRY_FLAG | OVERFLOW_FLAG)) | (result >> 8) |
+             (((cpu->A ^ result) & (value ^ result) & NEGATIVE_FLAG) >> 1);
 
     cpu->A = result & 0xFF;
 
-    cpu->Z = (cpu->A == 0);
-    cpu->N = (cpu->A >> 7) & 1;
+    cpu_set_nz(cpu, cpu->A);
 }
 
 void SBC(cpu_t *cpu, u16 addr)
 {
     u8 value = read_memory(cpu, addr);
-    u16 result = cpu->A - value - (1 - cpu->C);
-    cpu->C = (result < 0x100) != 0;  
-    cpu->V = ((cpu->A ^ result) & (~value ^ result) & 0x80) != 0;
-    
 
-    if (cpu->D) {
-        // Decimal mode adjustment
-        u16 tmp = result;
-
-        // Low nibble adjust
-        if (((cpu->A & 0x0F) - (1 - cpu->C)) < (value & 0x0F)) {
-            tmp -= 0x06;
-        }
+    if (cpu->P & DECIMAL_FLAG) {
+        decimal_apply(cpu, decimal_sbc_table[cpu_carry(cpu)][cpu->A][value]);
+        return;
+    }
 
-        // High nibble adjust
-        if (tmp > 0x99) {
-            tmp -= 0x60;
-        }
+    u16 result = cpu->A - value - (1 - cpu_carry(cpu));
 
-        result = tmp;
-    }
+    cpu->P = (cpu->P & ~(CARRY_FLAG | OVERFLOW_FLAG)) | (result < 0x100) |
+             (((cpu->A ^ result) & (~value ^ result) & NEGATIVE_FLAG) >> 1);
 
     cpu->A = result & 0xFF;
 
-    cpu->Z = (cpu->A == 0);
-    cpu->N = (cpu->A >> 7) & 1;
+    cpu_set_nz(cpu, cpu->A);
 }
 
 void AND(cpu_t *cpu, u16 addr)
 {
     cpu->A &= read_memory(cpu, addr);
-    cpu->Z = (cpu->A == 0);
-    cpu->N = (cpu->A >> 7) & 1;
+    cpu_set_nz(cpu, cpu->A);
 }
 
 void EOR(cpu_t *cpu, u16 addr)
 {
     cpu->A ^= read_memory(cpu, addr);
-    cpu->Z = (cpu->A == 0);
-    cpu->N = (cpu->A >> 7) & 1;
+    cpu_set_nz(cpu, cpu->A);
 }
 
 void ORA(cpu_t *cpu, u16 addr)
 {
     cpu->A |= read_memory(cpu, addr);
-    cpu->Z = (cpu->A == 0);
-    cpu->N = (cpu->A >> 7) & 1;
+    cpu_set_nz(cpu, cpu->A);
 }
 
 void CMP(cpu_t *cpu, u16 addr)
 {
     u8 value = read_memory(cpu, addr);
     u8 result = cpu->A - value;
-    cpu->C = (cpu->A >= value);
-    cpu->Z = (result == 0);
-    cpu->N = (result >> 7) & 1;
+    cpu_set_flag(cpu, CARRY_FLAG, cpu->A >= value);
+    cpu_set_nz(cpu, result);
 }
 
 void CPX(cpu_t *cpu, u16 addr)
 {
     u8 value = read_memory(cpu, addr);
     u8 result = cpu->X - value;
-    cpu->C = (cpu->X >= value);
-    cpu->Z = (result == 0);
-    cpu->N = (result >> 7) & 1;
+    cpu_set_flag(cpu, CARRY_FLAG, cpu->X >= value);
+    cpu_set_nz(cpu, result);
 }
 
 void CPY(cpu_t *cpu, u16 addr)
 {
     u8 value = read_memory(cpu, addr);
     u16 result = (u16)cpu->Y - (u16)value;
-    cpu->C = (cpu->Y >= value);
-    cpu->Z = (result == 0);
-    cpu->N = (result >> 7) & 1;
+    cpu_set_flag(cpu, CARRY_FLAG, cpu->Y >= value);
+    cpu_set_nz(cpu, result);
 }
 
 void ASL_ACC(cpu_t *cpu, u16 addr)
 {
-    cpu->C = (cpu->A >> 7) & 1;
+    cpu_set_flag(cpu, CARRY_FLAG, cpu->A & NEGATIVE_FLAG);
     cpu->A <<= 1;
-    cpu->Z = (cpu->A == 0);
-    cpu->N = (cpu->A & 0x80) != 0;
+    cpu_set_nz(cpu, cpu->A);
 }
 
 void ASL(cpu_t *cpu, u16 addr)
 {
     u8 value = read_memory(cpu, addr);
-    cpu->C = (value >> 7) & 1;
+    cpu_set_flag(cpu, CARRY_FLAG, value & NEGATIVE_FLAG);
     value <<= 1;
-    cpu->Z = (value == 0);
-  	cpu->N = (value >> 7) & 1;
+    cpu_set_nz(cpu, value);
 
     write_memory(cpu, addr, value);
 }
 
 void LSR_ACC(cpu_t *cpu, u16 addr) {
-    cpu->C = (cpu->A & CARRY_FLAG) != 0;
+    cpu_set_flag(cpu, CARRY_FLAG, cpu->A & CARRY_FLAG);
     cpu->A >>= 1;
-    cpu->Z = (cpu->A == 0);
-    cpu->N = (cpu->A >> 7) & 1;
+    cpu_set_nz(cpu, cpu->A);
 }
 
 void LSR(cpu_t *cpu, u16 addr) {
     u8 value = read_memory(cpu, addr);
-    cpu->C = (value & CARRY_FLAG) != 0;
+    cpu_set_flag(cpu, CARRY_FLAG, value & CARRY_FLAG);
     value >>= 1;
-    cpu->Z = (value == 0);
-    cpu->N = (value >> 7) & 1;
+    cpu_set_nz(cpu, value);
     write_memory(cpu, addr, value);
 }
 
 void ROL_ACC(cpu_t *cpu, u16 addr)
 {
-    u8 old_c = cpu->C;
-    cpu->C = (cpu->A & NEGATIVE_FLAG) != 0;  
+    u8 old_c = cpu_carry(cpu);
+    cpu_set_flag(cpu, CARRY_FLAG, cpu->A & NEGATIVE_FLAG);
     cpu->A = (cpu->A << 1) | old_c;
-    cpu->Z = (cpu->A == 0);
-	cpu->N = (cpu->A >> 7) & 1;
+    cpu_set_nz(cpu, cpu->A);
 }
 
 void ROL(cpu_t *cpu, u16 addr)
 {
-    u8 old_c = cpu->C;
+    u8 old_c = cpu_carry(cpu);
     u8 value = read_memory(cpu, addr);
-    cpu->C = (value & NEGATIVE_FLAG) != 0;       
+    cpu_set_flag(cpu, CARRY_FLAG, value & NEGATIVE_FLAG);
     value = (value << 1) | old_c;       
-    cpu->Z = (value == 0);
-	cpu->N = (value >> 7) & 1;              
+    cpu_set_nz(cpu, value);
 
     write_memory(cpu, addr, value);
 }
 
 void ROR_ACC(cpu_t *cpu, u16 addr) {
-    u8 old_c = cpu->C;
-    cpu->C = (cpu->A & CARRY_FLAG) != 0;
+    u8 old_c = cpu_carry(cpu);
+    cpu_set_flag(cpu, CARRY_FLAG, cpu->A & CARRY_FLAG);
     cpu->A = (cpu->A >> 1) | (old_c << 7);
-    cpu->Z = (cpu->A == 0);
-    cpu->N = (cpu->A >> 7) & 1;
+    cpu_set_nz(cpu, cpu->A);
 }
 
 void ROR(cpu_t *cpu, u16 addr) {
-    u8 old_c = cpu->C;
+    u8 old_c = cpu_carry(cpu);
     u8 value = read_memory(cpu, addr);
-    cpu->C = (value & CARRY_FLAG) != 0;
+    cpu_set_flag(cpu, CARRY_FLAG, value & CARRY_FLAG);
     value = (value >> 1) | (old_c << 7);
-    cpu->Z = (value == 0);
-    cpu->N = (value >> 7) & 1;
+    cpu_set_nz(cpu, value);
     write_memory(cpu, addr, value);
 }
 
 void SEC(cpu_t *cpu, u16 addr)
 {
-    cpu->C = 1;
+    cpu->P |= CARRY_FLAG;
 }
 
 void SED(cpu_t *cpu, u16 addr)
 {
-    cpu->D = 1;
+    cpu->P |= DECIMAL_FLAG;
 }
 
 void SEI(cpu_t *cpu, u16 addr)
 {
-    cpu->I = 1;
+    u8 old_p = cpu->P;
+
+    cpu->P |= INTERRUPT_FLAG;
+    cpu_delay_irq(cpu, old_p, 2);
 }
 
 void CLC(cpu_t *cpu, u16 addr)
 {
-    cpu->C = 0;
+    cpu->P &= ~CARRY_FLAG;
 }
 
 void CLD(cpu_t *cpu, u16 addr)
 {
-    cpu->D = 0;
+    cpu->P &= ~DECIMAL_FLAG;
 }
 
 void CLI(cpu_t *cpu, u16 addr)
 {
-    cpu->I = 0;
+    u8 old_p = cpu->P;
+
+    cpu->P &= ~INTERRUPT_FLAG;
+    cpu_delay_irq(cpu, old_p, 2);
 }
 
 void CLV(cpu_t *cpu, u16 addr)
 {
-    cpu->V = 0;
+    cpu->P &= ~OVERFLOW_FLAG;
 }
 
 void BIT(cpu_t *cpu, u16 addr)
 {
     u8 value = read_memory(cpu, addr);
-    u8 result = cpu->A & value;
 
-    cpu->Z = (result == 0);
-    cpu->N = (value >> 7) & 1;
-    cpu->V = (value >> 6) & 1;
+    // Z from A AND M, N and V straight from bits 7 and 6 of M
+    cpu->nz = (cpu->A & value) | (value << 8);
+    cpu_set_flag(cpu, OVERFLOW_FLAG, value & OVERFLOW_FLAG);
 }
 
 void BRK(cpu_t *cpu, u16 addr)
 {
-    cpu->I = 1;
-
     u16 return_addr = cpu->PC + 1;
 
     write_memory(cpu, 0x100 | cpu->SP, (return_addr >> 8) & 0xFF); 
@@ -600,19 +558,10 @@ void BRK(cpu_t *cpu, u16 addr)
     write_memory(cpu, 0x100 | cpu->SP, return_addr & 0xFF);        
     cpu->SP--;
 
-    u8 value = 0;
-    value |= cpu->C ? CARRY_FLAG : 0;  
-    value |= cpu->Z ? ZERO_FLAG : 0;  
-    value |= cpu->I ? INTERRUPT_FLAG : 0;  
-    value |= cpu->D ? DECIMAL_FLAG : 0;  
-    value |= BREAK_FLAG;               
-    value |= 0x20;               
-    value |= cpu->V ? OVERFLOW_FLAG : 0;  
-    value |= cpu->N ? NEGATIVE_FLAG: 0;  
-
-    write_memory(cpu, (0x100 | cpu->SP), value);
+    write_memory(cpu, (0x100 | cpu->SP), cpu_status(cpu) | BREAK_FLAG);
     cpu->SP--;
 
+    cpu->P |= INTERRUPT_FLAG;
     cpu->PC = (read_memory(cpu, BRK_LOW_ADDR)) | (read_memory(cpu, BRK_HIGH_ADDR) << 8);
 }
 
@@ -621,184 +570,165 @@ void NOP(cpu_t *cpu, u16 addr)
 
 }
 
+// Undocumented NMOS opcodes
+
+// "Magic" constant the unstable ANE/LXA opcodes OR into A on most chips
+#define UNSTABLE_MAGIC 0xEE
+
+void SLO(cpu_t *cpu, u16 addr)
+{
+    ASL(cpu, addr);
+    ORA(cpu, addr);
+}
+
+void RLA(cpu_t *cpu, u16 addr)
+{
+    ROL(cpu, addr);
+    AND(cpu, addr);
+}
+
+void SRE(cpu_t *cpu, u16 addr)
+{
+    LSR(cpu, addr);
+    EOR(cpu, addr);
+}
+
+void RRA(cpu_t *cpu, u16 addr)
+{
+    ROR(cpu, addr);
+    ADC(cpu, addr);
+}
+
+void DCP(cpu_t *cpu, u16 addr)
+{
+    DEC(cpu, addr);
+    CMP(cpu, addr);
+}
+
+void ISC(cpu_t *cpu, u16 addr)
+{
+    INC(cpu, addr);
+    SBC(cpu, addr);
+}
+
+void LAX(cpu_t *cpu, u16 addr)
+{
+    LDA(cpu, addr);
+    cpu->X = cpu->A;
+}
+
+void SAX(cpu_t *cpu, u16 addr)
+{
+    write_memory(cpu, addr, cpu->A & cpu->X);
+}
+
+void LAS(cpu_t *cpu, u16 addr)
+{
+    u8 value = read_memory(cpu, addr) & cpu->SP;
+    cpu->A = cpu->X = cpu->SP = value;
+
+    cpu_set_nz(cpu, value);
+}
+
+void ANC(cpu_t *cpu, u16 addr)
+{
+    AND(cpu, addr);
+    cpu_set_flag(cpu, CARRY_FLAG, cpu_negative(cpu));
+}
+
+void ALR(cpu_t *cpu, u16 addr)
+{
+    AND(cpu, addr);
+    LSR_ACC(cpu, addr);
+}
+
+void ARR(cpu_t *cpu, u16 addr)
+{
+    AND(cpu, addr);
+    ROR_ACC(cpu, addr);
+
+    // Carry and overflow come from bits 6 and 5 of the result
+    cpu_set_flag(cpu, CARRY_FLAG, (cpu->A >> 6) & 1);
+    cpu_set_flag(cpu, OVERFLOW_FLAG, ((cpu->A >> 6) ^ (cpu->A >> 5)) & 1);
+}
+
+void SBX(cpu_t *cpu, u16 addr)
+{
+    u8 value = read_memory(cpu, addr);
+    u8 ax = cpu->A & cpu->X;
+
+    cpu_set_flag(cpu, CARRY_FLAG, ax >= value);
+    cpu->X = ax - value;
+    cpu_set_nz(cpu, cpu->X);
+}
+
+void ANE(cpu_t *cpu, u16 addr)
+{
+    cpu->A = (cpu->A | UNSTABLE_MAGIC) & cpu->X & read_memory(cpu, addr);
+    cpu_set_nz(cpu, cpu->A);
+}
+
+void LXA(cpu_t *cpu, u16 addr)
+{
+    cpu->A = cpu->X = (cpu->A | UNSTABLE_MAGIC) & read_memory(cpu, addr);
+    cpu_set_nz(cpu, cpu->A);
+}
+
+void SHA(cpu_t *cpu, u16 addr)
+{
+    u8 high = (u16)(addr - cpu->Y) >> 8;
+    write_memory(cpu, addr, cpu->A & cpu->X & (high + 1));
+}
+
+void SHX(cpu_t *cpu, u16 addr)
+{
+    u8 high = (u16)(addr - cpu->Y) >> 8;
+    write_memory(cpu, addr, cpu->X & (high + 1));
+}
+
+void SHY(cpu_t *cpu, u16 addr)
+{
+    u8 high = (u16)(addr - cpu->X) >> 8;
+    write_memory(cpu, addr, cpu->Y & (high + 1));
+}
+
+void TAS(cpu_t *cpu, u16 addr)
+{
+    u8 high = (u16)(addr - cpu->Y) >> 8;
+    cpu->SP = cpu->A & cpu->X;
+    write_memory(cpu, addr, cpu->SP & (high + 1));
+}
+
+void JAM(cpu_t *cpu, u16 addr)
+{
+    cpu_halt(cpu, HALT_JAM);
+}
+
 opcode_t opcodes[256] = {
-    [0xA9] = {IMM, 2, LDA}, // LDA Immediate
-    [0xA5] = {ZP, 3, LDA},  // LDA Zero Page
-    [0xB5] = {ZPX, 4, LDA}, // LDA Zero Page,X
-    [0xAD] = {ABS, 4, LDA}, // LDA Absolute
-    [0xBD] = {ABX, 4, LDA}, // LDA Absolute,X
-    [0xB9] = {ABY, 4, LDA}, // LDA Absolute,Y
-    [0xA1] = {IDX, 6, LDA}, // LDA (Indirect,X)
-    [0xB1] = {IDY, 5, LDA}, // LDA (Indirect),Y
-
-    [0xA2] = {IMM, 2, LDX}, // LDX Immediate
-    [0xA6] = {ZP, 3, LDX},  // LDX Zero Page
-    [0xB6] = {ZPY, 4, LDX}, // LDX Zero Page,Y
-    [0xAE] = {ABS, 4, LDX}, // LDX Absolute
-    [0xBE] = {ABY, 4, LDX}, // LDX Absolute,Y
-
-    [0xA0] = {IMM, 2, LDY}, // LDY Immediate
-    [0xA4] = {ZP, 3, LDY},  // LDY Zero Page
-    [0xB4] = {ZPX, 4, LDY}, // LDY Zero Page,X
-    [0xAC] = {ABS, 4, LDY}, // LDY Absolute
-    [0xBC] = {ABX, 4, LDY}, // LDY Absolute,X
-
-    [0x85] = {ZP, 3, STA},  // STA Zero Page
-    [0x95] = {ZPX, 4, STA}, // STA Zero Page,X
-    [0x8D] = {ABS, 4, STA}, // STA Absolute
-    [0x9D] = {ABX, 5, STA}, // STA Absolute,X
-    [0x99] = {ABY, 5, STA}, // STA Absolute,Y
-    [0x81] = {IDX, 6, STA}, // STA (Indirect,X)
-    [0x91] = {IDY, 6, STA}, // STA (Indirect),Y
-
-    [0x86] = {ZP, 3, STX},  // STX Zero Page
-    [0x96] = {ZPY, 4, STX}, // STX Zero Page,Y
-    [0x8E] = {ABS, 4, STX}, // STX Absolute
-
-    [0x84] = {ZP, 3, STY},  // STY Zero Page
-    [0x94] = {ZPX, 4, STY}, // STY Zero Page,X
-    [0x8C] = {ABS, 4, STY}, // STY Absolute
-
-    [0x69] = {IMM, 2, ADC}, // ADC Immediate
-    [0x65] = {ZP, 3, ADC},  // ADC Zero Page
-    [0x75] = {ZPX, 4, ADC}, // ADC Zero Page,X
-    [0x6D] = {ABS, 4, ADC}, // ADC Absolute
-    [0x7D] = {ABX, 4, ADC}, // ADC Absolute,X
-    [0x79] = {ABY, 4, ADC}, // ADC Absolute,Y
-    [0x61] = {IDX, 6, ADC}, // ADC (Indirect,X)
-    [0x71] = {IDY, 5, ADC}, // ADC (Indirect),Y
-
-    [0xE9] = {IMM, 2, SBC}, // SBC Immediate
-    [0xE5] = {ZP, 3, SBC},  // SBC Zero Page
-    [0xF5] = {ZPX, 4, SBC}, // SBC Zero Page,X
-    [0xED] = {ABS, 4, SBC}, // SBC Absolute
-    [0xFD] = {ABX, 4, SBC}, // SBC Absolute,X
-    [0xF9] = {ABY, 4, SBC}, // SBC Absolute,Y
-    [0xE1] = {IDX, 6, SBC}, // SBC (Indirect,X)
-    [0xF1] = {IDY, 5, SBC}, // SBC (Indirect),Y
-
-    [0x29] = {IMM, 2, AND}, // AND Immediate
-    [0x25] = {ZP, 3, AND},  // AND Zero Page
-    [0x35] = {ZPX, 4, AND}, // AND Zero Page,X
-    [0x2D] = {ABS, 4, AND}, // AND Absolute
-    [0x3D] = {ABX, 4, AND}, // AND Absolute,X
-    [0x39] = {ABY, 4, AND}, // AND Absolute,Y
-    [0x21] = {IDX, 6, AND}, // AND (Indirect,X)
-    [0x31] = {IDY, 5, AND}, // AND (Indirect),Y
-
-    [0x49] = {IMM, 2, EOR}, // EOR Immediate
-    [0x45] = {ZP, 3, EOR},  // EOR Zero Page
-    [0x55] = {ZPX, 4, EOR}, // EOR Zero Page,X
-    [0x4D] = {ABS, 4, EOR}, // EOR Absolute
-    [0x5D] = {ABX, 4, EOR}, // EOR Absolute,X
-    [0x59] = {ABY, 4, EOR}, // EOR Absolute,Y
-    [0x41] = {IDX, 6, EOR}, // EOR (Indirect,X)
-    [0x51] = {IDY, 5, EOR}, // EOR (Indirect),Y
-
-    [0x09] = {IMM, 2, ORA}, // ORA Immediate
-    [0x05] = {ZP, 3, ORA},  // ORA Zero Page
-    [0x15] = {ZPX, 4, ORA}, // ORA Zero Page,X
-    [0x0D] = {ABS, 4, ORA}, // ORA Absolute
-    [0x1D] = {ABX, 4, ORA}, // ORA Absolute,X
-    [0x19] = {ABY, 4, ORA}, // ORA Absolute,Y
-    [0x01] = {IDX, 6, ORA}, // ORA (Indirect,X)
-    [0x11] = {IDY, 5, ORA}, // ORA (Indirect),Y
-
-    [0xC9] = {IMM, 2, CMP}, // CMP Immediate
-    [0xC5] = {ZP, 3, CMP},  // CMP Zero Page
-    [0xD5] = {ZPX, 4, CMP}, // CMP Zero Page,X
-    [0xCD] = {ABS, 4, CMP}, // CMP Absolute
-    [0xDD] = {ABX, 4, CMP}, // CMP Absolute,X
-    [0xD9] = {ABY, 4, CMP}, // CMP Absolute,Y
-    [0xC1] = {IDX, 6, CMP}, // CMP (Indirect,X)
-    [0xD1] = {IDY, 5, CMP}, // CMP (Indirect),Y
-
-    [0xE0] = {IMM, 2, CPX}, // CPX Immediate
-    [0xE4] = {ZP, 3, CPX},  // CPX Zero Page
-    [0xEC] = {ABS, 4, CPX}, // CPX Absolute
-
-    [0xC0] = {IMM, 2, CPY}, // CPY Immediate
-    [0xC4] = {ZP, 3, CPY},  // CPY Zero Page
-    [0xCC] = {ABS, 4, CPY}, // CPY Absolute
-
-    [0x0A] = {IMP, 2, ASL_ACC}, // ASL Accumulator
-    [0x06] = {ZP, 5, ASL},  // ASL Zero Page
-    [0x16] = {ZPX, 6, ASL}, // ASL Zero Page,X
-    [0x0E] = {ABS, 6, ASL}, // ASL Absolute
-    [0x1E] = {ABX, 7, ASL}, // ASL Absolute,X
-
-    [0x4A] = {IMP, 2, LSR_ACC}, // LSR Accumulator
-    [0x46] = {ZP, 5, LSR},  // LSR Zero Page
-    [0x56] = {ZPX, 6, LSR}, // LSR Zero Page,X
-    [0x4E] = {ABS, 6, LSR}, // LSR Absolute
-    [0x5E] = {ABX, 7, LSR}, // LSR Absolute,X
-
-    [0x2A] = {IMP, 2, ROL_ACC}, // ROL Accumulator
-    [0x26] = {ZP, 5, ROL},  // ROL Zero Page
-    [0x36] = {ZPX, 6, ROL}, // ROL Zero Page,X
-    [0x2E] = {ABS, 6, ROL}, // ROL Absolute
-    [0x3E] = {ABX, 7, ROL}, // ROL Absolute,X
-
-    [0x6A] = {IMP, 2, ROR_ACC}, // ROR Accumulator
-    [0x66] = {ZP, 5, ROR},  // ROR Zero Page
-    [0x76] = {ZPX, 6, ROR}, // ROR Zero Page,X
-    [0x6E] = {ABS, 6, ROR}, // ROR Absolute
-    [0x7E] = {ABX, 7, ROR}, // ROR Absolute,X
-
-    [0x90] = {REL, 2, BCC}, // BCC Relative
-    [0xB0] = {REL, 2, BCS}, // BCS Relative
-    [0xF0] = {REL, 2, BEQ}, // BEQ Relative
-    [0xD0] = {REL, 2, BNE}, // BNE Relative
-    [0x30] = {REL, 2, BMI}, // BMI Relative
-    [0x10] = {REL, 2, BPL}, // BPL Relative
-    [0x50] = {REL, 2, BVC}, // BVC Relative
-    [0x70] = {REL, 2, BVS}, // BVS Relative
-
-    [0x4C] = {ABS, 3, JMP}, // JMP Absolute
-    [0x6C] = {IND, 5, JMP}, // JMP Indirect
-    [0x20] = {ABS, 6, JSR}, // JSR Absolute
-    [0x60] = {IMP, 6, RTS}, // RTS Implied
-    [0x40] = {IMP, 6, RTI}, // RTI Implied
-
-    [0xE6] = {ZP, 5, INC},  // INC Zero Page
-    [0xF6] = {ZPX, 6, INC}, // INC Zero Page,X
-    [0xEE] = {ABS, 6, INC}, // INC Absolute
-    [0xFE] = {ABX, 7, INC}, // INC Absolute,X
-
-    [0xE8] = {IMP, 2, INX}, // INX Implied
-    [0xC8] = {IMP, 2, INY}, // INY Implied
-
-    [0xC6] = {ZP, 5, DEC},  // DEC Zero Page
-    [0xD6] = {ZPX, 6, DEC}, // DEC Zero Page,X
-    [0xCE] = {ABS, 6, DEC}, // DEC Absolute
-    [0xDE] = {ABX, 7, DEC}, // DEC Absolute,X
-
-    [0xCA] = {IMP, 2, DEX}, // DEX Implied
-    [0x88] = {IMP, 2, DEY}, // DEY Implied
-
-    [0x24] = {ZP, 3, BIT},  // BIT Zero Page
-    [0x2C] = {ABS, 4, BIT}, // BIT Absolute
-
-    [0x38] = {IMP, 2, SEC}, // SEC Implied
-    [0xF8] = {IMP, 2, SED}, // SED Implied
-    [0x78] = {IMP, 2, SEI}, // SEI Implied
-    [0x18] = {IMP, 2, CLC}, // CLC Implied
-    [0xD8] = {IMP, 2, CLD}, // CLD Implied
-    [0x58] = {IMP, 2, CLI}, // CLI Implied
-    [0xB8] = {IMP, 2, CLV}, // CLV Implied
-
-    [0x48] = {IMP, 3, PHA}, // PHA Implied
-    [0x08] = {IMP, 3, PHP}, // PHP Implied
-    [0x68] = {IMP, 4, PLA}, // PLA Implied
-    [0x28] = {IMP, 4, PLP}, // PLP Implied
-
-    [0xAA] = {IMP, 2, TAX}, // TAX Implied
-    [0xA8] = {IMP, 2, TAY}, // TAY Implied
-    [0x8A] = {IMP, 2, TXA}, // TXA Implied
-    [0x98] = {IMP, 2, TYA}, // TYA Implied
-    [0xBA] = {IMP, 2, TSX}, // TSX Implied
-    [0x9A] = {IMP, 2, TXS}, // TXS Implied
-
-    [0x00] = {IMP, 7, BRK}, // BRK Implied
-    [0xEA] = {IMP, 2, NOP}, // NOP Implied
+#define OPCODE(op, mode, cycles, xpage, operation) [op] = {mode, cycles, xpage, operation, false},
+#define ILLEGAL(op, mode, cycles, xpage, operation) [op] = {mode, cycles, xpage, operation, true},
+#include "opcodes.def"
+#undef OPCODE
+};
+
+const char *const opcode_names[256] = {
+#define OPCODE(op, mode, cycles, xpage, operation) [op] = #operation,
+#include "opcodes.def"
+#undef OPCODE
 };
+
+const char *const addr_mode_names[ADDR_MODE_COUNT] = {
+    [IMM] = "IMM", [ZP] = "ZP", [ZPX] = "ZPX", [ZPY] = "ZPY", [ABS] = "ABS", [ABX] = "ABX",
+    [ABY] = "ABY", [IND] = "IND", [IDX] = "IDX", [IDY] = "IDY", [IMP] = "IMP", [REL] = "REL",
+};
+
+const u8 addr_mode_lengths[ADDR_MODE_COUNT] = {
+    [IMM] = 2, [ZP] = 2, [ZPX] = 2, [ZPY] = 2, [ABS] = 3, [ABX] = 3,
+    [ABY] = 3, [IND] = 3, [IDX] = 2, [IDY] = 2, [IMP] = 1, [REL] = 2,
+};
+
+#define OPCODE(op, mode, cycles, xpage, operation) + 1
+_Static_assert(0
+#include "opcodes.def"
+    == 256, "opcodes.def must list every opcode");
+#undef OPCODE
\ No newline at end of file
@@ -19,14 +19,21 @@ enum ADDR_MODES {
     REL 
 };
 
+#define ADDR_MODE_COUNT (REL + 1)
+
 typedef struct opcode_t
 {
     enum ADDR_MODES addr_mode;                             // Addressing Modes;   ;
     u8 cycles;                                // Base Cycle Count
+    u8 xpage;                                 // +1 cycle when indexing crosses a page
     void (*operation)(cpu_t *cpu, u16 addr);  // Pointer to Function Implementation
+    bool illegal;                             // Undocumented NMOS opcode
 } opcode_t;
 
 extern opcode_t opcodes[256];
+extern const char *const opcode_names[256];             // Operation name, e.g. "LDA"
+extern const char *const addr_mode_names[ADDR_MODE_COUNT];
+extern const u8 addr_mode_lengths[ADDR_MODE_COUNT];     // Instruction bytes, opcode included
 
 u16 imm_address(cpu_t *cpu);
 u16 zp_address(cpu_t *cpu);
@@ -119,4 +126,26 @@ void BIT(cpu_t *cpu, u16 addr);
 void BRK(cpu_t *cpu, u16 addr);
 void NOP(cpu_t *cpu, u16 addr);
 
+// Undocumented NMOS opcodes
+void SLO(cpu_t *cpu, u16 addr); // ASL + ORA
+void RLA(cpu_t *cpu, u16 addr); // ROL + AND
+void SRE(cpu_t *cpu, u16 addr); // LSR + EOR
+void RRA(cpu_t *cpu, u16 addr); // ROR + ADC
+void DCP(cpu_t *cpu, u16 addr); // DEC + CMP
+void ISC(cpu_t *cpu, u16 addr); // INC + SBC
+void LAX(cpu_t *cpu, u16 addr); // LDA + LDX
+void SAX(cpu_t *cpu, u16 addr); // Store A & X
+void LAS(cpu_t *cpu, u16 addr); // A, X, SP = memory & SP
+void ANC(cpu_t *cpu, u16 addr); // AND, carry = bit 7
+void ALR(cpu_t *cpu, u16 addr); // AND + LSR A
+void ARR(cpu_t *cpu, u16 addr); // AND + ROR A
+void SBX(cpu_t *cpu, u16 addr); // X = (A & X) - operand
+void ANE(cpu_t *cpu, u16 addr); // Unstable: A = (A | magic) & X & operand
+void LXA(cpu_t *cpu, u16 addr); // Unstable: A, X = (A | magic) & operand
+void SHA(cpu_t *cpu, u16 addr); // Unstable: store A & X & (high + 1)
+void SHX(cpu_t *cpu, u16 addr); // Unstable: store X & (high + 1)
+void SHY(cpu_t *cpu, u16 addr); // Unstable: store Y & (high + 1)
+void TAS(cpu_t *cpu, u16 addr); // Unstable: SP = A & X, store SP & (high + 1)
+void JAM(cpu_t *cpu, u16 addr); // Locks up the CPU
+
 #endif
\ No newline at end of file
@@ -0,0 +1,89 @@
+#include "interrupt.h"
+#include "cpu.h"
+
+void interrupt_init(interrupt_t *interrupt)
+{
+    interrupt->irq_lines = 0;
+    interrupt->nmi_lines = 0;
+    interrupt->nmi_pending = false;
+    interrupt->i_before = 0;
+    interrupt->i_until = UINT64_MAX;
+    interrupt->irqs = 0;
+    interrupt->nmis = 0;
+}
+
+void interrupt_set_irq(cpu_t *cpu, u32 source, bool asserted)
+{
+    interrupt_t *interrupt = &cpu->interrupt;
+
+    if (asserted)
+        interrupt->irq_lines |= source;
+    else
+        interrupt->irq_lines &= ~source;
+
+    cpu_check_irq(cpu);
+}
+
+void interrupt_set_nmi(cpu_t *cpu, u32 source, bool asserted)
+{
+    interrupt_t *interrupt = &cpu->interrupt;
+    u32 before = interrupt->nmi_lines;
+
+    if (asserted)
+        interrupt->nmi_lines |= source;
+    else
+        interrupt->nmi_lines &= ~source;
+
+    if (before == 0 && interrupt->nmi_lines != 0)
+    {
+        interrupt->nmi_pending = true;
+        cpu->yield |= CPU_YIELD_SERVICE;
+    }
+}
+
+// Same sequence as BRK, except that B is clear in the pushed status and PC
+// is pushed as is, since no opcode was fetched
+static void interrupt_enter(cpu_t *cpu, u16 vector)
+{
+    write_memory(cpu, 0x100 | cpu->SP, cpu->PC >> 8);
+    cpu->SP--;
+
+    write_memory(cpu, 0x100 | cpu->SP, cpu->PC & 0xFF);
+    cpu->SP--;
+
+    write_memory(cpu, 0x100 | cpu->SP, cpu_status(cpu));
+    cpu->SP--;
+
+    cpu->P |= INTERRUPT_FLAG;
+    cpu->PC = read_memory(cpu, vector) | (read_memory(cpu, vector + 1) << 8);
+    cpu->global_cycles += INTERRUPT_CYCLES;
+    cpu->idle_polls = 0;
+}
+
+// Called between instructions: run device events that are due, then take
+// an NMI, or an IRQ if I is clear. NMI wins when both are pending. Right
+// after CLI, SEI or PLP the IRQ check sees I as it was before them
+void interrupt_service(cpu_t *cpu)
+{
+    interrupt_t *interrupt = &cpu->interrupt;
+
+    if (cpu->global_cycles >= cpu->next_event)
+        cpu->next_event = timer_update(&cpu->timer, cpu->global_cycles);
+
+    u8 masked = cpu->global_cycles == interrupt->i_until ? interrupt->i_before
+                                                         : cpu->P & INTERRUPT_FLAG;
+
+    if (interrupt->nmi_pending)
+    {
+        interrupt->nmi_pending = false;
+        interrupt->nmis++;
+        interrupt_enter(cpu, NMI_LOW_ADDR);
+    }
+    else if (interrupt->irq_lines && !masked)
+    {
+        interrupt->irqs++;
+        interrupt_enter(cpu, BRK_LOW_ADDR);
+    }
+
+    cpu->yield &= ~CPU_YIELD_SERVICE;
+}
@@ -0,0 +1,31 @@
+#ifndef INTERRUPT_H
+#define INTERRUPT_H
+
+#include "utils/util.h"
+
+struct cpu_t;
+
+// Devices that can drive the IRQ and NMI lines, one bit each. A line is the
+// wired-OR of its sources and stays asserted until all of them release it
+#define INTERRUPT_TIMER (1u << 0)
+
+// Cycles the 6502 spends pushing PC and P and fetching the vector
+#define INTERRUPT_CYCLES 7
+
+typedef struct
+{
+    u32 irq_lines;    // Level triggered: taken while any is held and I is clear
+    u32 nmi_lines;    // Edge triggered: going from none to any latches an NMI
+    bool nmi_pending;
+    u8 i_before;      // I as the poll at the end of CLI, SEI or PLP still sees it
+    u64 i_until;      // global_cycles of that poll, UINT64_MAX for none
+    u64 irqs;         // Interrupts taken so far
+    u64 nmis;
+} interrupt_t;
+
+void interrupt_init(interrupt_t *interrupt);
+void interrupt_set_irq(struct cpu_t *cpu, u32 source, bool asserted);
+void interrupt_set_nmi(struct cpu_t *cpu, u32 source, bool asserted);
+void interrupt_service(struct cpu_t *cpu);
+
+#endif
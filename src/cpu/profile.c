@@ -0,0 +1,352 @@
+#include "profile.h"
+#include "instruction.h"
+
+_Static_assert(PROFILE_MODES == ADDR_MODE_COUNT, "one profile bucket per addressing mode");
+
+typedef struct
+{
+    u32 key;
+    u64 count;
+    u64 cycles;
+} profile_row_t;
+
+profile_t *profile_create(void)
+{
+    return calloc(1, sizeof(profile_t));
+}
+
+void profile_destroy(profile_t *profile)
+{
+    if (profile == NULL)
+        return;
+
+    free(profile->symbols);
+    free(profile);
+}
+
+// Drop the counters, keep the symbols
+void profile_clear(profile_t *profile)
+{
+    profile_symbol_t *symbols = profile->symbols;
+    size_t symbol_count = profile->symbol_count;
+
+    memset(profile, 0, sizeof(*profile));
+    profile->symbols = symbols;
+    profile->symbol_count = symbol_count;
+}
+
+void profile_edge(profile_t *profile, u16 caller, u16 target)
+{
+    u32 key = ((u32)caller << 16) | target;
+    u32 slot = (key * 2654435761u) & (PROFILE_EDGE_SLOTS - 1);
+
+    for (u32 probe = 0; probe < PROFILE_EDGE_SLOTS; probe++)
+    {
+        profile_edge_t *edge = &profile->edges[(slot + probe) & (PROFILE_EDGE_SLOTS - 1)];
+
+        if (edge->count == 0)
+        {
+            // Keep the table at most 3/4 full so probes stay short
+            if (profile->edge_count >= PROFILE_EDGE_SLOTS / 4 * 3)
+                break;
+
+            edge->caller = caller;
+            edge->target = target;
+            edge->count = 1;
+            profile->edge_count++;
+            return;
+        }
+
+        if (edge->caller == caller && edge->target == target)
+        {
+            edge->count++;
+            return;
+        }
+    }
+
+    profile->edges_dropped++;
+}
+
+static int compare_symbols(const void *a, const void *b)
+{
+    const profile_symbol_t *x = a, *y = b;
+    return (int)x->address - (int)y->address;
+}
+
+// Accepts one symbol per line in any of these forms:
+//   E000 BASIC          (address first, as in most listings)
+//   BASIC = $E000       (assembler equates)
+//   al 00E000 .BASIC    (VICE / ca65 -Ln label files)
+// Blank lines and lines starting with ';' or '#' are ignored
+bool profile_load_symbols(profile_t *profile, const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return false;
+
+    char line[256];
+    size_t capacity = profile->symbol_count;
+
+    while (fgets(line, sizeof(line), file))
+    {
+        char name[PROFILE_SYMBOL_LEN];
+        unsigned int address;
+        char *end;
+
+        char *start = line + strspn(line, " \t");
+        if (*start == ';' || *start == '#' || *start == '\n' || *start == '\0')
+            continue;
+
+        if (sscanf(start, "al %x .%31s", &address, name) == 2 ||
+            sscanf(start, "%31s = $%x", name, &address) == 2)
+        {
+            // Parsed
+        }
+        else
+        {
+            unsigned long parsed = strtoul(start, &end, 16);
+            if (end == start || (*end != ' ' && *end != '\t') ||
+                sscanf(end, "%31s", name) != 1)
+            {
+                fprintf(stderr, "%s: skipping unrecognized line: %s", path, line);
+                continue;
+            }
+            address = (unsigned int)parsed;
+        }
+
+        if (address > 0xFFFF)
+            continue;
+
+        if (profile->symbol_count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 64;
+            profile_symbol_t *grown = realloc(profile->symbols, capacity * sizeof(profile_symbol_t));
+            if (grown == NULL)
+            {
+                fclose(file);
+                return false;
+            }
+            profile->symbols = grown;
+        }
+
+        profile_symbol_t *symbol = &profile->symbols[profile->symbol_count++];
+        symbol->address = (u16)address;
+        snprintf(symbol->name, sizeof(symbol->name), "%s", name);
+    }
+
+    fclose(file);
+    qsort(profile->symbols, profile->symbol_count, sizeof(profile_symbol_t), compare_symbols);
+    return true;
+}
+
+// Closest symbol at or below address, NULL if there is none
+static const profile_symbol_t *profile_symbol(const profile_t *profile, u16 address)
+{
+    const profile_symbol_t *found = NULL;
+    size_t low = 0, high = profile->symbol_count;
+
+    while (low < high)
+    {
+        size_t mid = (low + high) / 2;
+
+        if (profile->symbols[mid].address <= address)
+        {
+            found = &profile->symbols[mid];
+            low = mid + 1;
+        }
+        else
+            high = mid;
+    }
+
+    return found;
+}
+
+static const char *profile_label(const profile_t *profile, u16 address, char *buf, size_t len)
+{
+    const profile_symbol_t *symbol = profile_symbol(profile, address);
+
+    if (symbol == NULL)
+        snprintf(buf, len, "-");
+    else if (symbol->address == address)
+        snprintf(buf, len, "%s", symbol->name);
+    else
+        snprintf(buf, len, "%s+%u", symbol->name, (unsigned)(address - symbol->address));
+
+    return buf;
+}
+
+static int compare_rows(const void *a, const void *b)
+{
+    const profile_row_t *x = a, *y = b;
+
+    if (x->cycles != y->cycles)
+        return x->cycles < y->cycles ? 1 : -1;
+    return x->count < y->count ? 1 : x->count > y->count ? -1 : 0;
+}
+
+static double percent(u64 part, u64 total)
+{
+    return total ? 100.0 * part / total : 0;
+}
+
+static void report_rows(const profile_t *profile, FILE *out, profile_row_t *rows, size_t count)
+{
+    qsort(rows, count, sizeof(profile_row_t), compare_rows);
+
+    for (size_t i = 0; i < count && i < PROFILE_REPORT_TOP; i++)
+    {
+        char label[PROFILE_SYMBOL_LEN + 8];
+        u16 pc = (u16)rows[i].key;
+
+        fprintf(out, "  $%04X  %-24s %-8s %14llu %14llu %6.2f%%\n", pc,
+                profile_label(profile, pc, label, sizeof(label)),
+                opcode_names[profile->pc_opcode[pc]],
+                (unsigned long long)rows[i].count, (unsigned long long)rows[i].cycles,
+                percent(rows[i].cycles, profile->cycles));
+    }
+}
+
+static void report_routines(const profile_t *profile, FILE *out, profile_row_t *rows)
+{
+    size_t count = 0;
+
+    // Charge every address to the closest symbol below it
+    for (u32 pc = 0; pc < MEMORY_SIZE; pc++)
+    {
+        if (!profile->pc_count[pc])
+            continue;
+
+        const profile_symbol_t *symbol = profile_symbol(profile, (u16)pc);
+        if (symbol == NULL)
+            continue;
+
+        u32 index = (u32)(symbol - profile->symbols);
+        if (count == 0 || rows[count - 1].key != index)
+            rows[count++] = (profile_row_t){index, 0, 0};
+
+        rows[count - 1].count += profile->pc_count[pc];
+        rows[count - 1].cycles += profile->pc_cycles[pc];
+    }
+    qsort(rows, count, sizeof(profile_row_t), compare_rows);
+
+    fprintf(out, "\nHot routines\n");
+    fprintf(out, "  %-6s %-24s %14s %14s %7s\n", "addr", "symbol", "count", "cycles", "%cyc");
+
+    for (size_t i = 0; i < count && i < PROFILE_REPORT_TOP; i++)
+    {
+        const profile_symbol_t *symbol = &profile->symbols[rows[i].key];
+
+        fprintf(out, "  $%04X  %-24s %14llu %14llu %6.2f%%\n", symbol->address, symbol->name,
+                (unsigned long long)rows[i].count, (unsigned long long)rows[i].cycles,
+                percent(rows[i].cycles, profile->cycles));
+    }
+}
+
+static int compare_edges(const void *a, const void *b)
+{
+    const profile_edge_t *x = a, *y = b;
+    return x->count < y->count ? 1 : x->count > y->count ? -1 : 0;
+}
+
+static void report_calls(const profile_t *profile, FILE *out)
+{
+    profile_edge_t edges[PROFILE_EDGE_SLOTS];
+    size_t count = 0;
+
+    for (u32 i = 0; i < PROFILE_EDGE_SLOTS; i++)
+    {
+        if (profile->edges[i].count)
+            edges[count++] = profile->edges[i];
+    }
+    qsort(edges, count, sizeof(profile_edge_t), compare_edges);
+
+    fprintf(out, "\nJSR call graph (%zu edges", count);
+    if (profile->edges_dropped)
+        fprintf(out, ", %llu calls dropped", (unsigned long long)profile->edges_dropped);
+    fprintf(out, ")\n");
+
+    for (size_t i = 0; i < count && i < PROFILE_REPORT_TOP; i++)
+    {
+        char caller[PROFILE_SYMBOL_LEN + 8], target[PROFILE_SYMBOL_LEN + 8];
+
+        fprintf(out, "  $%04X %-24s -> $%04X %-24s %12llu\n",
+                edges[i].caller, profile_label(profile, edges[i].caller, caller, sizeof(caller)),
+                edges[i].target, profile_label(profile, edges[i].target, target, sizeof(target)),
+                (unsigned long long)edges[i].count);
+    }
+}
+
+void profile_report(const profile_t *profile, FILE *out)
+{
+    profile_row_t *rows = malloc(MEMORY_SIZE * sizeof(profile_row_t));
+    if (rows == NULL)
+        return;
+
+    fprintf(out, "Profile: %llu instructions, %llu cycles\n",
+            (unsigned long long)profile->instructions, (unsigned long long)profile->cycles);
+
+    size_t count = 0;
+    for (u32 pc = 0; pc < MEMORY_SIZE; pc++)
+    {
+        if (profile->pc_count[pc])
+            rows[count++] = (profile_row_t){pc, profile->pc_count[pc], profile->pc_cycles[pc]};
+    }
+
+    fprintf(out, "\nHot spots by address (%zu addresses executed)\n", count);
+    fprintf(out, "  %-6s %-24s %-8s %14s %14s %7s\n", "addr", "symbol", "opcode", "count", "cycles", "%cyc");
+    report_rows(profile, out, rows, count);
+
+    if (profile->symbol_count)
+        report_routines(profile, out, rows);
+
+    count = 0;
+    for (u32 op = 0; op < 256; op++)
+    {
+        if (profile->op_count[op])
+            rows[count++] = (profile_row_t){op, profile->op_count[op], profile->op_cycles[op]};
+    }
+    qsort(rows, count, sizeof(profile_row_t), compare_rows);
+
+    fprintf(out, "\nOpcodes\n");
+    fprintf(out, "  %-4s %-8s %-4s %14s %14s %7s\n", "op", "name", "mode", "count", "cycles", "%cyc");
+    for (size_t i = 0; i < count && i < PROFILE_REPORT_TOP; i++)
+    {
+        u8 op = (u8)rows[i].key;
+
+        fprintf(out, "  $%02X  %-8s %-4s %14llu %14llu %6.2f%%\n", op, opcode_names[op],
+                addr_mode_names[opcodes[op].addr_mode],
+                (unsigned long long)rows[i].count, (unsigned long long)rows[i].cycles,
+                percent(rows[i].cycles, profile->cycles));
+    }
+
+    fprintf(out, "\nAddressing modes\n");
+    for (u32 mode = 0; mode < PROFILE_MODES; mode++)
+    {
+        if (profile->mode_count[mode])
+            fprintf(out, "  %-4s %14llu %14llu %6.2f%%\n", addr_mode_names[mode],
+                    (unsigned long long)profile->mode_count[mode],
+                    (unsigned long long)profile->mode_cycles[mode],
+                    percent(profile->mode_cycles[mode], profile->cycles));
+    }
+
+    report_calls(profile, out);
+    free(rows);
+}
+
+// "-" writes to stderr
+bool profile_write(const profile_t *profile, const char *path)
+{
+    if (strcmp(path, "-") == 0)
+    {
+        profile_report(profile, stderr);
+        return true;
+    }
+
+    FILE *out = fopen(path, "w");
+    if (out == NULL)
+        return false;
+
+    profile_report(profile, out);
+    fclose(out);
+    return true;
+}
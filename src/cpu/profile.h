@@ -0,0 +1,75 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "utils/util.h"
+
+#define PROFILE_MODES 12          // Matches ADDR_MODE_COUNT
+#define PROFILE_EDGE_SLOTS 4096   // JSR call graph hash table, power of two
+#define PROFILE_SYMBOL_LEN 32
+#define PROFILE_REPORT_TOP 25     // Rows per section of the report
+
+#define JSR_OPCODE 0x20
+
+typedef struct
+{
+    u16 caller; // Address of the JSR instruction
+    u16 target;
+    u64 count;  // 0 = free slot
+} profile_edge_t;
+
+typedef struct
+{
+    u16 address;
+    char name[PROFILE_SYMBOL_LEN];
+} profile_symbol_t;
+
+// Execution profile, allocated only when profiling is switched on: the CPU
+// cores check a single pointer and skip everything below when it is NULL
+typedef struct profile_t
+{
+    u64 instructions;
+    u64 cycles;
+
+    u64 pc_count[MEMORY_SIZE];
+    u64 pc_cycles[MEMORY_SIZE];
+    u8 pc_opcode[MEMORY_SIZE]; // Last opcode executed at each address
+    u64 op_count[256];
+    u64 op_cycles[256];
+    u64 mode_count[PROFILE_MODES];
+    u64 mode_cycles[PROFILE_MODES];
+
+    profile_edge_t edges[PROFILE_EDGE_SLOTS];
+    u32 edge_count;
+    u64 edges_dropped; // Calls not recorded because the table was full
+
+    profile_symbol_t *symbols; // Sorted by address
+    size_t symbol_count;
+} profile_t;
+
+profile_t *profile_create(void);
+void profile_destroy(profile_t *profile);
+void profile_clear(profile_t *profile);
+void profile_edge(profile_t *profile, u16 caller, u16 target);
+bool profile_load_symbols(profile_t *profile, const char *path);
+void profile_report(const profile_t *profile, FILE *out);
+bool profile_write(const profile_t *profile, const char *path);
+
+// Called once per executed instruction with the PC of its opcode
+static inline void profile_record(profile_t *profile, u16 pc, u8 opcode, u8 mode,
+                                  u8 cycles, u16 addr)
+{
+    profile->instructions++;
+    profile->cycles += cycles;
+    profile->pc_count[pc]++;
+    profile->pc_cycles[pc] += cycles;
+    profile->pc_opcode[pc] = opcode;
+    profile->op_count[opcode]++;
+    profile->op_cycles[opcode] += cycles;
+    profile->mode_count[mode]++;
+    profile->mode_cycles[mode] += cycles;
+
+    if (opcode == JSR_OPCODE)
+        profile_edge(profile, pc, addr);
+}
+
+#endif
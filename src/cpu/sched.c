@@ -0,0 +1,133 @@
+#include "sched.h"
+
+#include <poll.h>
+
+u64 sched_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void sched_init(sched_t *sched, cpu_t *cpu, double speed)
+{
+    sched->speed = speed > 0 ? speed : 0;
+
+    // One 60 Hz frame worth of emulated cycles (~17,045 at 1x)
+    if (sched->speed > 0)
+        sched->slice_cycles = (u64)(APPLE1_CLOCK_HZ * sched->speed / SCHED_SLICE_HZ);
+    else
+        sched->slice_cycles = APPLE1_CLOCK_HZ / SCHED_SLICE_HZ;
+
+    if (sched->slice_cycles == 0)
+        sched->slice_cycles = 1;
+
+    sched->slice_target = cpu->global_cycles;
+    sched->anchor_cycles = cpu->global_cycles;
+    sched->anchor_ns = sched_now_ns();
+    sched->slices = 0;
+    sched->late_slices = 0;
+    sched->idle_cycles = 0;
+}
+
+static void sched_sync(sched_t *sched, cpu_t *cpu)
+{
+    // Deadline is derived from the total cycle count since the anchor, so
+    // rounding in the slice budget never accumulates into clock drift
+    u64 elapsed = cpu->global_cycles - sched->anchor_cycles;
+    u64 deadline = sched->anchor_ns +
+                   (u64)((double)elapsed * 1e9 / (APPLE1_CLOCK_HZ * sched->speed));
+    u64 now = sched_now_ns();
+
+    if (now >= deadline)
+    {
+        sched->late_slices++;
+
+        // Host stalled (suspended, swapped, ...): don't try to catch up in a burst
+        if (now - deadline > SCHED_MAX_LAG_NS)
+        {
+            sched->anchor_cycles = cpu->global_cycles;
+            sched->anchor_ns = now;
+        }
+        return;
+    }
+
+    struct timespec ts;
+    ts.tv_sec = deadline / 1000000000ULL;
+    ts.tv_nsec = deadline % 1000000000ULL;
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
+void sched_run_slice(sched_t *sched, cpu_t *cpu)
+{
+    // Overshoot from the last instruction of a slice is charged to the next one
+    sched->slice_target += sched->slice_cycles;
+    if (sched->slice_target < cpu->global_cycles)
+        sched->slice_target = cpu->global_cycles + sched->slice_cycles;
+
+    cpu_run(cpu, sched->slice_target, UINT64_MAX);
+
+    // A halted CPU stays stuck until reset while emulated time goes on
+    if (cpu->halt && cpu->global_cycles < sched->slice_target)
+    {
+        if (cpu->recording)
+            recording_skip(cpu->recording, cpu, sched->slice_target - cpu->global_cycles);
+        cpu->global_cycles = sched->slice_target;
+    }
+
+    sched->slices++;
+
+    // Waiting for a key: end the slice here, sched_idle does the sleeping
+    if (cpu->idle)
+    {
+        sched->slice_target = cpu->global_cycles;
+        return;
+    }
+
+    if (sched->speed > 0)
+        sched_sync(sched, cpu);
+}
+
+// Called by the frontend once the screen is up to date. While the 6502
+// spins on an empty keyboard, block until fd is readable (or a timeout) and
+// move global_cycles on by the time that passed, as if the loop had run.
+// Only the iteration count of the poll loop is lost
+void sched_idle(sched_t *sched, cpu_t *cpu, int fd)
+{
+    if (!cpu->idle)
+        return;
+    cpu->idle = false;
+
+    // A key to read or a timer already due: run on instead of waiting
+    if (!keyboard_empty(&cpu->keyboard) || cpu->next_event <= cpu->global_cycles)
+        return;
+
+    u64 start = sched_now_ns();
+    struct pollfd pfd = {fd, POLLIN, 0};
+    double rate = APPLE1_CLOCK_HZ * (sched->speed > 0 ? sched->speed : 1.0);
+
+    // Wake up in time for the next timer expiry
+    u64 until_event = cpu->next_event - cpu->global_cycles;
+    int timeout = SCHED_IDLE_TIMEOUT_MS;
+    if (until_event < (u64)(rate * SCHED_IDLE_TIMEOUT_MS / 1000))
+        timeout = (int)(until_event * 1000 / rate);
+
+    if (poll(&pfd, fd >= 0 ? 1 : 0, timeout) < 0 && errno != EINTR)
+        return;
+
+    u64 now = sched_now_ns();
+    u64 skipped = (u64)((double)(now - start) * rate / 1e9);
+    if (skipped > until_event)
+        skipped = until_event;
+
+    if (cpu->recording)
+        recording_skip(cpu->recording, cpu, skipped);
+    cpu->global_cycles += skipped;
+    sched->idle_cycles += skipped;
+
+    sched->slice_target = cpu->global_cycles;
+    sched->anchor_cycles = cpu->global_cycles;
+    sched->anchor_ns = now;
+}
@@ -0,0 +1,32 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include "utils/util.h"
+#include "cpu.h"
+
+#define SCHED_SLICE_HZ 60
+
+// How far behind the host may fall before the schedule is re-anchored
+#define SCHED_MAX_LAG_NS 100000000ULL
+
+// Longest single wait for input while the 6502 is idle
+#define SCHED_IDLE_TIMEOUT_MS 250
+
+typedef struct
+{
+    double speed;          // Multiple of the Apple-1 clock, 0 = unthrottled
+    u64 slice_cycles;      // Cycle budget of one time slice
+    u64 slice_target;      // global_cycles value that ends the current slice
+    u64 anchor_cycles;     // global_cycles at the anchor time
+    u64 anchor_ns;         // Monotonic time the schedule is anchored to
+    u64 slices;            // Slices run so far
+    u64 late_slices;       // Slices that finished past their deadline
+    u64 idle_cycles;       // Cycles skipped while waiting for input
+} sched_t;
+
+void sched_init(sched_t *sched, cpu_t *cpu, double speed);
+void sched_run_slice(sched_t *sched, cpu_t *cpu);
+void sched_idle(sched_t *sched, cpu_t *cpu, int fd);
+u64 sched_now_ns(void);
+
+#endif
@@ -0,0 +1,79 @@
+#include "cpu.h"
+#include "instruction.h"
+
+#ifdef THREADED_DISPATCH
+
+// Threaded interpreter core: every opcode in opcodes.def gets its own handler
+// with the addressing mode and operation fused, and each handler jumps
+// straight to the next one through a computed goto
+
+#define ADDR_IMM(cpu) imm_address(cpu)
+#define ADDR_ZP(cpu) zp_address(cpu)
+#define ADDR_ZPX(cpu) zpx_address(cpu)
+#define ADDR_ZPY(cpu) zpy_address(cpu)
+#define ADDR_ABS(cpu) abs_address(cpu)
+#define ADDR_ABX(cpu) abx_address(cpu)
+#define ADDR_ABY(cpu) aby_address(cpu)
+#define ADDR_IND(cpu) ind_address(cpu)
+#define ADDR_IDX(cpu) indx_address(cpu)
+#define ADDR_IDY(cpu) indy_address(cpu)
+#define ADDR_IMP(cpu) imp_address(cpu)
+#define ADDR_REL(cpu) (u16)rel_address(cpu)
+
+#define DISPATCH()                                                           \
+    do {                                                                     \
+        if (__builtin_expect(++count >= max_instructions ||                  \
+                             cpu->global_cycles >= cycle_target ||           \
+                             cpu->yield || !cpu->running, 0))                \
+            goto done;                                                       \
+        goto *handlers[read_memory(cpu, cpu->PC++)];                         \
+    } while (0)
+
+u64 cpu_run_threaded(cpu_t *cpu, u64 cycle_target, u64 max_instructions)
+{
+    static void *const handlers[256] = {
+#define OPCODE(op, mode, cycles, xpage, operation) [op] = &&op_##op,
+#include "opcodes.def"
+#undef OPCODE
+    };
+
+    u64 count = 0;
+
+    // Profiling, tracing and native routines live in cpu_cycle only. The
+    // predecoded instruction cache does too, but the handlers here decode
+    // faster than it, so it is only used when this core steps anyway
+    if (cpu->profile || cpu->trace || cpu->hle)
+        return cpu_run_stepped(cpu, cycle_target, max_instructions);
+
+    if (max_instructions == 0 || cpu->global_cycles >= cycle_target ||
+        cpu->yield || cpu->halt || !cpu->running)
+        goto done;
+
+    goto *handlers[read_memory(cpu, cpu->PC++)];
+
+#define EXECUTE(mode, cycles, xpage, operation)                              \
+        operation(cpu, ADDR_##mode(cpu));                                    \
+        cpu->global_cycles += cycles + (xpage ? cpu->page_crossed : 0) +     \
+                              cpu->temp_cycles;                              \
+        cpu->temp_cycles = 0;                                                \
+        DISPATCH();
+
+#define OPCODE(op, mode, cycles, xpage, operation)                           \
+    op_##op:                                                                 \
+        EXECUTE(mode, cycles, xpage, operation)
+#define ILLEGAL(op, mode, cycles, xpage, operation)                          \
+    op_##op:                                                                 \
+        if (!cpu->emulate_illegal)                                           \
+        {                                                                    \
+            cpu_halt(cpu, HALT_ILLEGAL);                                     \
+            goto done;                                                       \
+        }                                                                    \
+        EXECUTE(mode, cycles, xpage, operation)
+#include "opcodes.def"
+#undef OPCODE
+
+done:
+    return count;
+}
+
+#endif
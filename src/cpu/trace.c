@@ -0,0 +1,276 @@
+#include "trace.h"
+#include "instruction.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#define JMP_ABS_OPCODE 0x4C
+
+void trace_config_init(trace_config_t *config)
+{
+    memset(config, 0, sizeof(*config));
+    config->capacity = TRACE_DEFAULT_RECORDS;
+    config->pc_low = 0x0000;
+    config->pc_high = 0xFFFF;
+}
+
+static bool parse_hex16(const char *str, const char *end, u16 *out)
+{
+    char *stop;
+    unsigned long value = strtoul(str, &stop, 16);
+
+    if (stop == str || stop != end || value > 0xFFFF)
+        return false;
+
+    *out = (u16)value;
+    return true;
+}
+
+// Comma separated key=value list:
+//   pc=E000-EFFF   only record this PC range
+//   start=FF1F     start recording when PC first reaches this address
+//   stop=FF00      stop recording when PC reaches this address
+//   after=N        start recording once N cycles have run
+//   limit=N        stop after N records
+//   size=N         ring size in records
+bool trace_config_parse(trace_config_t *config, const char *spec)
+{
+    const char *item = spec;
+
+    while (*item)
+    {
+        const char *next = strchr(item, ',');
+        const char *end = next ? next : item + strlen(item);
+        const char *value = memchr(item, '=', end - item);
+        bool ok = false;
+
+        if (value != NULL)
+        {
+            size_t key_len = value - item;
+            value++;
+
+            char number[32];
+            size_t value_len = end - value;
+            char *stop;
+
+            if (value_len < sizeof(number))
+            {
+                memcpy(number, value, value_len);
+                number[value_len] = '\0';
+            }
+            else
+                number[0] = '\0';
+
+            if (key_len == 2 && strncmp(item, "pc", 2) == 0)
+            {
+                const char *dash = memchr(value, '-', value_len);
+                ok = dash && parse_hex16(value, dash, &config->pc_low) &&
+                     parse_hex16(dash + 1, end, &config->pc_high) &&
+                     config->pc_low <= config->pc_high;
+            }
+            else if (key_len == 5 && strncmp(item, "start", 5) == 0)
+                ok = config->start_on_pc = parse_hex16(value, end, &config->start_pc);
+            else if (key_len == 4 && strncmp(item, "stop", 4) == 0)
+                ok = config->stop_on_pc = parse_hex16(value, end, &config->stop_pc);
+            else if (key_len == 5 && strncmp(item, "after", 5) == 0)
+            {
+                config->after_cycles = strtoull(number, &stop, 10);
+                ok = number[0] && *stop == '\0';
+            }
+            else if (key_len == 5 && strncmp(item, "limit", 5) == 0)
+            {
+                config->limit = strtoull(number, &stop, 10);
+                ok = number[0] && *stop == '\0';
+            }
+            else if (key_len == 4 && strncmp(item, "size", 4) == 0)
+            {
+                config->capacity = strtoull(number, &stop, 10);
+                ok = number[0] && *stop == '\0' && config->capacity > 0 &&
+                     config->capacity <= (1ULL << 32);
+            }
+        }
+
+        if (!ok)
+        {
+            fprintf(stderr, "Invalid trace option: %.*s\n", (int)(end - item), item);
+            return false;
+        }
+
+        item = next ? next + 1 : end;
+    }
+
+    return true;
+}
+
+// The ring lives in a shared mapping of the trace file, so the records are
+// on disk even if the emulator dies, and recording is a plain memory store
+trace_t *trace_open(const char *path, const trace_config_t *config)
+{
+    trace_t *trace = calloc(1, sizeof(trace_t));
+    if (trace == NULL)
+        return NULL;
+
+    trace->config = *config;
+
+    u64 capacity = 1;
+    while (capacity < config->capacity)
+        capacity <<= 1;
+
+    trace->config.capacity = capacity;
+    trace->mask = capacity - 1;
+    trace->map_size = sizeof(trace_header_t) + capacity * sizeof(trace_record_t);
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        free(trace);
+        return NULL;
+    }
+
+    if (ftruncate(fd, (off_t)trace->map_size) != 0)
+    {
+        close(fd);
+        free(trace);
+        return NULL;
+    }
+
+    void *map = mmap(NULL, trace->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED)
+    {
+        free(trace);
+        return NULL;
+    }
+
+    trace->header = map;
+    trace->records = (trace_record_t *)(trace->header + 1);
+
+    memcpy(trace->header->magic, TRACE_MAGIC, sizeof(trace->header->magic));
+    trace->header->version = TRACE_VERSION;
+    trace->header->record_size = sizeof(trace_record_t);
+    trace->header->capacity = capacity;
+    trace->header->count = 0;
+
+    return trace;
+}
+
+void trace_close(trace_t *trace)
+{
+    if (trace == NULL)
+        return;
+
+    munmap(trace->header, trace->map_size);
+    free(trace);
+}
+
+// Slow path of trace_next while recording has not started yet
+bool trace_trigger(trace_t *trace, u16 pc, u64 cycles)
+{
+    if (trace->done || cycles < trace->config.after_cycles)
+        return false;
+
+    if (trace->config.start_on_pc && pc != trace->config.start_pc)
+        return false;
+
+    trace->active = true;
+    return true;
+}
+
+static u8 operand_length(u8 mode)
+{
+    switch (mode)
+    {
+    case IMP:
+        return 0;
+    case ABS:
+    case ABX:
+    case ABY:
+    case IND:
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+// Disassemble into buf. The nestest layout matches the widely used
+// "PC  bytes  instruction  A: X: Y: P: SP: CYC:" reference logs
+int trace_format(const trace_record_t *record, bool nestest, char *buf, size_t len)
+{
+    const opcode_t *opcode = &opcodes[record->opcode];
+    u8 length = operand_length(record->mode);
+    u8 lo = record->operand[0];
+    u16 word = record->operand[0] | (record->operand[1] << 8);
+    char bytes[12], name[8], operand[40] = "";
+
+    if (length == 0)
+        snprintf(bytes, sizeof(bytes), "%02X", record->opcode);
+    else if (length == 1)
+        snprintf(bytes, sizeof(bytes), "%02X %02X", record->opcode, lo);
+    else
+        snprintf(bytes, sizeof(bytes), "%02X %02X %02X", record->opcode, lo, record->operand[1]);
+
+    // ASL_ACC -> ASL A, undocumented opcodes marked with '*'
+    const char *mnemonic = opcode_names[record->opcode];
+    bool accumulator = strstr(mnemonic, "_ACC") != NULL;
+    snprintf(name, sizeof(name), "%s%.3s", opcode->illegal ? "*" : "", mnemonic);
+
+    switch (record->mode)
+    {
+    case IMM:
+        snprintf(operand, sizeof(operand), "#$%02X", lo);
+        break;
+    case ZP:
+        snprintf(operand, sizeof(operand), "$%02X = %02X", lo, record->value);
+        break;
+    case ZPX:
+    case ZPY:
+        snprintf(operand, sizeof(operand), "$%02X,%c @ %02X = %02X", lo,
+                 record->mode == ZPX ? 'X' : 'Y', record->addr & 0xFF, record->value);
+        break;
+    case ABS:
+        if (record->opcode == JSR_OPCODE || record->opcode == JMP_ABS_OPCODE)
+            snprintf(operand, sizeof(operand), "$%04X", word);
+        else
+            snprintf(operand, sizeof(operand), "$%04X = %02X", word, record->value);
+        break;
+    case ABX:
+    case ABY:
+        snprintf(operand, sizeof(operand), "$%04X,%c @ %04X = %02X", word,
+                 record->mode == ABX ? 'X' : 'Y', record->addr, record->value);
+        break;
+    case IND:
+        snprintf(operand, sizeof(operand), "($%04X) = %04X", word, record->addr);
+        break;
+    case IDX:
+        snprintf(operand, sizeof(operand), "($%02X,X) @ %02X = %04X = %02X", lo,
+                 (u8)(lo + record->X), record->addr, record->value);
+        break;
+    case IDY:
+        snprintf(operand, sizeof(operand), "($%02X),Y = %04X @ %04X = %02X", lo,
+                 (u16)(record->addr - record->Y), record->addr, record->value);
+        break;
+    case IMP:
+        if (accumulator)
+            snprintf(operand, sizeof(operand), "A");
+        break;
+    case REL:
+        snprintf(operand, sizeof(operand), "$%04X", (u16)(record->pc + 2 + (i8)lo));
+        break;
+    }
+
+    if (nestest)
+        return snprintf(buf, len, "%04X  %-8s %4s %-27s A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%llu",
+                        record->pc, bytes, name, operand, record->A, record->X, record->Y,
+                        record->P, record->SP, (unsigned long long)record->cycles);
+
+    char flags[9];
+    const char *letters = "NV-BDIZC";
+    for (int bit = 0; bit < 8; bit++)
+        flags[bit] = (record->P & (0x80 >> bit)) ? letters[bit] : '.';
+    flags[8] = '\0';
+
+    return snprintf(buf, len, "%12llu  %04X  %-8s %4s %-27s A=%02X X=%02X Y=%02X SP=%02X %s",
+                    (unsigned long long)record->cycles, record->pc, bytes, name, operand,
+                    record->A, record->X, record->Y, record->SP, flags);
+}
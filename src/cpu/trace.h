@@ -0,0 +1,97 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "utils/util.h"
+
+#define TRACE_MAGIC "A1TRACE"
+#define TRACE_VERSION 1
+#define TRACE_DEFAULT_RECORDS (1u << 20) // 24 MB trace file
+
+// One executed instruction, captured after operand fetch and before the
+// operation runs, so registers and memory show the state it started from
+typedef struct
+{
+    u64 cycles;    // global_cycles before the instruction
+    u16 pc;
+    u16 addr;      // Effective address
+    u8 opcode;
+    u8 operand[2]; // Bytes following the opcode
+    u8 mode;       // Addressing mode
+    u8 value;      // Memory at addr, read without device side effects
+    u8 A, X, Y, SP, P;
+    u8 reserved;
+} trace_record_t;
+
+_Static_assert(sizeof(trace_record_t) == 24, "trace records are a fixed 24 bytes");
+
+// File layout: header, then a ring of capacity records. Record n (counting
+// from 0) lives in slot n % capacity, so the file holds the last
+// min(count, capacity) instructions
+typedef struct
+{
+    char magic[8];
+    u32 version;
+    u32 record_size;
+    u64 capacity;
+    u64 count;     // Records written in total
+} trace_header_t;
+
+typedef struct
+{
+    u64 capacity;      // Ring size in records, rounded up to a power of two
+    u16 pc_low;        // Only record instructions inside this PC range
+    u16 pc_high;
+    bool start_on_pc;  // Start recording the first time PC reaches start_pc
+    u16 start_pc;
+    bool stop_on_pc;   // Stop for good when PC reaches stop_pc
+    u16 stop_pc;
+    u64 after_cycles;  // Start recording once global_cycles gets here
+    u64 limit;         // Stop after this many records, 0 = no limit
+} trace_config_t;
+
+typedef struct trace_t
+{
+    trace_config_t config;
+    trace_header_t *header; // Start of the mapped file
+    trace_record_t *records;
+    size_t map_size;
+    u64 mask;
+    bool active;            // Start trigger has fired
+    bool done;              // Stop trigger or limit reached
+} trace_t;
+
+void trace_config_init(trace_config_t *config);
+bool trace_config_parse(trace_config_t *config, const char *spec);
+trace_t *trace_open(const char *path, const trace_config_t *config);
+void trace_close(trace_t *trace);
+bool trace_trigger(trace_t *trace, u16 pc, u64 cycles);
+int trace_format(const trace_record_t *record, bool nestest, char *buf, size_t len);
+
+// Slot for the instruction at pc, or NULL when it is filtered out
+static inline trace_record_t *trace_next(trace_t *trace, u16 pc, u64 cycles)
+{
+    if (__builtin_expect(!trace->active, 0) && !trace_trigger(trace, pc, cycles))
+        return NULL;
+
+    if (trace->config.stop_on_pc && pc == trace->config.stop_pc)
+    {
+        trace->active = false;
+        trace->done = true;
+        return NULL;
+    }
+
+    if (pc < trace->config.pc_low || pc > trace->config.pc_high)
+        return NULL;
+
+    trace_record_t *record = &trace->records[trace->header->count & trace->mask];
+
+    if (++trace->header->count == trace->config.limit)
+    {
+        trace->active = false;
+        trace->done = true;
+    }
+
+    return record;
+}
+
+#endif
@@ -0,0 +1,1002 @@
+#include "applesoft.h"
+#include "cpu/cpu.h"
+#include "hle/hle.h"
+
+// Native floating point for Applesoft Lite. The routines below are the ROM
+// code from FSUB to POLY, translated instruction by instruction: every AT()
+// is the ROM address of the instruction that follows, and the macros do
+// what that instruction does to the registers, flags, memory and cycle
+// count. JSR and RTS go through the real 6502 stack, so the results, the
+// FAC/ARG temporaries, the stack contents and the cycles charged all match
+// the ROM exactly, including the paths that unwind the stack or end in an
+// error. An RTS to an address outside this code ends the native run
+
+// Give up and let the interpreter carry on past this many cycles, so a
+// program that patched the tables into a loop still yields to the host
+#define FP_MAX_CYCLES 1000000
+
+#define AT(addr) __attribute__((fallthrough)); case 0x##addr: l_##addr: __attribute__((unused));
+
+#define NZ(value) (n = (value) >> 7, z = (value) == 0)
+
+// Operand reads, charging the cycles of a load or ALU instruction
+#define RD_IMM(o) (cycles += 2, (u8)(o))
+#define RD_ZP(o) (cycles += 3, ram[o])
+#define RD_ZPX(o) (cycles += 4, ram[(u8)((o) + x)])
+#define RD_ABS(o) (cycles += 4, read_memory(cpu, o))
+#define RD_ABY(o) (cycles += 4 + (((o) & 0xFF) + y > 0xFF), read_memory(cpu, (u16)((o) + y)))
+#define RD_IDY(o) (ptr = ram[o] | (ram[(u8)((o) + 1)] << 8), \
+                   cycles += 5 + ((ptr & 0xFF) + y > 0xFF), read_memory(cpu, (u16)(ptr + y)))
+
+#define WR_ZP(o, value) (cycles += 3, ram[o] = (value))
+#define WR_ZPX(o, value) (cycles += 4, ram[(u8)((o) + x)] = (value))
+#define WR_IDY(o, value) (ptr = ram[o] | (ram[(u8)((o) + 1)] << 8), \
+                          cycles += 6, write_memory(cpu, (u16)(ptr + y), value))
+
+// Read-modify-write operands
+#define EA_ZP(o) (o)
+#define EA_ZPX(o) (u8)((o) + x)
+#define RMW_CYCLES_ZP 5
+#define RMW_CYCLES_ZPX 6
+
+#define LDA(mode, o) do { a = RD_##mode(o); NZ(a); } while (0)
+#define LDX(mode, o) do { x = RD_##mode(o); NZ(x); } while (0)
+#define LDY(mode, o) do { y = RD_##mode(o); NZ(y); } while (0)
+#define STA(mode, o) WR_##mode(o, a)
+#define STX(mode, o) WR_##mode(o, x)
+#define STY(mode, o) WR_##mode(o, y)
+
+#define ADD(m)                                                               \
+    do {                                                                     \
+        u8 m_ = (m);                                                         \
+        u16 t_ = a + m_ + c;                                                 \
+        v = (~(a ^ m_) & (a ^ t_) & 0x80) != 0;                              \
+        c = t_ > 0xFF;                                                       \
+        a = (u8)t_;                                                          \
+        NZ(a);                                                               \
+    } while (0)
+#define ADC(mode, o) ADD(RD_##mode(o))
+#define SBC(mode, o) ADD((u8)~RD_##mode(o))
+
+#define AND(mode, o) do { a &= RD_##mode(o); NZ(a); } while (0)
+#define ORA(mode, o) do { a |= RD_##mode(o); NZ(a); } while (0)
+#define EOR(mode, o) do { a ^= RD_##mode(o); NZ(a); } while (0)
+
+#define COMPARE(reg, m) do { u8 m_ = (m); c = (reg) >= m_; NZ((u8)((reg) - m_)); } while (0)
+#define CMP(mode, o) COMPARE(a, RD_##mode(o))
+#define CPX(mode, o) COMPARE(x, RD_##mode(o))
+#define CPY(mode, o) COMPARE(y, RD_##mode(o))
+
+#define BIT(mode, o) do { u8 m_ = RD_##mode(o); z = (a & m_) == 0; n = m_ >> 7; v = (m_ >> 6) & 1; } while (0)
+
+// Shifts and rotates through the carry, on a register or a memory operand
+#define SHL(var) (c = (var) >> 7, var <<= 1)
+#define SHR(var) (c = (var) & 1, var >>= 1)
+#define RL(var) do { u8 c_ = (var) >> 7; var = (u8)((var) << 1) | c; c = c_; } while (0)
+#define RR(var) do { u8 c_ = (var) & 1; var = (u8)((var) >> 1) | (c << 7); c = c_; } while (0)
+
+#define RMW(mode, o, op)                                                     \
+    do {                                                                     \
+        u8 *p_ = &ram[EA_##mode(o)];                                         \
+        u8 m_ = *p_;                                                         \
+        op;                                                                  \
+        *p_ = m_;                                                            \
+        NZ(m_);                                                              \
+        cycles += RMW_CYCLES_##mode;                                         \
+    } while (0)
+#define ASL(mode, o) RMW(mode, o, SHL(m_))
+#define LSR(mode, o) RMW(mode, o, SHR(m_))
+#define ROL(mode, o) RMW(mode, o, RL(m_))
+#define ROR(mode, o) RMW(mode, o, RR(m_))
+#define INC(mode, o) RMW(mode, o, m_++)
+#define DEC(mode, o) RMW(mode, o, m_--)
+
+#define IMPLIED(op) do { op; cycles += 2; } while (0)
+#define ASL_A() IMPLIED(SHL(a); NZ(a))
+#define LSR_A() IMPLIED(SHR(a); NZ(a))
+#define ROL_A() IMPLIED(RL(a); NZ(a))
+#define ROR_A() IMPLIED(RR(a); NZ(a))
+#define TAX() IMPLIED(x = a; NZ(x))
+#define TAY() IMPLIED(y = a; NZ(y))
+#define TXA() IMPLIED(a = x; NZ(a))
+#define TYA() IMPLIED(a = y; NZ(a))
+#define INX() IMPLIED(x++; NZ(x))
+#define INY() IMPLIED(y++; NZ(y))
+#define DEX() IMPLIED(x--; NZ(x))
+#define DEY() IMPLIED(y--; NZ(y))
+#define CLC() IMPLIED(c = 0)
+#define SEC() IMPLIED(c = 1)
+
+#define STATUS() ((n << 7) | (v << 6) | 0x20 | id | (z << 1) | c)
+
+#define PHA() do { ram[0x100 | sp--] = a; cycles += 3; } while (0)
+#define PHP() do { ram[0x100 | sp--] = STATUS() | BREAK_FLAG; cycles += 3; } while (0)
+#define PLA() do { a = ram[0x100 | ++sp]; NZ(a); cycles += 4; } while (0)
+#define PLP()                                                                \
+    do {                                                                     \
+        u8 m_ = ram[0x100 | ++sp];                                           \
+        n = m_ >> 7;                                                         \
+        v = (m_ >> 6) & 1;                                                   \
+        id = m_ & (INTERRUPT_FLAG | DECIMAL_FLAG);                           \
+        z = (m_ >> 1) & 1;                                                   \
+        c = m_ & 1;                                                          \
+        cycles += 4;                                                         \
+    } while (0)
+
+// Control transfers take the address of the instruction itself, for the
+// page crossing penalty of branches and the return address of JSR
+#define BRANCH(cond, at, to)                                                 \
+    do {                                                                     \
+        cycles += 2;                                                         \
+        if (cond)                                                            \
+        {                                                                    \
+            cycles += 1 + ((0x##at + 2) >> 8 != 0x##to >> 8);                \
+            goto l_##to;                                                     \
+        }                                                                    \
+    } while (0)
+#define BCC(at, to) BRANCH(!c, at, to)
+#define BCS(at, to) BRANCH(c, at, to)
+#define BNE(at, to) BRANCH(!z, at, to)
+#define BEQ(at, to) BRANCH(z, at, to)
+#define BPL(at, to) BRANCH(!n, at, to)
+#define BMI(at, to) BRANCH(n, at, to)
+
+#define JMP(to) do { cycles += 3; goto l_##to; } while (0)
+
+#define JSR(at, to)                                                          \
+    do {                                                                     \
+        ram[0x100 | sp--] = (0x##at + 2) >> 8;                               \
+        ram[0x100 | sp--] = (0x##at + 2) & 0xFF;                             \
+        cycles += 6;                                                         \
+        goto l_##to;                                                         \
+    } while (0)
+
+#define RTS()                                                                \
+    do {                                                                     \
+        sp += 2;                                                             \
+        pc = (u16)((ram[0x100 | (u8)(sp - 1)] | (ram[0x100 | sp] << 8)) + 1); \
+        cycles += 6;                                                         \
+        goto dispatch;                                                       \
+    } while (0)
+
+// Leave for ROM code that is not translated, the error handlers
+#define EXIT(to) do { cycles += 3; pc = 0x##to; goto done; } while (0)
+
+// Runs from the hooked entry point until the routine returns to its caller.
+// Declines while decimal mode is set, which the ROM never does, and while a
+// timer is armed, since its interrupt could land in the middle
+static u32 applesoft_fp(cpu_t *cpu)
+{
+    if ((cpu->P & DECIMAL_FLAG) || cpu->next_event != UINT64_MAX)
+        return 0;
+
+    u8 *ram = cpu->memory; // Zero page and stack, RAM in every configuration
+    u8 a = cpu->A, x = cpu->X, y = cpu->Y, sp = cpu->SP;
+    u8 n = cpu_negative(cpu), v = (cpu->P & OVERFLOW_FLAG) != 0;
+    u8 z = cpu_zero(cpu), c = cpu_carry(cpu);
+    u8 id = cpu->P & (INTERRUPT_FLAG | DECIMAL_FLAG);
+    u16 pc = cpu->PC;
+    u16 ptr;
+    u32 cycles = 0;
+
+dispatch:
+    if (cycles > FP_MAX_CYCLES)
+        goto done;
+
+    switch (pc)
+    {
+    default:
+        goto done; // Returned to the caller
+
+    // Shared return of the routine before FSUB, reached from FADDT
+    AT(7449) RTS();
+
+    // FSUB: FAC = number at (A,Y) - FAC. FSUBT: FAC = ARG - FAC
+    AT(7451) JSR(7451, 768B);
+    AT(7454) LDA(ZP, 0xA2);
+             EOR(IMM, 0xFF);
+             STA(ZP, 0xA2);
+             EOR(ZP, 0xAA);
+             STA(ZP, 0xAB);
+             LDA(ZP, 0x9D);
+             JMP(746B);
+
+    // FADDT continued: shift ARG right a byte at a time
+    AT(7463) JSR(7463, 759A);
+    AT(7466) BCC(7466, 74A4);
+
+    // FADD: FAC = number at (A,Y) + FAC
+    AT(7468) JSR(7468, 768B);
+
+    // FADDT: FAC = ARG + FAC, Z holds FAC == 0 from the caller
+    AT(746B) BNE(746B, 7470);
+             JMP(77F8);
+    AT(7470) LDX(ZP, 0xAC);
+             STX(ZP, 0x92);
+             LDX(IMM, 0xA5);
+             LDA(ZP, 0xA5);
+    AT(7478) TAY();
+             BEQ(7479, 7449);
+             SEC();
+             SBC(ZP, 0x9D);
+             BEQ(747E, 74A4);
+             BCC(7480, 7494);
+             STY(ZP, 0x9D);
+             LDY(ZP, 0xAA);
+             STY(ZP, 0xA2);
+             EOR(IMM, 0xFF);
+             ADC(IMM, 0x00);
+             LDY(IMM, 0x00);
+             STY(ZP, 0x92);
+             LDX(IMM, 0x9D);
+             BNE(7492, 7498);
+    AT(7494) LDY(IMM, 0x00);
+             STY(ZP, 0xAC);
+    AT(7498) CMP(IMM, 0xF9);
+             BMI(749A, 7463);
+             TAY();
+             LDA(ZP, 0xAC);
+             LSR(ZPX, 0x01);
+             JSR(74A1, 75B1);
+    AT(74A4) BIT(ZP, 0xAB);
+             BPL(74A6, 74FF);
+             LDY(IMM, 0x9D);
+             CPX(IMM, 0xA5);
+             BEQ(74AC, 74B0);
+             LDY(IMM, 0xA5);
+    AT(74B0) SEC();
+             EOR(IMM, 0xFF);
+             ADC(ZP, 0x92);
+             STA(ZP, 0xAC);
+             LDA(ABY, 0x0004);
+             SBC(ZPX, 0x04);
+             STA(ZP, 0xA1);
+             LDA(ABY, 0x0003);
+             SBC(ZPX, 0x03);
+             STA(ZP, 0xA0);
+             LDA(ABY, 0x0002);
+             SBC(ZPX, 0x02);
+             STA(ZP, 0x9F);
+             LDA(ABY, 0x0001);
+             SBC(ZPX, 0x01);
+             STA(ZP, 0x9E);
+
+    // NORMALIZE: negate the mantissa if C is clear, then shift it left
+    AT(74D3) BCS(74D3, 74D8);
+             JSR(74D5, 7548);
+    AT(74D8) LDY(IMM, 0x00);
+             TYA();
+             CLC();
+    AT(74DC) LDX(ZP, 0x9E);
+             BNE(74DE, 752A);
+             LDX(ZP, 0x9F);
+             STX(ZP, 0x9E);
+             LDX(ZP, 0xA0);
+             STX(ZP, 0x9F);
+             LDX(ZP, 0xA1);
+             STX(ZP, 0xA0);
+             LDX(ZP, 0xAC);
+             STX(ZP, 0xA1);
+             STY(ZP, 0xAC);
+             ADC(IMM, 0x08);
+             CMP(IMM, 0x20);
+             BNE(74F6, 74DC);
+
+    // ZERO.FAC
+    AT(74F8) LDA(IMM, 0x00);
+    AT(74FA) STA(ZP, 0x9D);
+             STA(ZP, 0xA2);
+             RTS();
+
+    // FADDT continued: same signs, add the mantissas
+    AT(74FF) ADC(ZP, 0x92);
+             STA(ZP, 0xAC);
+             LDA(ZP, 0xA1);
+             ADC(ZP, 0xA9);
+             STA(ZP, 0xA1);
+             LDA(ZP, 0xA0);
+             ADC(ZP, 0xA8);
+             STA(ZP, 0xA0);
+             LDA(ZP, 0x9F);
+             ADC(ZP, 0xA7);
+             STA(ZP, 0x9F);
+             LDA(ZP, 0x9E);
+             ADC(ZP, 0xA6);
+             STA(ZP, 0x9E);
+             JMP(7537);
+    AT(751E) ADC(IMM, 0x01);
+             ASL(ZP, 0xAC);
+             ROL(ZP, 0xA1);
+             ROL(ZP, 0xA0);
+             ROL(ZP, 0x9F);
+             ROL(ZP, 0x9E);
+    AT(752A) BPL(752A, 751E);
+             SEC();
+             SBC(ZP, 0x9D);
+             BCS(752F, 74F8);
+             EOR(IMM, 0xFF);
+             ADC(IMM, 0x01);
+             STA(ZP, 0x9D);
+    AT(7537) BCC(7537, 7547);
+    AT(7539) INC(ZP, 0x9D);
+             BEQ(753B, 757F);
+             ROR(ZP, 0x9E);
+             ROR(ZP, 0x9F);
+             ROR(ZP, 0xA0);
+             ROR(ZP, 0xA1);
+             ROR(ZP, 0xAC);
+    AT(7547) RTS();
+
+    // COMPLEMENT.FAC: negate mantissa and sign
+    AT(7548) LDA(ZP, 0xA2);
+             EOR(IMM, 0xFF);
+             STA(ZP, 0xA2);
+    AT(754E) LDA(ZP, 0x9E);
+             EOR(IMM, 0xFF);
+             STA(ZP, 0x9E);
+             LDA(ZP, 0x9F);
+             EOR(IMM, 0xFF);
+             STA(ZP, 0x9F);
+             LDA(ZP, 0xA0);
+             EOR(IMM, 0xFF);
+             STA(ZP, 0xA0);
+             LDA(ZP, 0xA1);
+             EOR(IMM, 0xFF);
+             STA(ZP, 0xA1);
+             LDA(ZP, 0xAC);
+             EOR(IMM, 0xFF);
+             STA(ZP, 0xAC);
+             INC(ZP, 0xAC);
+             BNE(756E, 757E);
+
+    // INCREMENT.MANTISSA
+    AT(7570) INC(ZP, 0xA1);
+             BNE(7572, 757E);
+             INC(ZP, 0xA0);
+             BNE(7576, 757E);
+             INC(ZP, 0x9F);
+             BNE(757A, 757E);
+             INC(ZP, 0x9E);
+    AT(757E) RTS();
+
+    // OVERFLOW: ?OVERFLOW ERROR, printed by the ROM
+    AT(757F) LDX(IMM, 0x28);
+             EXIT(62C0);
+
+    // SHIFT.RIGHT: shift the 4 bytes after X and the extension in A right
+    AT(7584) LDX(IMM, 0x61);
+    AT(7586) LDY(ZPX, 0x04);
+             STY(ZP, 0xAC);
+             LDY(ZPX, 0x03);
+             STY(ZPX, 0x04);
+             LDY(ZPX, 0x02);
+             STY(ZPX, 0x03);
+             LDY(ZPX, 0x01);
+             STY(ZPX, 0x02);
+             LDY(ZP, 0xA4);
+             STY(ZPX, 0x01);
+    AT(759A) ADC(IMM, 0x08);
+             BMI(759C, 7586);
+             BEQ(759E, 7586);
+             SBC(IMM, 0x08);
+             TAY();
+             LDA(ZP, 0xAC);
+             BCS(75A5, 75BB);
+    AT(75A7) ASL(ZPX, 0x01);
+             BCC(75A9, 75AD);
+             INC(ZPX, 0x01);
+    AT(75AD) ROR(ZPX, 0x01);
+             ROR(ZPX, 0x01);
+    AT(75B1) ROR(ZPX, 0x02);
+             ROR(ZPX, 0x03);
+             ROR(ZPX, 0x04);
+             ROR_A();
+             INY();
+             BNE(75B9, 75A7);
+    AT(75BB) CLC();
+             RTS();
+
+    // LOG: FAC = LOG(FAC), ?ILLEGAL QUANTITY unless FAC > 0
+    AT(75EB) JSR(75EB, 7827);
+    AT(75EE) BEQ(75EE, 75F2);
+             BPL(75F0, 75F5);
+    AT(75F2) EXIT(6F18);
+    AT(75F5) LDA(ZP, 0x9D);
+             SBC(IMM, 0x7F);
+             PHA();
+             LDA(IMM, 0x80);
+             STA(ZP, 0x9D);
+             LDA(IMM, 0xD7);
+             LDY(IMM, 0x75);
+             JSR(7602, 7468);
+    AT(7605) LDA(IMM, 0xDC);
+             LDY(IMM, 0x75);
+             JSR(7609, 770B);
+    AT(760C) LDA(IMM, 0xBD);
+             LDY(IMM, 0x75);
+             JSR(7610, 7451);
+    AT(7613) LDA(IMM, 0xC2);
+             LDY(IMM, 0x75);
+             JSR(7617, 7BFA);
+    AT(761A) LDA(IMM, 0xE1);
+             LDY(IMM, 0x75);
+             JSR(761E, 7468);
+    AT(7621) PLA();
+             JSR(7622, 7976);
+    AT(7625) LDA(IMM, 0xE6);
+             LDY(IMM, 0x75);
+
+    // FMULT: FAC = number at (A,Y) * FAC. FMULTT: FAC = ARG * FAC
+    AT(7629) JSR(7629, 768B);
+    AT(762C) BNE(762C, 762F);
+             RTS();
+    AT(762F) JSR(762F, 76B6);
+    AT(7632) LDA(IMM, 0x00);
+             STA(ZP, 0x62);
+             STA(ZP, 0x63);
+             STA(ZP, 0x64);
+             STA(ZP, 0x65);
+             LDA(ZP, 0xAC);
+             JSR(763E, 7658);
+    AT(7641) LDA(ZP, 0xA1);
+             JSR(7643, 7658);
+    AT(7646) LDA(ZP, 0xA0);
+             JSR(7648, 7658);
+    AT(764B) LDA(ZP, 0x9F);
+             JSR(764D, 7658);
+    AT(7650) LDA(ZP, 0x9E);
+             JSR(7652, 765D);
+    AT(7655) JMP(778B);
+
+    // MULTIPLY1: add ARG into RESULT for each set bit of A
+    AT(7658) BNE(7658, 765D);
+             JMP(7584);
+    AT(765D) LSR_A();
+             ORA(IMM, 0x80);
+    AT(7660) TAY();
+             BCC(7661, 767C);
+             CLC();
+             LDA(ZP, 0x65);
+             ADC(ZP, 0xA9);
+             STA(ZP, 0x65);
+             LDA(ZP, 0x64);
+             ADC(ZP, 0xA8);
+             STA(ZP, 0x64);
+             LDA(ZP, 0x63);
+             ADC(ZP, 0xA7);
+             STA(ZP, 0x63);
+             LDA(ZP, 0x62);
+             ADC(ZP, 0xA6);
+             STA(ZP, 0x62);
+    AT(767C) ROR(ZP, 0x62);
+             ROR(ZP, 0x63);
+             ROR(ZP, 0x64);
+             ROR(ZP, 0x65);
+             ROR(ZP, 0xAC);
+             TYA();
+             LSR_A();
+             BNE(7688, 7660);
+             RTS();
+
+    // CONUPK: load ARG from the packed number at (A,Y)
+    AT(768B) STA(ZP, 0x5E);
+             STY(ZP, 0x5F);
+             LDY(IMM, 0x04);
+             LDA(IDY, 0x5E);
+             STA(ZP, 0xA9);
+             DEY();
+             LDA(IDY, 0x5E);
+             STA(ZP, 0xA8);
+             DEY();
+             LDA(IDY, 0x5E);
+             STA(ZP, 0xA7);
+             DEY();
+             LDA(IDY, 0x5E);
+             STA(ZP, 0xAA);
+             EOR(ZP, 0xA2);
+             STA(ZP, 0xAB);
+             LDA(ZP, 0xAA);
+             ORA(IMM, 0x80);
+             STA(ZP, 0xA6);
+             DEY();
+             LDA(IDY, 0x5E);
+             STA(ZP, 0xA5);
+             LDA(ZP, 0x9D);
+             RTS();
+
+    // ADD.EXPONENTS for FMULT and FDIV, also the end of EXP
+    AT(76B6) LDA(ZP, 0xA5);
+    AT(76B8) BEQ(76B8, 76D6);
+             CLC();
+             ADC(ZP, 0x9D);
+             BCC(76BD, 76C3);
+             BMI(76BF, 76DB);
+             CLC();
+             BIT(ABS, 0x1110); // Skips the BPL in its operand
+             goto l_76C5;
+    AT(76C3) BPL(76C3, 76D6);
+    AT(76C5) ADC(IMM, 0x80);
+             STA(ZP, 0x9D);
+             BEQ(76C9, 76CD);
+             LDA(ZP, 0xAB);
+    AT(76CD) STA(ZP, 0xA2);
+             RTS();
+
+    // OUTOFRNG: EXP underflow or overflow
+    AT(76D0) LDA(ZP, 0xA2);
+             EOR(IMM, 0xFF);
+             BMI(76D4, 76DB);
+    AT(76D6) PLA();
+             PLA();
+             JMP(74F8);
+    AT(76DB) JMP(757F);
+
+    // MUL10: FAC = FAC * 10
+    AT(76DE) JSR(76DE, 7808);
+    AT(76E1) TAX();
+             BEQ(76E2, 76F4);
+             CLC();
+             ADC(IMM, 0x02);
+             BCS(76E7, 76DB);
+             LDX(IMM, 0x00);
+             STX(ZP, 0xAB);
+             JSR(76ED, 7478);
+    AT(76F0) INC(ZP, 0x9D);
+             BEQ(76F2, 76DB);
+    AT(76F4) RTS();
+
+    // DIV10: FAC = FAC / 10
+    AT(76FA) JSR(76FA, 7808);
+    AT(76FD) LDA(IMM, 0xF5);
+             LDY(IMM, 0x76);
+             LDX(IMM, 0x00);
+             STX(ZP, 0xAB);
+             JSR(7705, 779E);
+    AT(7708) JMP(770E);
+
+    // FDIV: FAC = number at (A,Y) / FAC. FDIVT: FAC = ARG / FAC
+    AT(770B) JSR(770B, 768B);
+    AT(770E) BEQ(770E, 7786);
+             JSR(7710, 7817);
+    AT(7713) LDA(IMM, 0x00);
+             SEC();
+             SBC(ZP, 0x9D);
+             STA(ZP, 0x9D);
+             JSR(771A, 76B6);
+    AT(771D) INC(ZP, 0x9D);
+             BEQ(771F, 76DB);
+             LDX(IMM, 0xFC);
+             LDA(IMM, 0x01);
+    AT(7725) LDY(ZP, 0xA6);
+             CPY(ZP, 0x9E);
+             BNE(7729, 773B);
+             LDY(ZP, 0xA7);
+             CPY(ZP, 0x9F);
+             BNE(772F, 773B);
+             LDY(ZP, 0xA8);
+             CPY(ZP, 0xA0);
+             BNE(7735, 773B);
+             LDY(ZP, 0xA9);
+             CPY(ZP, 0xA1);
+    AT(773B) PHP();
+             ROL_A();
+             BCC(773D, 7748);
+             INX();
+             STA(ZPX, 0x65);
+             BEQ(7742, 7776);
+             BPL(7744, 777A);
+             LDA(IMM, 0x01);
+    AT(7748) PLP();
+             BCS(7749, 7759);
+    AT(774B) ASL(ZP, 0xA9);
+             ROL(ZP, 0xA8);
+             ROL(ZP, 0xA7);
+             ROL(ZP, 0xA6);
+             BCS(7753, 773B);
+             BMI(7755, 7725);
+             BPL(7757, 773B);
+    AT(7759) TAY();
+             LDA(ZP, 0xA9);
+             SBC(ZP, 0xA1);
+             STA(ZP, 0xA9);
+             LDA(ZP, 0xA8);
+             SBC(ZP, 0xA0);
+             STA(ZP, 0xA8);
+             LDA(ZP, 0xA7);
+             SBC(ZP, 0x9F);
+             STA(ZP, 0xA7);
+             LDA(ZP, 0xA6);
+             SBC(ZP, 0x9E);
+             STA(ZP, 0xA6);
+             TYA();
+             JMP(774B);
+    AT(7776) LDA(IMM, 0x40);
+             BNE(7778, 7748);
+    AT(777A) ASL_A();
+             ASL_A();
+             ASL_A();
+             ASL_A();
+             ASL_A();
+             ASL_A();
+             STA(ZP, 0xAC);
+             PLP();
+             JMP(778B);
+
+    // ?DIVISION BY ZERO ERROR
+    AT(7786) LDX(IMM, 0x53);
+             EXIT(62C0);
+
+    // Move RESULT to the FAC mantissa and normalize
+    AT(778B) LDA(ZP, 0x62);
+             STA(ZP, 0x9E);
+             LDA(ZP, 0x63);
+             STA(ZP, 0x9F);
+             LDA(ZP, 0x64);
+             STA(ZP, 0xA0);
+             LDA(ZP, 0x65);
+             STA(ZP, 0xA1);
+             JMP(74D8);
+
+    // MOVFM: load FAC from the packed number at (A,Y)
+    AT(779E) STA(ZP, 0x5E);
+             STY(ZP, 0x5F);
+             LDY(IMM, 0x04);
+             LDA(IDY, 0x5E);
+             STA(ZP, 0xA1);
+             DEY();
+             LDA(IDY, 0x5E);
+             STA(ZP, 0xA0);
+             DEY();
+             LDA(IDY, 0x5E);
+             STA(ZP, 0x9F);
+             DEY();
+             LDA(IDY, 0x5E);
+             STA(ZP, 0xA2);
+             ORA(IMM, 0x80);
+             STA(ZP, 0x9E);
+             DEY();
+             LDA(IDY, 0x5E);
+             STA(ZP, 0x9D);
+             STY(ZP, 0xAC);
+             RTS();
+
+    // MOVMF: store FAC rounded at TEMP2 ($98), TEMP1 ($93) or (X,Y)
+    AT(77C3) LDX(IMM, 0x98);
+             BIT(ABS, 0x93A2); // Skips the LDX in its operand
+             goto l_77C8;
+    AT(77C6) LDX(IMM, 0x93);
+    AT(77C8) LDY(IMM, 0x00);
+             BEQ(77CA, 77D0);
+             LDX(ZP, 0x85);
+             LDY(ZP, 0x86);
+    AT(77D0) JSR(77D0, 7817);
+    AT(77D3) STX(ZP, 0x5E);
+             STY(ZP, 0x5F);
+             LDY(IMM, 0x04);
+             LDA(ZP, 0xA1);
+             STA(IDY, 0x5E);
+             DEY();
+             LDA(ZP, 0xA0);
+             STA(IDY, 0x5E);
+             DEY();
+             LDA(ZP, 0x9F);
+             STA(IDY, 0x5E);
+             DEY();
+             LDA(ZP, 0xA2);
+             ORA(IMM, 0x7F);
+             AND(ZP, 0x9E);
+             STA(IDY, 0x5E);
+             DEY();
+             LDA(ZP, 0x9D);
+             STA(IDY, 0x5E);
+             STY(ZP, 0xAC);
+             RTS();
+
+    // MOVFA: FAC = ARG
+    AT(77F8) LDA(ZP, 0xAA);
+    AT(77FA) STA(ZP, 0xA2);
+             LDX(IMM, 0x05);
+    AT(77FE) LDA(ZPX, 0xA4);
+             STA(ZPX, 0x9C);
+             DEX();
+             BNE(7803, 77FE);
+             STX(ZP, 0xAC);
+             RTS();
+
+    // MOVAF: ARG = FAC, rounded first from $7808
+    AT(7808) JSR(7808, 7817);
+    AT(780B) LDX(IMM, 0x06);
+    AT(780D) LDA(ZPX, 0x9C);
+             STA(ZPX, 0xA4);
+             DEX();
+             BNE(7812, 780D);
+             STX(ZP, 0xAC);
+    AT(7816) RTS();
+
+    // ROUND: round the mantissa up if the extension byte is >= $80
+    AT(7817) LDA(ZP, 0x9D);
+             BEQ(7819, 7816);
+             ASL(ZP, 0xAC);
+             BCC(781D, 7816);
+    AT(781F) JSR(781F, 7570);
+    AT(7822) BNE(7822, 7816);
+             JMP(7539);
+
+    // SIGN: A = 0, 1 or $FF for FAC zero, positive or negative
+    AT(7827) LDA(ZP, 0x9D);
+             BEQ(7829, 7834);
+    AT(782B) LDA(ZP, 0xA2);
+    AT(782D) ROL_A();
+             LDA(IMM, 0xFF);
+             BCS(7830, 7834);
+             LDA(IMM, 0x01);
+    AT(7834) RTS();
+
+    // FLOAT: FAC = signed byte in A
+    AT(7838) STA(ZP, 0x9E);
+             LDA(IMM, 0x00);
+             STA(ZP, 0x9F);
+             LDX(IMM, 0x88);
+             LDA(ZP, 0x9E);
+             EOR(IMM, 0xFF);
+             ROL_A();
+             LDA(IMM, 0x00);
+             STA(ZP, 0xA1);
+             STA(ZP, 0xA0);
+             STX(ZP, 0x9D);
+             STA(ZP, 0xAC);
+             STA(ZP, 0xA2);
+             JMP(74D3);
+
+    // FCOMP: compare FAC with the packed number at (A,Y), result as SIGN
+    AT(7857) STA(ZP, 0x60);
+             STY(ZP, 0x61);
+             LDY(IMM, 0x00);
+             LDA(IDY, 0x60);
+             INY();
+             TAX();
+             BEQ(7861, 7827);
+             LDA(IDY, 0x60);
+             EOR(ZP, 0xA2);
+             BMI(7867, 782B);
+             CPX(ZP, 0x9D);
+             BNE(786B, 788E);
+             LDA(IDY, 0x60);
+             ORA(IMM, 0x80);
+             CMP(ZP, 0x9E);
+             BNE(7873, 788E);
+             INY();
+             LDA(IDY, 0x60);
+             CMP(ZP, 0x9F);
+             BNE(787A, 788E);
+             INY();
+             LDA(IDY, 0x60);
+             CMP(ZP, 0xA0);
+             BNE(7881, 788E);
+             INY();
+             LDA(IMM, 0x7F);
+             CMP(ZP, 0xAC);
+             LDA(IDY, 0x60);
+             SBC(ZP, 0xA1);
+             BEQ(788C, 78B3);
+    AT(788E) ROR_A();
+             EOR(ZP, 0xA2);
+             JMP(782D);
+
+    // QINT: FAC mantissa = INT(FAC) as a signed 32 bit number
+    AT(7894) LDA(ZP, 0x9D);
+             BEQ(7896, 78E2);
+             SEC();
+             SBC(IMM, 0xA0);
+             BIT(ZP, 0xA2);
+             BPL(789D, 78A8);
+             TAX();
+             LDA(IMM, 0xFF);
+             STA(ZP, 0xA4);
+             JSR(78A4, 754E);
+    AT(78A7) TXA();
+    AT(78A8) LDX(IMM, 0x9D);
+             CMP(IMM, 0xF9);
+             BPL(78AC, 78B4);
+             JSR(78AE, 759A);
+    AT(78B1) STY(ZP, 0xA4);
+    AT(78B3) RTS();
+    AT(78B4) TAY();
+             LDA(ZP, 0xA2);
+             AND(IMM, 0x80);
+             LSR(ZP, 0x9E);
+             ORA(ZP, 0x9E);
+             STA(ZP, 0x9E);
+             JSR(78BF, 75B1);
+    AT(78C2) STY(ZP, 0xA4);
+             RTS();
+
+    // INT: FAC = INT(FAC)
+    AT(78C5) LDA(ZP, 0x9D);
+             CMP(IMM, 0xA0);
+             BCS(78C9, 78EB);
+             JSR(78CB, 7894);
+    AT(78CE) STY(ZP, 0xAC);
+             LDA(ZP, 0xA2);
+             STY(ZP, 0xA2);
+             EOR(IMM, 0x80);
+             ROL_A();
+             LDA(IMM, 0xA0);
+             STA(ZP, 0x9D);
+             LDA(ZP, 0xA1);
+             STA(ZP, 0x0D);
+             JMP(74D3);
+    AT(78E2) STA(ZP, 0x9E);
+             STA(ZP, 0x9F);
+             STA(ZP, 0xA0);
+             STA(ZP, 0xA1);
+             TAY();
+    AT(78EB) RTS();
+
+    // ADDACC: FAC = FAC + signed byte in A, for LOG
+    AT(7976) PHA();
+             JSR(7977, 7808);
+    AT(797A) PLA();
+             JSR(797B, 7838);
+    AT(797E) LDA(ZP, 0xAA);
+             EOR(ZP, 0xA2);
+             STA(ZP, 0xAB);
+             LDX(ZP, 0x9D);
+             JMP(746B);
+
+    // SQR: FAC = FAC ^ 0.5. FPWRT: FAC = ARG ^ FAC
+    AT(7B2D) JSR(7B2D, 7808);
+    AT(7B30) LDA(IMM, 0x04);
+             LDY(IMM, 0x7B);
+             JSR(7B34, 779E);
+    AT(7B37) BEQ(7B37, 7BA8);
+             LDA(ZP, 0xA5);
+             BNE(7B3B, 7B40);
+             JMP(74FA);
+    AT(7B40) LDX(IMM, 0x8A);
+             LDY(IMM, 0x00);
+             JSR(7B44, 77D0);
+    AT(7B47) LDA(ZP, 0xAA);
+             BPL(7B49, 7B5A);
+             JSR(7B4B, 78C5);
+    AT(7B4E) LDA(IMM, 0x8A);
+             LDY(IMM, 0x00);
+             JSR(7B52, 7857);
+    AT(7B55) BNE(7B55, 7B5A);
+             TYA();
+             LDY(ZP, 0x0D);
+    AT(7B5A) JSR(7B5A, 77FA);
+    AT(7B5D) TYA();
+             PHA();
+             JSR(7B5F, 75EB);
+    AT(7B62) LDA(IMM, 0x8A);
+             LDY(IMM, 0x00);
+             JSR(7B66, 7629);
+    AT(7B69) JSR(7B69, 7BA8);
+    AT(7B6C) PLA();
+             BPL(7B6D, 7B79);
+
+    // NEGOP: FAC = -FAC
+    AT(7B6F) LDA(ZP, 0x9D);
+             BEQ(7B71, 7B79);
+             LDA(ZP, 0xA2);
+             EOR(IMM, 0xFF);
+             STA(ZP, 0xA2);
+    AT(7B79) RTS();
+
+    // EXP: FAC = EXP(FAC)
+    AT(7BA8) LDA(IMM, 0x7A);
+             LDY(IMM, 0x7B);
+             JSR(7BAC, 7629);
+    AT(7BAF) LDA(ZP, 0xAC);
+             ADC(IMM, 0x50);
+             BCC(7BB3, 7BB8);
+             JSR(7BB5, 781F);
+    AT(7BB8) STA(ZP, 0x92);
+             JSR(7BBA, 780B);
+    AT(7BBD) LDA(ZP, 0x9D);
+             CMP(IMM, 0x88);
+             BCC(7BC1, 7BC6);
+    AT(7BC3) JSR(7BC3, 76D0);
+    AT(7BC6) JSR(7BC6, 78C5);
+    AT(7BC9) LDA(ZP, 0x0D);
+             CLC();
+             ADC(IMM, 0x81);
+             BEQ(7BCE, 7BC3);
+             SEC();
+             SBC(IMM, 0x01);
+             PHA();
+             LDX(IMM, 0x05);
+    AT(7BD6) LDA(ZPX, 0xA5);
+             LDY(ZPX, 0x9D);
+             STA(ZPX, 0x9D);
+             STY(ZPX, 0xA5);
+             DEX();
+             BPL(7BDF, 7BD6);
+             LDA(ZP, 0x92);
+             STA(ZP, 0xAC);
+             JSR(7BE5, 7454);
+    AT(7BE8) JSR(7BE8, 7B6F);
+    AT(7BEB) LDA(IMM, 0x7F);
+             LDY(IMM, 0x7B);
+             JSR(7BEF, 7C10);
+    AT(7BF2) LDA(IMM, 0x00);
+             STA(ZP, 0xAB);
+             PLA();
+             JMP(76B8);
+
+    // POLY_ODD: odd polynomial in FAC, coefficients at (A,Y)
+    AT(7BFA) STA(ZP, 0xAD);
+             STY(ZP, 0xAE);
+             JSR(7BFE, 77C6);
+    AT(7C01) LDA(IMM, 0x93);
+             JSR(7C03, 7629);
+    AT(7C06) JSR(7C06, 7C14);
+    AT(7C09) LDA(IMM, 0x93);
+             LDY(IMM, 0x00);
+             JMP(7629);
+
+    // POLY: polynomial in FAC, coefficients at (A,Y)
+    AT(7C10) STA(ZP, 0xAD);
+             STY(ZP, 0xAE);
+    AT(7C14) JSR(7C14, 77C3);
+    AT(7C17) LDA(IDY, 0xAD);
+             STA(ZP, 0xA3);
+             LDY(ZP, 0xAD);
+             INY();
+             TYA();
+             BNE(7C1F, 7C23);
+             INC(ZP, 0xAE);
+    AT(7C23) STA(ZP, 0xAD);
+             LDY(ZP, 0xAE);
+    AT(7C27) JSR(7C27, 7629);
+    AT(7C2A) LDA(ZP, 0xAD);
+             LDY(ZP, 0xAE);
+             CLC();
+             ADC(IMM, 0x05);
+             BCC(7C31, 7C34);
+             INY();
+    AT(7C34) STA(ZP, 0xAD);
+             STY(ZP, 0xAE);
+             JSR(7C38, 7468);
+    AT(7C3B) LDA(IMM, 0x98);
+             LDY(IMM, 0x00);
+             DEC(ZP, 0xA3);
+             BNE(7C41, 7C27);
+             RTS();
+    }
+
+done:
+    if (cycles == 0)
+        return 0;
+
+    cpu->PC = pc;
+    cpu->A = a;
+    cpu->X = x;
+    cpu->Y = y;
+    cpu->SP = sp;
+    cpu_set_status(cpu, STATUS());
+    return cycles;
+}
+
+static const struct
+{
+    const char *name;
+    u16 address;
+} entry_points[] = {
+    {"FSUB", 0x7451},  {"FSUBT", 0x7454}, {"FADD", 0x7468},  {"FADDT", 0x746B},
+    {"LOG", 0x75EB},   {"FMULT", 0x7629}, {"FMULTT", 0x762C}, {"MUL10", 0x76DE},
+    {"DIV10", 0x76FA}, {"FDIV", 0x770B},  {"FDIVT", 0x770E}, {"INT", 0x78C5},
+    {"SQR", 0x7B2D},   {"FPWRT", 0x7B37}, {"EXP", 0x7BA8},
+};
+
+// Hook the floating point entry points of the Applesoft image in memory
+bool applesoft_hle_install(cpu_t *cpu)
+{
+    for (size_t i = 0; i < sizeof(entry_points) / sizeof(entry_points[0]); i++)
+    {
+        if (!hle_add(cpu, entry_points[i].name, entry_points[i].address, applesoft_fp))
+            return false;
+    }
+    return true;
+}
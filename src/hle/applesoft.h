@@ -0,0 +1,18 @@
+#ifndef APPLESOFT_H
+#define APPLESOFT_H
+
+#include "utils/util.h"
+
+struct cpu_t;
+
+// Applesoft Lite, the Replica-1 build in roms/applesoft.bin. It runs from RAM
+// at 0x6000 (cold start there, warm start at 0x6003) and keeps programs
+// between 0x0800 and HIMEM = 0x6000, so it needs at least 32K
+#define APPLESOFT_START 0x6000
+#define APPLESOFT_WARM_START 0x6003
+#define APPLESOFT_SIZE 0x2000
+#define APPLESOFT_MIN_RAM_KB 32
+
+bool applesoft_hle_install(struct cpu_t *cpu);
+
+#endif
@@ -0,0 +1,346 @@
+#include "console.h"
+#include "cpu/cpu.h"
+#include "hle/hle.h"
+
+// Native keyboard and display routines of Wozmon and Integer BASIC. Each
+// hook does what the 6502 code does: the same PIA reads and writes, so keys
+// are latched and the display is fed as before, the same stack bytes left
+// behind by its JSRs, the same registers and flags, the same cycles. The
+// line input hooks take every key already waiting in one go and hand back
+// to the 6502 at the top of its polling loop once the queue is empty
+
+// Display rate limiting makes every character wait on the busy bit, and a
+// timer interrupt could land in the middle of a routine
+static bool console_ready(const cpu_t *cpu)
+{
+    return !cpu->display.realtime && cpu->next_event == UINT64_MAX;
+}
+
+static bool key_waiting(cpu_t *cpu)
+{
+    return cpu->key_ready || !keyboard_empty(&cpu->keyboard);
+}
+
+// CMP #value
+static void compare(cpu_t *cpu, u8 value)
+{
+    cpu_set_flag(cpu, CARRY_FLAG, cpu->A >= value);
+    cpu_set_nz(cpu, cpu->A - value);
+}
+
+// The return address a JSR at jsr pushes, which the RTS that ends the
+// callee pops again
+static void jsr_frame(cpu_t *cpu, u16 jsr)
+{
+    u16 ret = jsr + 2;
+
+    write_memory(cpu, 0x100 | cpu->SP, ret >> 8);
+    write_memory(cpu, 0x100 | (u8)(cpu->SP - 1), ret & 0xFF);
+}
+
+static void rts(cpu_t *cpu)
+{
+    u8 low = read_memory(cpu, 0x100 | (u8)(cpu->SP + 1));
+    u8 high = read_memory(cpu, 0x100 | (u8)(cpu->SP + 2));
+
+    cpu->SP += 2;
+    cpu->PC = ((high << 8) | low) + 1;
+}
+
+// LDA $D011 / BPL / LDA $D010, with a key waiting
+static u32 read_key(cpu_t *cpu)
+{
+    read_memory(cpu, 0xD011);
+    cpu->A = read_memory(cpu, 0xD010);
+    cpu_set_nz(cpu, cpu->A);
+    return 4 + 2 + 4;
+}
+
+// BIT $D012 / BMI / STA $D012. Outside real time mode the display is never
+// busy, so BIT reads 0: Z set, N and V clear
+static u32 write_char(cpu_t *cpu)
+{
+    write_memory(cpu, 0xD012, cpu->A);
+    cpu_set_nz(cpu, 0);
+    cpu->P &= ~OVERFLOW_FLAG;
+    return 4 + 2 + 4;
+}
+
+// JSR ECHO at jsr, through to its RTS
+static u32 call_echo(cpu_t *cpu, u16 jsr)
+{
+    jsr_frame(cpu, jsr);
+    return 6 + write_char(cpu) + 6;
+}
+
+// ECHO and COUT: print A and return
+static u32 console_echo(cpu_t *cpu)
+{
+    if (!console_ready(cpu))
+        return 0;
+
+    u32 cycles = write_char(cpu);
+    rts(cpu);
+    return cycles + 6;
+}
+
+// RDKEY: the next key, with bit 7 set, in A. Declines while there is none,
+// so the 6502 keeps polling and the frontend still sees it waiting
+static u32 basic_rdkey(cpu_t *cpu)
+{
+    if (!console_ready(cpu) || !key_waiting(cpu))
+        return 0;
+
+    u32 cycles = read_key(cpu);
+    rts(cpu);
+    return cycles + 6;
+}
+
+// Wozmon from NEXTCHAR: store each key at IN,Y and echo it, with backspace
+// ('_'), escape and line overflow handled like the ROM. Ends at the command
+// parser once RETURN is typed
+static u32 woz_getline(cpu_t *cpu)
+{
+    if (!console_ready(cpu) || !key_waiting(cpu))
+        return 0;
+
+    u32 cycles = 0;
+
+    do
+    {
+        cycles += read_key(cpu);
+        write_memory(cpu, 0x0200 + cpu->Y, cpu->A);
+        cycles += 5 + call_echo(cpu, 0xFF34);
+
+        cycles += 2;
+        compare(cpu, 0x8D);
+        if (cpu->A == 0x8D)
+        {
+            cpu->PC = 0xFF3B;
+            return cycles + 2;
+        }
+
+        // NOTCR
+        cycles += 3 + 2;
+        compare(cpu, 0xDF);
+        if (cpu->A == 0xDF)
+        {
+            cycles += 3;
+            goto backspace;
+        }
+
+        cycles += 2 + 2;
+        compare(cpu, 0x9B);
+        if (cpu->A == 0x9B)
+        {
+            cycles += 3;
+            goto escape;
+        }
+
+        cycles += 2 + 2;
+        cpu->Y++;
+        cpu_set_nz(cpu, cpu->Y);
+        if (!(cpu->Y & 0x80))
+        {
+            cycles += 3;
+            continue;
+        }
+        cycles += 2;
+
+    escape:
+        cpu->A = 0xDC;
+        cycles += 2 + call_echo(cpu, 0xFF1C);
+
+    getline:
+        cpu->A = 0x8D;
+        cycles += 2 + call_echo(cpu, 0xFF21);
+        cpu->Y = 1;
+        cycles += 2;
+
+    backspace:
+        cpu->Y--;
+        cpu_set_nz(cpu, cpu->Y);
+        cycles += 2;
+        if (cpu->Y & 0x80)
+        {
+            cycles += 3;
+            goto getline;
+        }
+        cycles += 2;
+    } while (key_waiting(cpu) && !cpu->yield);
+
+    cpu->PC = WOZ_NEXTCHAR;
+    return cycles;
+}
+
+// Integer BASIC from the JSR RDKEY in GETLN: store each key at IN,Y and
+// echo it through COUT, which keeps the column count at $24. Returns to the
+// caller once RETURN is typed. Escape and line overflow print a message
+// through the ROM's string table, so those are left to the 6502 at $E294
+static u32 basic_getln(cpu_t *cpu)
+{
+    if (!console_ready(cpu) || !key_waiting(cpu))
+        return 0;
+
+    u32 cycles = 0;
+
+    do
+    {
+        jsr_frame(cpu, BASIC_GETLN);
+        cycles += 6 + read_key(cpu) + 6 + 2 + 2;
+
+        // JSR $E3C9: RETURN starts the column count over
+        jsr_frame(cpu, 0xE2A3);
+        cycles += 6 + 2;
+        compare(cpu, 0x8D);
+        if (cpu->A == 0x8D)
+        {
+            write_memory(cpu, 0x24, 0);
+            cycles += 2 + 2 + 3 + 2;
+        }
+        else
+        {
+            cycles += 3;
+        }
+        write_memory(cpu, 0x24, read_memory(cpu, 0x24) + 1);
+        cycles += 5 + write_char(cpu) + 6;
+
+        cycles += 2;
+        compare(cpu, 0x8D);
+        if (cpu->A == 0x8D)
+        {
+            cpu->A = 0xDF;
+            cpu_set_nz(cpu, cpu->A);
+            write_memory(cpu, 0x0200 + cpu->Y, cpu->A);
+            rts(cpu);
+            return cycles + 2 + 2 + 5 + 6;
+        }
+
+        // Ctrl-D
+        cycles += 3 + 2;
+        compare(cpu, 0x84);
+        if (cpu->A == 0x84)
+        {
+            u8 flags = read_memory(cpu, 0xF8);
+            cpu_set_flag(cpu, CARRY_FLAG, flags & 1);
+            write_memory(cpu, 0xF8, flags >> 1);
+            cycles += 2 + 5;
+        }
+        else
+        {
+            cycles += 3;
+        }
+
+        cycles += 2;
+        compare(cpu, 0xDF);
+        if (cpu->A == 0xDF)
+        {
+            cpu->Y--;
+            cpu_set_nz(cpu, cpu->Y);
+            cycles += 3 + 2;
+            if (cpu->Y & 0x80)
+            {
+                cpu->PC = 0xE294;
+                return cycles + 3;
+            }
+            cycles += 2;
+            continue;
+        }
+
+        cycles += 2 + 2;
+        compare(cpu, 0x9B);
+        if (cpu->A == 0x9B)
+        {
+            cpu->PC = 0xE294;
+            return cycles + 3;
+        }
+
+        cycles += 2;
+        write_memory(cpu, 0x0200 + cpu->Y, cpu->A);
+        cpu->Y++;
+        cpu_set_nz(cpu, cpu->Y);
+        cycles += 5 + 2;
+        if (cpu->Y & 0x80)
+        {
+            cpu->PC = 0xE294;
+            return cycles + 2;
+        }
+        cycles += 3;
+    } while (key_waiting(cpu) && !cpu->yield);
+
+    cpu->PC = BASIC_GETLN;
+    return cycles;
+}
+
+// Integer BASIC's string output loop at $EE0F: LDA ($DA),Y through $E3C9
+// and COUT for Y up to the string length kept at $76,X
+static u32 basic_print_string(cpu_t *cpu)
+{
+    if (!console_ready(cpu))
+        return 0;
+
+    u8 *ram = cpu->memory;
+    u8 length = ram[(u8)(0x76 + cpu->X)];
+    u32 cycles = 0;
+
+    while (!cpu->yield)
+    {
+        cpu->A = cpu->Y;
+        compare(cpu, length);
+        cycles += 2 + 4;
+        if (cpu->Y >= length)
+        {
+            cpu->PC = 0xEE1D;
+            return cycles + 3;
+        }
+
+        u16 string = ram[0xDA] | (ram[0xDB] << 8);
+        cpu->A = read_memory(cpu, string + cpu->Y);
+        cycles += 2 + 5 + ((string & 0xFF) + cpu->Y > 0xFF);
+
+        // JSR $E3C9: RETURN starts the column count over
+        jsr_frame(cpu, 0xEE16);
+        cycles += 6 + 2;
+        compare(cpu, 0x8D);
+        if (cpu->A == 0x8D)
+        {
+            ram[0x24] = 0;
+            cycles += 2 + 2 + 3 + 2;
+        }
+        else
+        {
+            cycles += 3;
+        }
+        ram[0x24]++;
+        cycles += 5 + write_char(cpu) + 6;
+
+        cpu->Y++;
+        cpu_set_nz(cpu, cpu->Y);
+        cycles += 2 + 3;
+    }
+
+    cpu->PC = BASIC_PRINT_STRING;
+    return cycles;
+}
+
+static const struct
+{
+    const char *name;
+    u16 address;
+    hle_fn_t run;
+} entry_points[] = {
+    {"ECHO", WOZ_ECHO, console_echo},     {"GETLINE", WOZ_NEXTCHAR, woz_getline},
+    {"RDKEY", BASIC_RDKEY, basic_rdkey},  {"GETLN", BASIC_GETLN, basic_getln},
+    {"COUT", BASIC_COUT, console_echo},   {"PRSTR", BASIC_PRINT_STRING, basic_print_string},
+};
+
+// Hook the character I/O of the Wozmon and Integer BASIC images in memory
+bool console_hle_install(cpu_t *cpu)
+{
+    for (size_t i = 0; i < sizeof(entry_points) / sizeof(entry_points[0]); i++)
+    {
+        if (!hle_add(cpu, entry_points[i].name, entry_points[i].address, entry_points[i].run))
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,21 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include "utils/util.h"
+
+struct cpu_t;
+
+// Character I/O of the built-in ROMs: Wozmon's ECHO at 0xFFEF and its line
+// input loop at 0xFF29, Integer BASIC's RDKEY at 0xE003, its line input
+// loop at 0xE29E, its COUT at 0xE3D5 and the loop at 0xEE0F that prints a
+// string through it
+#define WOZ_ECHO 0xFFEF
+#define WOZ_NEXTCHAR 0xFF29
+#define BASIC_RDKEY 0xE003
+#define BASIC_GETLN 0xE29E
+#define BASIC_COUT 0xE3D5
+#define BASIC_PRINT_STRING 0xEE0F
+
+bool console_hle_install(struct cpu_t *cpu);
+
+#endif
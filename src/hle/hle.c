@@ -0,0 +1,87 @@
+#include "hle.h"
+#include "cpu/cpu.h"
+
+hle_t *hle_create(void)
+{
+    return calloc(1, sizeof(hle_t));
+}
+
+void hle_destroy(hle_t *hle)
+{
+    free(hle);
+}
+
+// Hook the routine at address, as it is in memory now. cpu->hle must be set
+bool hle_add(cpu_t *cpu, const char *name, u16 address, hle_fn_t run)
+{
+    hle_t *hle = cpu->hle;
+
+    if (hle->count == HLE_MAX_HOOKS)
+        return false;
+
+    hle_hook_t *hook = &hle->hooks[hle->count++];
+    hook->name = name;
+    hook->address = address;
+    hook->run = run;
+    hook->calls = 0;
+
+    for (u16 i = 0; i < HLE_SIGNATURE; i++)
+        hook->signature[i] = mem_peek(&cpu->mem, address + i);
+
+    hle->pages[address >> 8]++;
+    hle->hooked[address >> 3] |= 1 << (address & 7);
+    return true;
+}
+
+static bool hle_intact(cpu_t *cpu, const hle_hook_t *hook)
+{
+    for (u16 i = 0; i < HLE_SIGNATURE; i++)
+    {
+        if (mem_peek(&cpu->mem, hook->address + i) != hook->signature[i])
+            return false;
+    }
+    return true;
+}
+
+// Run the hook at PC, if there is one and it takes the call. Returns the
+// cycles charged, 0 when the 6502 should execute the instruction itself
+u32 hle_dispatch(cpu_t *cpu)
+{
+    hle_t *hle = cpu->hle;
+
+    if (!(hle->hooked[cpu->PC >> 3] & (1 << (cpu->PC & 7))))
+        return 0;
+
+    for (u32 i = 0; i < hle->count; i++)
+    {
+        hle_hook_t *hook = &hle->hooks[i];
+
+        if (hook->address != cpu->PC)
+            continue;
+
+        if (!hle_intact(cpu, hook))
+            return 0;
+
+        u32 cycles = hook->run(cpu);
+        if (cycles)
+        {
+            hook->calls++;
+            cpu->global_cycles += cycles;
+        }
+        return cycles;
+    }
+
+    return 0;
+}
+
+void hle_report(const hle_t *hle, FILE *out)
+{
+    for (u32 i = 0; i < hle->count; i++)
+    {
+        const hle_hook_t *hook = &hle->hooks[i];
+
+        if (hook->calls)
+            fprintf(out, "HLE %-8s $%04X: %llu calls\n", hook->name, hook->address,
+                    (unsigned long long)hook->calls);
+    }
+}
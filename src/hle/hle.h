@@ -0,0 +1,47 @@
+#ifndef HLE_H
+#define HLE_H
+
+#include "utils/util.h"
+
+struct cpu_t;
+
+#define HLE_MAX_HOOKS 32
+
+// Bytes of ROM code a hook checks before it runs, so a program that loads
+// something else over the routine gets the 6502 code back
+#define HLE_SIGNATURE 4
+
+// Native stand-in for a ROM routine, called when the 6502 is about to run
+// the instruction at its address. It either declines by returning 0, with
+// nothing changed, or does everything the 6502 code would have done and
+// returns the cycles that took; cpu_cycle adds them to global_cycles
+typedef u32 (*hle_fn_t)(struct cpu_t *cpu);
+
+typedef struct
+{
+    const char *name;
+    u16 address;
+    u8 signature[HLE_SIGNATURE];
+    hle_fn_t run;
+    u64 calls; // Times the hook ran instead of the 6502 code
+} hle_hook_t;
+
+// High-level emulation hooks. pages counts the hooks in each 256-byte page,
+// which is all the interpreter looks at until PC lands on one of them;
+// hooked has a bit per address, so code that merely runs in such a page
+// does not search the table on every instruction
+typedef struct hle_t
+{
+    u8 pages[MEMORY_SIZE / 256];
+    u8 hooked[MEMORY_SIZE / 8];
+    hle_hook_t hooks[HLE_MAX_HOOKS];
+    u32 count;
+} hle_t;
+
+hle_t *hle_create(void);
+void hle_destroy(hle_t *hle);
+bool hle_add(struct cpu_t *cpu, const char *name, u16 address, hle_fn_t run);
+u32 hle_dispatch(struct cpu_t *cpu);
+void hle_report(const hle_t *hle, FILE *out);
+
+#endif
@@ -0,0 +1,168 @@
+#include "aci.h"
+#include "cpu/cpu.h"
+
+void aci_init(aci_t *aci, void *cpu)
+{
+    aci->device = (mem_device_t){"aci", ACI_IO_START, ACI_ROM_START - 1, aci_read, aci_write, cpu};
+
+    tape_init(&aci->input);
+    aci->playing = false;
+    aci->position = 0;
+    aci->next_edge = 0;
+    aci->in_level = false;
+
+    tape_init(&aci->output);
+    aci->record = false;
+    aci->out_level = false;
+    aci->out_started = false;
+    aci->last_toggle = 0;
+
+    aci->fast_load = true;
+    aci->fast_loads = 0;
+}
+
+void aci_free(aci_t *aci)
+{
+    tape_free(&aci->input);
+    tape_free(&aci->output);
+}
+
+// Replace the input tape, rewound
+bool aci_insert(aci_t *aci, const char *path, char *err, size_t len)
+{
+    tape_free(&aci->input);
+    aci->playing = false;
+    aci->position = 0;
+    aci->in_level = false;
+
+    return tape_load(&aci->input, path, err, len);
+}
+
+bool aci_save(aci_t *aci, const char *path, char *err, size_t len)
+{
+    if (aci->output.count == 0)
+    {
+        snprintf(err, len, "%s: nothing was recorded", path);
+        return false;
+    }
+    return tape_save(&aci->output, path, err, len);
+}
+
+// Catch the input level up with the CPU
+static void aci_play(aci_t *aci, u64 cycles)
+{
+    if (!aci->playing)
+    {
+        if (aci->input.count == 0)
+            return;
+
+        aci->playing = true;
+        aci->position = 0;
+        aci->next_edge = cycles + aci->input.halves[0];
+    }
+
+    while (aci->position < aci->input.count && cycles >= aci->next_edge)
+    {
+        aci->in_level = !aci->in_level;
+        if (++aci->position < aci->input.count)
+            aci->next_edge += aci->input.halves[aci->position];
+    }
+}
+
+static void aci_toggle(aci_t *aci, u64 cycles)
+{
+    aci->out_level = !aci->out_level;
+
+    if (!aci->record)
+        return;
+
+    if (aci->out_started)
+        tape_append(&aci->output, (u32)(cycles - aci->last_toggle));
+
+    aci->out_started = true;
+    aci->last_toggle = cycles;
+}
+
+// The first input sample of the ROM read routine happens two calls deep:
+// READ calls FULLCYCLE, which calls CMPLEVEL
+static bool aci_read_starting(cpu_t *cpu)
+{
+    static const u8 frames[] = {0xBE, 0xC1, 0x8F, 0xC1}; // JSR returns at $C1BE, $C18F
+
+    for (u8 i = 0; i < sizeof(frames); i++)
+    {
+        if (read_memory(cpu, 0x100 | (u8)(cpu->SP + 1 + i)) != frames[i])
+            return false;
+    }
+    return true;
+}
+
+// Decode the next block straight into A1..A2 and leave the ROM where its
+// read loop ends, instead of sampling every half wave. Falls back to real
+// time playback when no block is found
+static void aci_fast_load(cpu_t *cpu)
+{
+    aci_t *aci = &cpu->aci;
+    u16 start = read_memory(cpu, 0x26) | (read_memory(cpu, 0x27) << 8);
+    u16 end = read_memory(cpu, 0x24) | (read_memory(cpu, 0x25) << 8);
+    size_t max = end >= start ? (size_t)(end - start) + 1 : 1;
+    size_t position = aci->position;
+
+    u8 *block = malloc(max);
+    if (block == NULL)
+        return;
+
+    size_t size = tape_decode_block(&aci->input, &position, block, max);
+
+    for (size_t i = 0; i < size; i++)
+        write_memory(cpu, (u16)(start + i), block[i]);
+    free(block);
+
+    if (size == 0)
+        return;
+
+    u16 next = (u16)(start + size);
+    write_memory(cpu, 0x26, next & 0xFF);
+    write_memory(cpu, 0x27, next >> 8);
+
+    // What the ROM would leave behind: X saved by WHEADER, carry set by the
+    // final INCADDR, both JSR frames popped
+    write_memory(cpu, 0x28, cpu->X);
+    cpu->P |= CARRY_FLAG;
+    cpu->SP += 4;
+    cpu->PC = ACI_READ_DONE;
+
+    aci->position = position;
+    if (position < aci->input.count)
+        aci->next_edge = cpu->global_cycles + aci->input.halves[position];
+    aci->fast_loads++;
+}
+
+u8 aci_read(void *ctx, u16 address)
+{
+    cpu_t *cpu = ctx;
+    aci_t *aci = &cpu->aci;
+
+    if (address == ACI_TAPE_IN)
+    {
+        aci_play(aci, cpu->global_cycles);
+
+        if (aci->fast_load && aci->playing && aci_read_starting(cpu))
+            aci_fast_load(cpu);
+    }
+    else
+    {
+        aci_toggle(aci, cpu->global_cycles);
+    }
+
+    return cpu->memory[ACI_ROM_START | (address & 0xFE) | aci->in_level];
+}
+
+void aci_write(void *ctx, u16 address, u8 value)
+{
+    cpu_t *cpu = ctx;
+    (void)address;
+    (void)value;
+
+    aci_toggle(&cpu->aci, cpu->global_cycles);
+}
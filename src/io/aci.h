@@ -0,0 +1,49 @@
+#ifndef ACI_H
+#define ACI_H
+
+#include "utils/util.h"
+#include "mem/memory.h"
+#include "io/tape.h"
+
+// Apple Cassette Interface: the 256 byte ROM at 0xC100-0xC1FF plus the tape
+// flip-flops in 0xC000-0xC0FF. Reading 0xC081 samples the input, which
+// selects the even or odd ROM byte; any other access toggles the output
+#define ACI_IO_START 0xC000
+#define ACI_ROM_START 0xC100
+#define ACI_TAPE_IN 0xC081
+
+// Entry of the ROM read routine and where it continues once the read is done
+#define ACI_READ 0xC18D
+#define ACI_READ_DONE 0xC189
+
+typedef struct
+{
+    mem_device_t device;
+
+    // Input tape. Playback starts at the first access after the tape is
+    // inserted and follows global_cycles from then on
+    tape_t input;
+    bool playing;
+    size_t position;  // Next half wave
+    u64 next_edge;    // global_cycles of the next level change
+    bool in_level;
+
+    // Output tape, recorded while record is set
+    tape_t output;
+    bool record;
+    bool out_level;
+    bool out_started;
+    u64 last_toggle;
+
+    bool fast_load;   // Transfer whole blocks when the ROM starts a read
+    u32 fast_loads;
+} aci_t;
+
+void aci_init(aci_t *aci, void *cpu);
+void aci_free(aci_t *aci);
+bool aci_insert(aci_t *aci, const char *path, char *err, size_t len);
+bool aci_save(aci_t *aci, const char *path, char *err, size_t len);
+u8 aci_read(void *ctx, u16 address);
+void aci_write(void *ctx, u16 address, u8 value);
+
+#endif
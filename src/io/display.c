@@ -0,0 +1,72 @@
+#include "display.h"
+
+void display_init(display_t *display, bool realtime)
+{
+    display_clear(display);
+    display->realtime = realtime;
+    display->busy_until = 0;
+    display->chars = 0;
+    display->refreshes = 0;
+}
+
+void display_clear(display_t *display)
+{
+    memset(display->screen, ' ', sizeof(display->screen));
+    display->row = 0;
+    display->col = 0;
+    display->dirty_rows = DISPLAY_ALL_ROWS;
+}
+
+static void display_newline(display_t *display)
+{
+    display->col = 0;
+
+    if (display->row < DISPLAY_ROWS - 1)
+    {
+        display->row++;
+        return;
+    }
+
+    // Scroll up one line
+    memmove(display->screen[0], display->screen[1], (DISPLAY_ROWS - 1) * DISPLAY_COLS);
+    memset(display->screen[DISPLAY_ROWS - 1], ' ', DISPLAY_COLS);
+    display->dirty_rows = DISPLAY_ALL_ROWS;
+}
+
+void display_write(display_t *display, u8 value, u64 cycles)
+{
+    u8 ch = value & 0x7F;
+
+    display->chars++;
+    if (display->realtime)
+        display->busy_until = cycles + DISPLAY_CYCLES_PER_CHAR;
+
+    if (ch == 0x7F)
+    {
+        if (display->col > 0)
+        {
+            display->col--;
+            display->screen[display->row][display->col] = ' ';
+            display->dirty_rows |= 1u << display->row;
+        }
+    }
+    else if (ch == '\n' || ch == '\r')
+    {
+        display_newline(display);
+        display->dirty_rows |= 1u << display->row;
+    }
+    else if (ch >= 0x20 && ch <= 0x7E)
+    {
+        display->screen[display->row][display->col++] = ch;
+        display->dirty_rows |= 1u << display->row;
+
+        if (display->col >= DISPLAY_COLS)
+            display_newline(display);
+    }
+}
+
+// Bit 7 of 0xD012 reads back as 1 while the display is still shifting out
+bool display_busy(display_t *display, u64 cycles)
+{
+    return display->realtime && cycles < display->busy_until;
+}
@@ -0,0 +1,33 @@
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include "utils/util.h"
+
+#define DISPLAY_COLS 40
+#define DISPLAY_ROWS 24
+#define DISPLAY_ALL_ROWS ((1u << DISPLAY_ROWS) - 1)
+
+// The Apple-1 terminal section shifts out about 60 characters per second
+#define DISPLAY_CHARS_PER_SEC 60
+#define DISPLAY_CYCLES_PER_CHAR (APPLE1_CLOCK_HZ / DISPLAY_CHARS_PER_SEC)
+
+typedef struct
+{
+    char screen[DISPLAY_ROWS][DISPLAY_COLS];
+    u8 row;
+    u8 col;
+    u32 dirty_rows;   // One bit per row changed since the last flush
+
+    bool realtime;    // Model the real display rate through the 0xD012 busy bit
+    u64 busy_until;   // global_cycles at which the next character is accepted
+
+    u64 chars;        // Characters written to 0xD012
+    u64 refreshes;    // Terminal refreshes actually issued
+} display_t;
+
+void display_init(display_t *display, bool realtime);
+void display_clear(display_t *display);
+void display_write(display_t *display, u8 value, u64 cycles);
+bool display_busy(display_t *display, u64 cycles);
+
+#endif
@@ -0,0 +1,82 @@
+#include "keyboard.h"
+
+void keyboard_init(keyboard_t *kb)
+{
+    atomic_init(&kb->head, 0);
+    atomic_init(&kb->tail, 0);
+    memset(kb->keys, 0, sizeof(kb->keys));
+}
+
+bool keyboard_push(keyboard_t *kb, u8 key)
+{
+    unsigned head = atomic_load_explicit(&kb->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&kb->tail, memory_order_acquire);
+
+    if (head - tail == KEYBOARD_QUEUE_SIZE)
+        return false; // Full
+
+    kb->keys[head & (KEYBOARD_QUEUE_SIZE - 1)] = key;
+    atomic_store_explicit(&kb->head, head + 1, memory_order_release);
+    return true;
+}
+
+bool keyboard_pop(keyboard_t *kb, u8 *key)
+{
+    unsigned tail = atomic_load_explicit(&kb->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&kb->head, memory_order_acquire);
+
+    if (head == tail)
+        return false; // Empty
+
+    *key = kb->keys[tail & (KEYBOARD_QUEUE_SIZE - 1)];
+    atomic_store_explicit(&kb->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+bool keyboard_empty(keyboard_t *kb)
+{
+    return atomic_load_explicit(&kb->head, memory_order_acquire) ==
+           atomic_load_explicit(&kb->tail, memory_order_acquire);
+}
+
+unsigned keyboard_space(keyboard_t *kb)
+{
+    unsigned head = atomic_load_explicit(&kb->head, memory_order_acquire);
+    unsigned tail = atomic_load_explicit(&kb->tail, memory_order_acquire);
+    return KEYBOARD_QUEUE_SIZE - (head - tail);
+}
+
+// Consumer side only: drops everything typed ahead
+void keyboard_clear(keyboard_t *kb)
+{
+    atomic_store_explicit(&kb->tail, atomic_load_explicit(&kb->head, memory_order_acquire),
+                          memory_order_release);
+}
+
+// Consumer side only: copy the queued keys, oldest first, without taking them
+unsigned keyboard_peek_all(keyboard_t *kb, u8 *keys)
+{
+    unsigned tail = atomic_load_explicit(&kb->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&kb->head, memory_order_acquire);
+    unsigned count = 0;
+
+    for (; tail != head; tail++)
+        keys[count++] = kb->keys[tail & (KEYBOARD_QUEUE_SIZE - 1)];
+
+    return count;
+}
+
+// Map a host character to what the Apple-1 keyboard would send, -1 if none
+int keyboard_ascii(int ch)
+{
+    if (ch == '\n' || ch == '\r')
+        return '\r';
+
+    if (ch >= 'a' && ch <= 'z')
+        ch += 'A' - 'a';
+
+    if (ch < 0 || ch > 0x7F)
+        return -1;
+
+    return ch;
+}
@@ -0,0 +1,29 @@
+#ifndef KEYBOARD_H
+#define KEYBOARD_H
+
+#include <stdatomic.h>
+
+#include "utils/util.h"
+
+// Must be a power of two
+#define KEYBOARD_QUEUE_SIZE 256
+
+// Single-producer/single-consumer key queue. The input stage pushes, the PIA
+// pops when the 6502 reads 0xD010/0xD011, so typed-ahead keys are never lost
+typedef struct
+{
+    _Atomic unsigned head; // Next slot to write, owned by the producer
+    _Atomic unsigned tail; // Next slot to read, owned by the consumer
+    u8 keys[KEYBOARD_QUEUE_SIZE];
+} keyboard_t;
+
+void keyboard_init(keyboard_t *kb);
+bool keyboard_push(keyboard_t *kb, u8 key);
+bool keyboard_pop(keyboard_t *kb, u8 *key);
+bool keyboard_empty(keyboard_t *kb);
+unsigned keyboard_space(keyboard_t *kb);
+void keyboard_clear(keyboard_t *kb);
+unsigned keyboard_peek_all(keyboard_t *kb, u8 *keys);
+int keyboard_ascii(int ch);
+
+#endif
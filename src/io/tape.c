@@ -0,0 +1,422 @@
+#include "tape.h"
+
+#include <strings.h>
+#include <sys/stat.h>
+
+#define TAPE_WAV_RATE 44100
+#define TAPE_MAX_FILE (64u << 20)
+
+typedef struct
+{
+    char magic[8];
+    u32 version;
+    u32 blocks; // Each block: u32 size, then size bytes
+} tape_header_t;
+
+void tape_init(tape_t *tape)
+{
+    tape->halves = NULL;
+    tape->count = 0;
+    tape->capacity = 0;
+}
+
+void tape_free(tape_t *tape)
+{
+    free(tape->halves);
+    tape_init(tape);
+}
+
+bool tape_append(tape_t *tape, u32 cycles)
+{
+    if (tape->count == tape->capacity)
+    {
+        size_t capacity = tape->capacity ? tape->capacity * 2 : 4096;
+        u32 *halves = realloc(tape->halves, capacity * sizeof(u32));
+        if (halves == NULL)
+            return false;
+
+        tape->halves = halves;
+        tape->capacity = capacity;
+    }
+
+    tape->halves[tape->count++] = cycles;
+    return true;
+}
+
+// Header tone, start bit and the data, the way the ACI write routine lays it out
+bool tape_append_block(tape_t *tape, const u8 *data, size_t size)
+{
+    bool ok = true;
+
+    for (int i = 0; i < TAPE_HEADER_HALVES; i++)
+        ok &= tape_append(tape, TAPE_ONE_HALF);
+
+    ok &= tape_append(tape, TAPE_ZERO_HALF);
+    ok &= tape_append(tape, TAPE_ZERO_HALF);
+
+    for (size_t i = 0; i < size; i++)
+    {
+        for (int bit = 7; bit >= 0; bit--)
+        {
+            u32 half = (data[i] >> bit) & 1 ? TAPE_ONE_HALF : TAPE_ZERO_HALF;
+            ok &= tape_append(tape, half);
+            ok &= tape_append(tape, half);
+        }
+    }
+
+    return ok && tape_append(tape, TAPE_GAP_HALF);
+}
+
+// Decode the next block at or after *pos, returns the number of bytes stored
+// in data (0 if the tape holds no further block). *pos is left after the
+// last byte read
+size_t tape_decode_block(const tape_t *tape, size_t *pos, u8 *data, size_t max)
+{
+    const u32 *halves = tape->halves;
+    size_t i = *pos;
+    size_t header = 0;
+
+    // Header tone, then the first short half wave is the start bit
+    while (i < tape->count && !(header >= TAPE_MIN_HEADER && halves[i] < TAPE_START_LIMIT))
+    {
+        header = halves[i] >= TAPE_START_LIMIT && halves[i] < TAPE_SILENCE ? header + 1 : 0;
+        i++;
+    }
+
+    if (i + 2 > tape->count)
+    {
+        *pos = tape->count;
+        return 0;
+    }
+    i += 2;
+
+    size_t size = 0;
+
+    while (size < max && i + 16 <= tape->count)
+    {
+        u8 byte = 0;
+        bool complete = true;
+
+        for (int bit = 0; bit < 8 && complete; bit++)
+        {
+            u32 first = halves[i + 2 * bit];
+            u32 second = halves[i + 2 * bit + 1];
+
+            complete = first < TAPE_SILENCE && second < TAPE_SILENCE;
+            byte = (u8)(byte << 1) | (first + second > TAPE_BIT_LIMIT);
+        }
+
+        if (!complete)
+            break;
+
+        data[size++] = byte;
+        i += 16;
+    }
+
+    *pos = i;
+    return size;
+}
+
+static u16 get_u16(const u8 *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static u32 get_u32(const u8 *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((u32)p[3] << 24);
+}
+
+static void put_u16(u8 *p, u16 value)
+{
+    p[0] = value & 0xFF;
+    p[1] = value >> 8;
+}
+
+static void put_u32(u8 *p, u32 value)
+{
+    put_u16(p, value & 0xFFFF);
+    put_u16(p + 2, value >> 16);
+}
+
+// 8 or 16 bit PCM, any rate, first channel only. Level changes are zero
+// crossings with some hysteresis so noise on a real recording is ignored
+static bool tape_load_wav(tape_t *tape, const u8 *file, size_t size, char *err, size_t len)
+{
+    if (size < 12 || memcmp(file + 8, "WAVE", 4) != 0)
+    {
+        snprintf(err, len, "not a WAVE file");
+        return false;
+    }
+
+    u16 channels = 0, bits = 0;
+    u32 rate = 0;
+    const u8 *samples = NULL;
+    size_t frames = 0;
+
+    for (size_t offset = 12; offset + 8 <= size;)
+    {
+        const u8 *chunk = file + offset;
+        u32 chunk_size = get_u32(chunk + 4);
+
+        if (chunk_size > size - offset - 8)
+            chunk_size = (u32)(size - offset - 8);
+
+        if (memcmp(chunk, "fmt ", 4) == 0 && chunk_size >= 16)
+        {
+            u16 format = get_u16(chunk + 8);
+            channels = get_u16(chunk + 10);
+            rate = get_u32(chunk + 12);
+            bits = get_u16(chunk + 22);
+
+            if ((format != 1 && format != 0xFFFE) || (bits != 8 && bits != 16) || channels == 0 || rate == 0)
+            {
+                snprintf(err, len, "only 8 or 16 bit PCM WAVE files are supported");
+                return false;
+            }
+        }
+        else if (memcmp(chunk, "data", 4) == 0 && channels)
+        {
+            samples = chunk + 8;
+            frames = chunk_size / (channels * (bits / 8));
+        }
+
+        offset += 8 + chunk_size + (chunk_size & 1);
+    }
+
+    if (samples == NULL || frames == 0)
+    {
+        snprintf(err, len, "no audio data");
+        return false;
+    }
+
+    size_t stride = channels * (bits / 8);
+    int peak = 0;
+
+    for (size_t n = 0; n < frames; n++)
+    {
+        const u8 *s = samples + n * stride;
+        int value = bits == 8 ? (s[0] - 128) << 8 : (i16)get_u16(s);
+        if (abs(value) > peak)
+            peak = abs(value);
+    }
+
+    int threshold = peak / 8;
+    bool level = false;
+    u64 last = 0;
+    bool started = false;
+
+    for (size_t n = 0; n < frames; n++)
+    {
+        const u8 *s = samples + n * stride;
+        int value = bits == 8 ? (s[0] - 128) << 8 : (i16)get_u16(s);
+
+        if (level ? value >= -threshold : value <= threshold)
+            continue;
+
+        level = !level;
+
+        u64 cycle = (u64)n * APPLE1_CLOCK_HZ / rate;
+        if (started && !tape_append(tape, (u32)(cycle - last)))
+        {
+            snprintf(err, len, "out of memory");
+            return false;
+        }
+        last = cycle;
+        started = true;
+    }
+
+    if (tape->count == 0)
+    {
+        snprintf(err, len, "no signal found");
+        return false;
+    }
+    return true;
+}
+
+static bool tape_load_compact(tape_t *tape, const u8 *file, size_t size, char *err, size_t len)
+{
+    tape_header_t header;
+
+    if (size < sizeof(header))
+    {
+        snprintf(err, len, "truncated tape header");
+        return false;
+    }
+
+    memcpy(&header, file, sizeof(header));
+    if (header.version != TAPE_VERSION)
+    {
+        snprintf(err, len, "not a version %d tape", TAPE_VERSION);
+        return false;
+    }
+
+    size_t offset = sizeof(header);
+
+    for (u32 i = 0; i < header.blocks; i++)
+    {
+        u32 block;
+
+        if (offset + sizeof(block) > size)
+        {
+            snprintf(err, len, "truncated block %u", i);
+            return false;
+        }
+        memcpy(&block, file + offset, sizeof(block));
+        offset += sizeof(block);
+
+        if (block > size - offset)
+        {
+            snprintf(err, len, "truncated block %u", i);
+            return false;
+        }
+
+        if (!tape_append_block(tape, file + offset, block))
+        {
+            snprintf(err, len, "out of memory");
+            return false;
+        }
+        offset += block;
+    }
+    return true;
+}
+
+// Append the contents of a WAV or A1TAPE file, told apart by their magic
+bool tape_load(tape_t *tape, const char *path, char *err, size_t len)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        snprintf(err, len, "%s: %s", path, strerror(errno));
+        return false;
+    }
+
+    // The buffer only lives until the file is converted to half waves
+    struct stat st;
+    if (fstat(fileno(file), &st) != 0 || st.st_size > TAPE_MAX_FILE)
+    {
+        snprintf(err, len, "%s: file too large, tapes are at most %u MB", path, TAPE_MAX_FILE >> 20);
+        fclose(file);
+        return false;
+    }
+
+    size_t size = (size_t)st.st_size;
+    u8 *data = malloc(size ? size : 1);
+    bool read = data && fread(data, 1, size, file) == size;
+    fclose(file);
+
+    char message[128] = "";
+    bool ok = false;
+
+    if (data == NULL)
+        snprintf(message, sizeof(message), "out of memory");
+    else if (!read)
+        snprintf(message, sizeof(message), "read error");
+    else if (size >= 4 && memcmp(data, "RIFF", 4) == 0)
+        ok = tape_load_wav(tape, data, size, message, sizeof(message));
+    else if (size >= sizeof(TAPE_MAGIC) && memcmp(data, TAPE_MAGIC, sizeof(TAPE_MAGIC)) == 0)
+        ok = tape_load_compact(tape, data, size, message, sizeof(message));
+    else
+        snprintf(message, sizeof(message), "neither a WAVE nor an %s file", TAPE_MAGIC);
+
+    if (!ok)
+        snprintf(err, len, "%s: %s", path, message);
+
+    free(data);
+    return ok;
+}
+
+// Square wave, 8 bit mono
+static bool tape_save_wav(const tape_t *tape, FILE *file)
+{
+    u64 total = 0;
+    for (size_t i = 0; i < tape->count; i++)
+        total += tape->halves[i];
+
+    u32 frames = (u32)(total * TAPE_WAV_RATE / APPLE1_CLOCK_HZ) + 1;
+    u8 header[44];
+
+    memcpy(header, "RIFF", 4);
+    put_u32(header + 4, 36 + frames);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    put_u32(header + 16, 16);
+    put_u16(header + 20, 1);             // PCM
+    put_u16(header + 22, 1);             // Mono
+    put_u32(header + 24, TAPE_WAV_RATE);
+    put_u32(header + 28, TAPE_WAV_RATE); // Bytes per second
+    put_u16(header + 32, 1);             // Bytes per frame
+    put_u16(header + 34, 8);
+    memcpy(header + 36, "data", 4);
+    put_u32(header + 40, frames);
+
+    if (fwrite(header, sizeof(header), 1, file) != 1)
+        return false;
+
+    u64 cycle = 0;
+    u32 frame = 0;
+    u8 level = 0x40;
+
+    for (size_t i = 0; i < tape->count; i++)
+    {
+        cycle += tape->halves[i];
+        u32 end = (u32)(cycle * TAPE_WAV_RATE / APPLE1_CLOCK_HZ);
+
+        for (; frame < end; frame++)
+            fputc(level, file);
+        level ^= 0x80;
+    }
+    for (; frame < frames; frame++)
+        fputc(level, file);
+
+    return !ferror(file);
+}
+
+static bool tape_save_compact(const tape_t *tape, FILE *file)
+{
+    u8 *block = malloc(MEMORY_SIZE);
+    if (block == NULL)
+        return false;
+
+    tape_header_t header = {0};
+    memcpy(header.magic, TAPE_MAGIC, sizeof(TAPE_MAGIC));
+    header.version = TAPE_VERSION;
+    fwrite(&header, sizeof(header), 1, file);
+
+    size_t pos = 0;
+    u32 size;
+
+    while ((size = (u32)tape_decode_block(tape, &pos, block, MEMORY_SIZE)) > 0)
+    {
+        fwrite(&size, sizeof(size), 1, file);
+        fwrite(block, 1, size, file);
+        header.blocks++;
+    }
+
+    free(block);
+
+    rewind(file);
+    fwrite(&header, sizeof(header), 1, file);
+    return !ferror(file);
+}
+
+// A .wav path gets the waveform, anything else the compact block format
+bool tape_save(const tape_t *tape, const char *path, char *err, size_t len)
+{
+    const char *ext = strrchr(path, '.');
+    bool wav = ext && strcasecmp(ext, ".wav") == 0;
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        snprintf(err, len, "%s: %s", path, strerror(errno));
+        return false;
+    }
+
+    bool ok = wav ? tape_save_wav(tape, file) : tape_save_compact(tape, file);
+
+    if (fclose(file) != 0)
+        ok = false;
+    if (!ok)
+        snprintf(err, len, "%s: write failed", path);
+    return ok;
+}
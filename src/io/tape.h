@@ -0,0 +1,41 @@
+#ifndef TAPE_H
+#define TAPE_H
+
+#include "utils/util.h"
+
+#define TAPE_MAGIC "A1TAPE"
+#define TAPE_VERSION 1
+
+// Nominal ACI timings in CPU cycles per half wave: header tone and '1' bits
+// at 1 kHz, '0' bits at 2 kHz. A short half wave after the header is the
+// start bit; data follows MSB first, one full wave per bit
+#define TAPE_ONE_HALF 500
+#define TAPE_ZERO_HALF 250
+#define TAPE_HEADER_HALVES 10000 // About 5 seconds, longer than the ACI read delay
+#define TAPE_GAP_HALF APPLE1_CLOCK_HZ
+
+// Decoding thresholds, the same ones the ACI read routine uses
+#define TAPE_START_LIMIT 375 // Shorter half waves end the header
+#define TAPE_BIT_LIMIT 750   // Longer full waves are '1' bits
+#define TAPE_SILENCE 2000    // Longer half waves end a block
+#define TAPE_MIN_HEADER 64
+
+// A tape is the time between level changes, so playback only has to count
+// cycles. WAV files are converted on load and rendered on save; the compact
+// A1TAPE format stores only the decoded data blocks
+typedef struct
+{
+    u32 *halves; // Half wave lengths in CPU cycles
+    size_t count;
+    size_t capacity;
+} tape_t;
+
+void tape_init(tape_t *tape);
+void tape_free(tape_t *tape);
+bool tape_append(tape_t *tape, u32 cycles);
+bool tape_append_block(tape_t *tape, const u8 *data, size_t size);
+size_t tape_decode_block(const tape_t *tape, size_t *pos, u8 *data, size_t max);
+bool tape_load(tape_t *tape, const char *path, char *err, size_t len);
+bool tape_save(const tape_t *tape, const char *path, char *err, size_t len);
+
+#endif
@@ -0,0 +1,128 @@
+#include "timer.h"
+#include "cpu/cpu.h"
+
+void timer_init(itimer_t *timer, void *cpu)
+{
+    timer->device = (mem_device_t){"timer", TIMER_START, TIMER_END, timer_read, timer_write, cpu};
+    timer->period = 0;
+    timer->control = 0;
+    timer->status = 0;
+    timer->deadline = 0;
+}
+
+static u64 timer_period(const itimer_t *timer)
+{
+    return timer->period ? timer->period : 0x10000;
+}
+
+// Hold the selected interrupt line while expired, release the other one
+static void timer_signal(itimer_t *timer)
+{
+    cpu_t *cpu = timer->device.ctx;
+    bool asserted = (timer->status & TIMER_EXPIRED) && (timer->control & TIMER_INTERRUPT);
+    bool nmi = timer->control & TIMER_NMI;
+
+    interrupt_set_irq(cpu, INTERRUPT_TIMER, asserted && !nmi);
+    interrupt_set_nmi(cpu, INTERRUPT_TIMER, asserted && nmi);
+}
+
+// Stopped and acknowledged, as after RESET
+void timer_reset(itimer_t *timer)
+{
+    cpu_t *cpu = timer->device.ctx;
+
+    timer->control = 0;
+    timer->status = 0;
+    timer_signal(timer);
+    cpu->next_event = UINT64_MAX;
+}
+
+static void timer_start(itimer_t *timer, u64 cycles)
+{
+    cpu_t *cpu = timer->device.ctx;
+
+    timer->deadline = cycles + timer_period(timer);
+    cpu_schedule(cpu, timer->deadline);
+}
+
+// Catch up with the CPU, returns the cycle of the next expiry. Periods that
+// passed while nobody looked (the frontend skipping idle time) count once
+u64 timer_update(itimer_t *timer, u64 cycles)
+{
+    if (!(timer->control & TIMER_RUN))
+        return UINT64_MAX;
+
+    if (cycles >= timer->deadline)
+    {
+        timer->status |= TIMER_EXPIRED;
+
+        if (timer->control & TIMER_ONE_SHOT)
+        {
+            timer->control &= ~TIMER_RUN;
+        }
+        else
+        {
+            u64 period = timer_period(timer);
+            timer->deadline += ((cycles - timer->deadline) / period + 1) * period;
+        }
+
+        timer_signal(timer);
+    }
+
+    return timer->control & TIMER_RUN ? timer->deadline : UINT64_MAX;
+}
+
+u8 timer_read(void *ctx, u16 address)
+{
+    cpu_t *cpu = ctx;
+    itimer_t *timer = &cpu->timer;
+    u64 cycles = cpu->global_cycles;
+
+    // The count is derived from the deadline; expiries due mid-instruction
+    // are only applied at the next boundary
+    u16 counter = timer->control & TIMER_RUN && timer->deadline > cycles ? (u16)(timer->deadline - cycles) : 0;
+
+    switch (address)
+    {
+    case TIMER_COUNTER_LO:
+        return counter & 0xFF;
+    case TIMER_COUNTER_HI:
+        return counter >> 8;
+    case TIMER_CONTROL:
+        return timer->control;
+    default:
+        return timer->status;
+    }
+}
+
+void timer_write(void *ctx, u16 address, u8 value)
+{
+    cpu_t *cpu = ctx;
+    itimer_t *timer = &cpu->timer;
+
+    switch (address)
+    {
+    case TIMER_COUNTER_LO:
+        timer->period = (timer->period & 0xFF00) | value;
+        break;
+    case TIMER_COUNTER_HI:
+        timer->period = (timer->period & 0x00FF) | (value << 8);
+        if (timer->control & TIMER_RUN)
+            timer_start(timer, cpu->global_cycles);
+        break;
+    case TIMER_CONTROL:
+    {
+        bool started = !(timer->control & TIMER_RUN) && (value & TIMER_RUN);
+
+        timer->control = value;
+        if (started)
+            timer_start(timer, cpu->global_cycles);
+        timer_signal(timer);
+        break;
+    }
+    default:
+        timer->status &= ~TIMER_EXPIRED;
+        timer_signal(timer);
+        break;
+    }
+}
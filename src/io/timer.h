@@ -0,0 +1,46 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "utils/util.h"
+#include "mem/memory.h"
+
+// Programmable interval timer at 0xC200-0xC203, counting CPU cycles:
+//   0xC200  counter low  (read) / period low  (write)
+//   0xC201  counter high (read) / period high (write, restarts the count)
+//   0xC202  control, see below
+//   0xC203  status: bit 7 set once the counter ran out; any write clears it
+// The interrupt line follows the status bit while TIMER_INTERRUPT is set,
+// so a handler acknowledges by writing 0xC203
+#define TIMER_START 0xC200
+#define TIMER_END 0xC203
+
+#define TIMER_COUNTER_LO 0xC200
+#define TIMER_COUNTER_HI 0xC201
+#define TIMER_CONTROL 0xC202
+#define TIMER_STATUS 0xC203
+
+// Control bits
+#define TIMER_RUN 0x01       // Count; cleared again when a one-shot runs out
+#define TIMER_ONE_SHOT 0x02  // Stop at the first expiry instead of reloading
+#define TIMER_NMI 0x40       // Signal on NMI instead of IRQ
+#define TIMER_INTERRUPT 0x80 // Drive the interrupt line
+
+// Status bits
+#define TIMER_EXPIRED 0x80
+
+typedef struct
+{
+    mem_device_t device;
+    u16 period;     // In cycles, 0 = 65536
+    u8 control;
+    u8 status;
+    u64 deadline;   // global_cycles of the next expiry while running
+} itimer_t;
+
+void timer_init(itimer_t *timer, void *cpu);
+void timer_reset(itimer_t *timer);
+u64 timer_update(itimer_t *timer, u64 cycles);
+u8 timer_read(void *ctx, u16 address);
+void timer_write(void *ctx, u16 address, u8 value);
+
+#endif
@@ -0,0 +1,198 @@
+#include "jit.h"
+#include "cpu/cpu.h"
+
+#include <sys/mman.h>
+
+// Dynamic translation of hot 6502 code. cpu_run hands its bursts to
+// jit_run, which interprets through cpu_cycle and counts how often each PC
+// comes round. Once one is hot the straight-line code from there, up to
+// the first instruction that needs the interpreter (device I/O, ROM writes,
+// interrupt flag changes, native ROM routines), is translated to host code
+// and run from then on, as long as a pass through it can't overshoot the
+// cycle or instruction budget. Every block starts and ends on an
+// instruction boundary with all state written back, so the interpreter
+// can take over anywhere and nothing outside sees the difference
+
+jit_t *jit_create(void)
+{
+    jit_t *jit = calloc(1, sizeof(jit_t));
+    if (jit == NULL)
+        return NULL;
+
+    void *code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED)
+    {
+        free(jit);
+        return NULL;
+    }
+    jit->code = code;
+
+    if (!jit_emit_entry(jit))
+    {
+        jit_destroy(jit);
+        return NULL;
+    }
+    jit->code_used = jit->code_base;
+    return jit;
+}
+
+void jit_destroy(jit_t *jit)
+{
+    if (jit == NULL)
+        return;
+
+    munmap(jit->code, JIT_CODE_SIZE);
+    free(jit);
+}
+
+// Drop every block: when memory is remapped, or the cache is full
+void jit_flush(cpu_t *cpu)
+{
+    jit_t *jit = cpu->jit;
+
+    for (unsigned page = 0; page < MEM_PAGES; page++)
+    {
+        if (jit->page_blocks[page])
+            mem_watch(&cpu->mem, page, false);
+    }
+
+    if (jit->pool_used)
+        jit->flushes++;
+
+    memset(jit->blocks, 0, sizeof(jit->blocks));
+    memset(jit->heat, 0, sizeof(jit->heat));
+    memset(jit->cover, 0, sizeof(jit->cover));
+    memset(jit->page_blocks, 0, sizeof(jit->page_blocks));
+    jit->pool_used = 0;
+    jit->code_used = jit->code_base;
+}
+
+static void jit_invalidate(cpu_t *cpu, jit_block_t *block)
+{
+    jit_t *jit = cpu->jit;
+    u16 last = block->start + block->length - 1;
+
+    for (u16 i = 0; i < block->length; i++)
+        jit->cover[(u16)(block->start + i)]--;
+
+    for (unsigned page = block->start >> 8; page <= (unsigned)(last >> 8); page++)
+    {
+        if (--jit->page_blocks[page] == 0)
+            mem_watch(&cpu->mem, page, false);
+    }
+
+    jit->blocks[block->start] = NULL;
+    jit->heat[block->start] = 0;
+    jit->invalidated++;
+}
+
+// Watch hook: a byte of a page with translated code was written. Only
+// blocks starting up to JIT_MAX_BYTES before it can cover it
+void jit_write(cpu_t *cpu, u16 address)
+{
+    jit_t *jit = cpu->jit;
+    u32 first = address >= JIT_MAX_BYTES ? address - JIT_MAX_BYTES + 1 : 0;
+
+    for (u32 pc = first; pc <= address && jit->cover[address]; pc++)
+    {
+        jit_block_t *block = jit->blocks[pc];
+
+        if (block && address < pc + block->length)
+            jit_invalidate(cpu, block);
+    }
+}
+
+static jit_block_t *jit_compile(cpu_t *cpu, u16 pc)
+{
+    jit_t *jit = cpu->jit;
+
+    if (jit->pool_used == JIT_MAX_BLOCKS)
+        jit_flush(cpu);
+
+    jit_status_t status = jit_translate(cpu, pc, &jit->pool[jit->pool_used]);
+    if (status == JIT_FULL)
+    {
+        jit_flush(cpu);
+        status = jit_translate(cpu, pc, &jit->pool[0]);
+    }
+
+    if (status != JIT_OK)
+    {
+        jit->heat[pc] = JIT_COLD;
+        return NULL;
+    }
+
+    jit_block_t *block = &jit->pool[jit->pool_used++];
+    u16 last = block->start + block->length - 1;
+
+    for (u16 i = 0; i < block->length; i++)
+        jit->cover[(u16)(block->start + i)]++;
+
+    for (unsigned page = block->start >> 8; page <= (unsigned)(last >> 8); page++)
+    {
+        if (jit->page_blocks[page]++ == 0)
+            mem_watch(&cpu->mem, page, true);
+    }
+
+    jit->blocks[pc] = block;
+    jit->translated++;
+    return block;
+}
+
+// cpu_run_stepped with translated blocks. A block is only entered when a
+// whole pass through it fits in what is left of both budgets; otherwise,
+// and for anything not translated, cpu_cycle runs one instruction, so a
+// run stops on exactly the same instruction as with the interpreter alone
+u64 jit_run(cpu_t *cpu, u64 cycle_target, u64 max_instructions)
+{
+    jit_t *jit = cpu->jit;
+    u64 count = 0;
+
+    // Profiling and tracing see every instruction in cpu_cycle
+    if (cpu->profile || cpu->trace)
+        return cpu_run_stepped(cpu, cycle_target, max_instructions);
+
+    while (cpu->running && !cpu->yield && !cpu->halt && count < max_instructions &&
+           cpu->global_cycles < cycle_target)
+    {
+        u16 pc = cpu->PC;
+        jit_block_t *block = jit->blocks[pc];
+
+        if (block == NULL && jit->heat[pc] != JIT_COLD && ++jit->heat[pc] >= JIT_HOT)
+            block = jit_compile(cpu, pc);
+
+        if (block && cpu->global_cycles + block->cycles < cycle_target &&
+            count + block->instructions <= max_instructions)
+        {
+            u64 done = jit->enter(cpu, cycle_target - cpu->global_cycles,
+                                  max_instructions - count, block->code);
+
+            // Nothing run means the first instruction left for the
+            // interpreter, say a store into code
+            if (done)
+            {
+                count += done;
+                jit->native += done;
+                continue;
+            }
+        }
+
+        if (cpu_cycle(cpu))
+        {
+            count++;
+            jit->interpreted++;
+        }
+    }
+
+    return count;
+}
+
+void jit_report(const jit_t *jit, FILE *out)
+{
+    u64 total = jit->native + jit->interpreted;
+
+    fprintf(out, "JIT: %llu blocks translated, %llu invalidated, %llu flushes, %.1f%% of instructions native\n",
+            (unsigned long long)jit->translated, (unsigned long long)jit->invalidated,
+            (unsigned long long)jit->flushes, total ? 100.0 * jit->native / total : 0.0);
+}
@@ -0,0 +1,76 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "utils/util.h"
+#include "mem/memory.h"
+
+struct cpu_t;
+
+// Interpreted visits to a PC before the code there is translated
+#define JIT_HOT 16
+#define JIT_COLD 0xFF // heat of a PC whose first instruction can't be translated
+
+#define JIT_MAX_INSTRUCTIONS 64
+#define JIT_MAX_BYTES (JIT_MAX_INSTRUCTIONS * 3)
+#define JIT_MAX_BLOCKS 16384
+#define JIT_CODE_SIZE (4u << 20)
+
+// Runs the translated code at code until it leaves the block. cycles and
+// instructions are what is left before cpu_run has to stop; a block never
+// starts another pass through a loop that could go past either. Returns the
+// instructions run, with PC, the registers and global_cycles written back
+typedef u64 (*jit_entry_t)(struct cpu_t *cpu, u64 cycles, u64 instructions, const u8 *code);
+
+typedef struct
+{
+    const u8 *code;
+    u16 start;
+    u16 length;       // Bytes of 6502 code translated
+    u32 cycles;       // Most cycles one pass through the block can take
+    u32 instructions; // Instructions in it
+} jit_block_t;
+
+typedef enum
+{
+    JIT_OK,
+    JIT_UNSUPPORTED, // The first instruction has to be interpreted
+    JIT_FULL         // No room left in the code buffer
+} jit_status_t;
+
+// Translated basic blocks. Writes to a page with translated code go through
+// the memory map's watch hook, which drops every block covering the byte
+typedef struct jit_t
+{
+    jit_block_t *blocks[MEMORY_SIZE]; // By start address, NULL if none
+    u8 heat[MEMORY_SIZE];
+    u8 cover[MEMORY_SIZE];            // Blocks translated from each byte
+    u16 page_blocks[MEM_PAGES];       // Blocks with code in each page, watched while nonzero
+    jit_block_t pool[JIT_MAX_BLOCKS];
+    u32 pool_used;
+
+    u8 *code;         // Executable buffer of JIT_CODE_SIZE bytes
+    size_t code_base; // End of the entry and exit code, where blocks start
+    size_t code_used;
+    jit_entry_t enter;
+    const u8 *exit;   // Where blocks go to store the registers and return
+
+    u64 translated;
+    u64 invalidated;
+    u64 flushes;
+    u64 native;      // Instructions run as translated code
+    u64 interpreted; // ... and by cpu_cycle
+} jit_t;
+
+jit_t *jit_create(void);
+void jit_destroy(jit_t *jit);
+void jit_flush(struct cpu_t *cpu);
+void jit_write(struct cpu_t *cpu, u16 address);
+u64 jit_run(struct cpu_t *cpu, u64 cycle_target, u64 max_instructions);
+void jit_report(const jit_t *jit, FILE *out);
+
+// Host code generator (x64.c): the entry and exit code at the start of the
+// buffer, then one block at a time after code_used
+bool jit_emit_entry(jit_t *jit);
+jit_status_t jit_translate(struct cpu_t *cpu, u16 pc, jit_block_t *block);
+
+#endif
@@ -0,0 +1,1186 @@
+#include "jit.h"
+#include "cpu/cpu.h"
+#include "cpu/instruction.h"
+
+#if defined(__x86_64__)
+
+// x86-64 code generator. Inside a block the 6502 state lives in host
+// registers, loaded by the entry code and stored by the shared exit:
+//
+//   rbx  cpu_t *            rsi  nz, as cpu->nz      rcx  cycles run
+//   r12  A    r13  X        rdi  P, as cpu->P        rbp  instructions run
+//   r14  Y    r15  SP       r8   cycle budget        r9   instruction budget
+//
+// with rax, rdx, r10 and r11 as scratch. A, X, Y and SP only ever see byte
+// operations, so their upper bits stay clear and they can index memory
+// directly. Cycles and instructions known at translation time are added up
+// and only applied where control leaves the straight line; page crossings
+// are added as they happen. Memory is cpu->memory, which RAM and ROM are
+// mapped onto one to one, so zero page, stack and static addresses in
+// RAM/ROM are plain loads and stores; everything else checks the page table
+// at run time and leaves for the interpreter when there is no direct page
+
+enum
+{
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+#define REG_A R12
+#define REG_X R13
+#define REG_Y R14
+#define REG_S R15
+#define REG_NZ RSI
+#define REG_P RDI
+#define CYCLES RCX
+#define COUNT RBP
+
+// ALU operations, as the /digit of opcodes 0x80-0x83
+enum { OP_ADD, OP_OR, OP_ADC, OP_SBB, OP_AND, OP_SUB, OP_XOR, OP_CMP };
+
+// Condition codes
+enum { CC_O = 0x0, CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7 };
+
+// Shift group, as the /digit of 0xC1 and 0xD0
+enum { SH_ROL, SH_ROR, SH_RCL, SH_RCR, SH_SHL, SH_SHR };
+
+#define OFF(field) ((int32_t)offsetof(cpu_t, field))
+#define MEM OFF(memory)
+#define STACK (MEM + 0x100)
+
+// Encoding flags
+#define W 0x01   // 64 bit operand
+#define B8 0x02  // Byte registers: always emit REX so 4-7 are spl-dil, not ah-bh
+#define O16 0x04 // 16 bit operand
+
+typedef struct
+{
+    bool mem;
+    u8 reg;   // Register operand
+    u8 base;  // Memory operand: [base + index << scale + disp]
+    i8 index; // -1 for none
+    u8 scale;
+    int32_t disp;
+} rm_t;
+
+static rm_t R(int reg)
+{
+    return (rm_t){false, reg, 0, -1, 0, 0};
+}
+
+static rm_t M(int base, int32_t disp)
+{
+    return (rm_t){true, 0, base, -1, 0, disp};
+}
+
+static rm_t MX(int base, int index, int scale, int32_t disp)
+{
+    return (rm_t){true, 0, base, index, scale, disp};
+}
+
+typedef struct
+{
+    u8 *p;
+    u8 *end;
+    bool full;
+} out_t;
+
+static void put8(out_t *o, u8 value)
+{
+    if (o->p < o->end)
+        *o->p++ = value;
+    else
+        o->full = true;
+}
+
+static void put32(out_t *o, u32 value)
+{
+    for (int i = 0; i < 4; i++)
+        put8(o, value >> (8 * i));
+}
+
+// [66] [REX] opcode ModRM [SIB] [disp32]. reg is a register or the /digit
+// of the opcode; two byte opcodes are given with the 0x0F
+static void encode(out_t *o, unsigned flags, u32 opcode, int reg, rm_t rm)
+{
+    int base = rm.mem ? rm.base : rm.reg;
+    int index = rm.mem && rm.index >= 0 ? rm.index : 0;
+    u8 rex = 0x40 | (flags & W ? 8 : 0) | (reg & 8 ? 4 : 0) | (index & 8 ? 2 : 0) | (base & 8 ? 1 : 0);
+
+    if (flags & O16)
+        put8(o, 0x66);
+    if (rex != 0x40 || (flags & B8))
+        put8(o, rex);
+    if (opcode > 0xFF)
+        put8(o, opcode >> 8);
+    put8(o, opcode);
+
+    if (!rm.mem)
+    {
+        put8(o, 0xC0 | (reg & 7) << 3 | (base & 7));
+        return;
+    }
+
+    // Always a 32 bit displacement, which also covers rbp and r13 as base
+    if (rm.index >= 0 || (base & 7) == RSP)
+    {
+        put8(o, 0x84 | (reg & 7) << 3);
+        put8(o, rm.index >= 0 ? rm.scale << 6 | (index & 7) << 3 | (base & 7) : 0x24);
+    }
+    else
+    {
+        put8(o, 0x80 | (reg & 7) << 3 | (base & 7));
+    }
+    put32(o, (u32)rm.disp);
+}
+
+// op r/m, imm
+static void alu_i(out_t *o, unsigned flags, int op, rm_t rm, int32_t imm)
+{
+    if (flags & B8)
+    {
+        encode(o, flags, 0x80, op, rm);
+        put8(o, imm);
+    }
+    else if (imm >= -128 && imm <= 127)
+    {
+        encode(o, flags, 0x83, op, rm);
+        put8(o, imm);
+    }
+    else
+    {
+        encode(o, flags, 0x81, op, rm);
+        put32(o, imm);
+    }
+}
+
+// op r/m, reg
+static void alu_r(out_t *o, unsigned flags, int op, rm_t rm, int reg)
+{
+    encode(o, flags, op * 8 + (flags & B8 ? 0 : 1), reg, rm);
+}
+
+static void mov_ri(out_t *o, int reg, u32 imm)
+{
+    if (reg & 8)
+        put8(o, 0x41);
+    put8(o, 0xB8 + (reg & 7));
+    put32(o, imm);
+}
+
+// mov dst32, src32
+static void mov_rr(out_t *o, int dst, int src)
+{
+    encode(o, 0, 0x89, src, R(dst));
+}
+
+static void movzx8(out_t *o, int reg, rm_t rm)
+{
+    encode(o, B8, 0x0FB6, reg, rm);
+}
+
+static void store8(out_t *o, rm_t rm, int reg)
+{
+    encode(o, B8, 0x88, reg, rm);
+}
+
+static void shift_i(out_t *o, int op, int reg, u8 count)
+{
+    encode(o, 0, 0xC1, op, R(reg));
+    put8(o, count);
+}
+
+static void test_i(out_t *o, int reg, u32 imm)
+{
+    encode(o, 0, 0xF7, 0, R(reg));
+    put32(o, imm);
+}
+
+static void setcc(out_t *o, int cc, int reg)
+{
+    encode(o, B8, 0x0F90 + cc, 0, R(reg));
+}
+
+// inc/dec r8
+static void step8(out_t *o, int reg, bool down)
+{
+    encode(o, B8, 0xFE, down, R(reg));
+}
+
+// bt edi, 0: the 6502 carry into the host carry
+static void carry_in(out_t *o)
+{
+    encode(o, 0, 0x0FBA, 4, R(REG_P));
+    put8(o, 0);
+}
+
+// imul esi, reg, 0x101: N and Z from the byte in reg
+static void set_nz(out_t *o, int reg)
+{
+    encode(o, 0, 0x69, REG_NZ, R(reg));
+    put32(o, 0x101);
+}
+
+static void add_count(out_t *o, int reg, u32 value)
+{
+    if (value)
+        alu_i(o, W, OP_ADD, R(reg), (int32_t)value);
+}
+
+static void jmp_to(out_t *o, const u8 *target)
+{
+    put8(o, 0xE9);
+    put32(o, (u32)(target - (o->p + 4)));
+}
+
+// jcc rel32, to be patched. NULL once the buffer is full
+static u8 *jcc(out_t *o, int cc)
+{
+    put8(o, 0x0F);
+    put8(o, 0x80 + cc);
+    u8 *at = o->p;
+    put32(o, 0);
+    return o->full ? NULL : at;
+}
+
+static u8 *jmp(out_t *o)
+{
+    put8(o, 0xE9);
+    u8 *at = o->p;
+    put32(o, 0);
+    return o->full ? NULL : at;
+}
+
+static void patch(u8 *at, const u8 *target)
+{
+    if (at == NULL)
+        return;
+
+    u32 rel = (u32)(target - (at + 4));
+    memcpy(at, &rel, sizeof(rel));
+}
+
+typedef enum
+{
+    K_NONE,
+    K_LDA, K_LDX, K_LDY, K_STA, K_STX, K_STY,
+    K_ADC, K_SBC, K_AND, K_ORA, K_EOR, K_CMP, K_CPX, K_CPY, K_BIT,
+    K_INC, K_DEC, K_ASL, K_LSR, K_ROL, K_ROR,
+    K_ASL_A, K_LSR_A, K_ROL_A, K_ROR_A,
+    K_INX, K_INY, K_DEX, K_DEY,
+    K_TAX, K_TAY, K_TXA, K_TYA, K_TSX, K_TXS,
+    K_PHA, K_PHP, K_PLA,
+    K_CLC, K_SEC, K_CLD, K_SED, K_CLV, K_NOP,
+    K_BCC, K_BCS, K_BEQ, K_BNE, K_BMI, K_BPL, K_BVC, K_BVS,
+    K_JMP, K_JSR, K_RTS
+} kind_t;
+
+// Whatever is not listed stays with the interpreter: BRK, RTI, JMP (ind),
+// CLI, SEI and PLP (they decide when an interrupt gets in) and the
+// undocumented opcodes
+static kind_t classify(u8 opcode)
+{
+    static const struct
+    {
+        void (*operation)(cpu_t *cpu, u16 addr);
+        kind_t kind;
+    } kinds[] = {
+        {LDA, K_LDA}, {LDX, K_LDX}, {LDY, K_LDY}, {STA, K_STA}, {STX, K_STX}, {STY, K_STY},
+        {ADC, K_ADC}, {SBC, K_SBC}, {AND, K_AND}, {ORA, K_ORA}, {EOR, K_EOR},
+        {CMP, K_CMP}, {CPX, K_CPX}, {CPY, K_CPY}, {BIT, K_BIT},
+        {INC, K_INC}, {DEC, K_DEC}, {ASL, K_ASL}, {LSR, K_LSR}, {ROL, K_ROL}, {ROR, K_ROR},
+        {ASL_ACC, K_ASL_A}, {LSR_ACC, K_LSR_A}, {ROL_ACC, K_ROL_A}, {ROR_ACC, K_ROR_A},
+        {INX, K_INX}, {INY, K_INY}, {DEX, K_DEX}, {DEY, K_DEY},
+        {TAX, K_TAX}, {TAY, K_TAY}, {TXA, K_TXA}, {TYA, K_TYA}, {TSX, K_TSX}, {TXS, K_TXS},
+        {PHA, K_PHA}, {PHP, K_PHP}, {PLA, K_PLA},
+        {CLC, K_CLC}, {SEC, K_SEC}, {CLD, K_CLD}, {SED, K_SED}, {CLV, K_CLV},
+        {NOP, K_NOP},
+        {BCC, K_BCC}, {BCS, K_BCS}, {BEQ, K_BEQ}, {BNE, K_BNE},
+        {BMI, K_BMI}, {BPL, K_BPL}, {BVC, K_BVC}, {BVS, K_BVS},
+        {JSR, K_JSR}, {RTS, K_RTS},
+    };
+    const opcode_t *op = &opcodes[opcode];
+
+    if (op->illegal)
+        return K_NONE;
+    if (op->operation == JMP)
+        return op->addr_mode == ABS ? K_JMP : K_NONE;
+
+    for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++)
+    {
+        if (kinds[i].operation == op->operation)
+            return kinds[i].kind;
+    }
+    return K_NONE;
+}
+
+static bool loads(kind_t kind)
+{
+    return (kind >= K_LDA && kind <= K_LDY) || (kind >= K_ADC && kind <= K_ROR);
+}
+
+static bool stores(kind_t kind)
+{
+    return (kind >= K_STA && kind <= K_STY) || (kind >= K_INC && kind <= K_ROR);
+}
+
+static bool is_branch(kind_t kind)
+{
+    return kind >= K_BCC && kind <= K_BVS;
+}
+
+typedef struct
+{
+    u16 pc;
+    u8 opcode;
+    u8 length;
+    kind_t kind;
+    u16 operand;
+    u16 target;   // Branches and jumps
+    int inside;   // Index of the instruction at target, -1 if outside the block
+    bool label;   // Something in the block jumps here
+    const u8 *code;
+} insn_t;
+
+typedef enum
+{
+    STUB_EXIT,  // Leave for the interpreter at pc
+    STUB_STORE, // Store to a page without a direct write pointer
+    STUB_JUMP   // Branch or jump to an instruction of the block
+} stub_kind_t;
+
+typedef struct
+{
+    stub_kind_t kind;
+    u8 *from;       // rel32 that goes to the stub
+    const u8 *back; // STUB_STORE: where the store itself is
+    u16 pc;
+    u32 cycles;     // Still to be counted when the stub is taken
+    u32 count;
+    bool dynamic;   // STUB_STORE: address in eax, page in r10
+    u16 address;    // ... or this one
+    int inside;     // STUB_JUMP: the instruction it goes to
+    bool backward;
+} stub_t;
+
+#define MAX_STUBS (JIT_MAX_INSTRUCTIONS * 3)
+
+typedef struct
+{
+    cpu_t *cpu;
+    out_t out;
+    insn_t insns[JIT_MAX_INSTRUCTIONS];
+    u32 count;
+    u32 pass_cycles; // Most cycles for one pass, see jit_block_t
+    const insn_t *insn;
+    u32 cycles;      // Counted statically since the last flush
+    u32 done;
+    stub_t stubs[MAX_STUBS];
+    u32 stub_count;
+} translation_t;
+
+// Code is never translated out of zero page and the stack, which native
+// code writes without looking at the page table
+static bool fetchable(const cpu_t *cpu, u16 address)
+{
+    return address >= 0x200 && cpu->mem.read[address >> 8] != NULL;
+}
+
+static bool hooked(const cpu_t *cpu, u16 address)
+{
+    return cpu->hle && (cpu->hle->hooked[address >> 3] & (1 << (address & 7)));
+}
+
+// Native code reads and writes cpu->memory directly
+static bool identity_mapped(const cpu_t *cpu)
+{
+    const memmap_t *map = &cpu->mem;
+
+    for (unsigned page = 0; page < MEM_PAGES; page++)
+    {
+        const u8 *ram = cpu->memory + page * MEM_PAGE_SIZE;
+
+        if ((map->base_read[page] && map->base_read[page] != ram) ||
+            (map->base_write[page] && map->base_write[page] != ram))
+            return false;
+    }
+
+    return map->write[0] && map->write[1];
+}
+
+// An absolute operand has to be RAM/ROM to read, RAM to write
+static bool static_access(const cpu_t *cpu, kind_t kind, u16 address)
+{
+    unsigned page = address >> 8;
+
+    if (loads(kind) && cpu->mem.read[page] == NULL)
+        return false;
+    if (stores(kind) && (cpu->mem.base_write[page] == NULL || cpu->mem.device[page]))
+        return false;
+    return true;
+}
+
+static u32 max_cycles(const insn_t *in)
+{
+    const opcode_t *op = &opcodes[in->opcode];
+    return op->cycles + op->xpage + (is_branch(in->kind) ? 2 : 0);
+}
+
+// Straight-line code from pc up to the first instruction the block can't
+// contain, or just past a jump, JSR or RTS
+static u32 decode(translation_t *tr, u16 pc)
+{
+    const cpu_t *cpu = tr->cpu;
+    u32 count = 0;
+    u32 bytes = 0;
+
+    while (count < JIT_MAX_INSTRUCTIONS && fetchable(cpu, pc) && !hooked(cpu, pc))
+    {
+        insn_t *in = &tr->insns[count];
+        u8 opcode = cpu->memory[pc];
+        kind_t kind = classify(opcode);
+        u8 mode = opcodes[opcode].addr_mode;
+        u8 length = addr_mode_lengths[mode];
+
+        if (kind == K_NONE || bytes + length > JIT_MAX_BYTES)
+            break;
+        if (length > 1 && !fetchable(cpu, pc + length - 1))
+            break;
+
+        u16 operand = length == 1 ? 0 : length == 2 ? cpu->memory[(u16)(pc + 1)]
+                                    : cpu->memory[(u16)(pc + 1)] | cpu->memory[(u16)(pc + 2)] << 8;
+
+        if (mode == ABS && kind != K_JMP && kind != K_JSR && !static_access(cpu, kind, operand))
+            break;
+
+        *in = (insn_t){pc, opcode, length, kind, operand, 0, -1, false, NULL};
+        if (is_branch(kind))
+            in->target = pc + 2 + (i8)operand;
+        else if (kind == K_JMP || kind == K_JSR)
+            in->target = operand;
+
+        count++;
+        bytes += length;
+        pc += length;
+
+        if (kind == K_JMP || kind == K_JSR || kind == K_RTS)
+            break;
+    }
+
+    // Branches and jumps within the block stay in host code
+    for (u32 i = 0; i < count; i++)
+    {
+        insn_t *in = &tr->insns[i];
+
+        if (!is_branch(in->kind) && in->kind != K_JMP)
+            continue;
+
+        for (u32 j = 0; j < count; j++)
+        {
+            if (tr->insns[j].pc == in->target)
+            {
+                in->inside = j;
+                tr->insns[j].label = true;
+            }
+        }
+    }
+
+    return count;
+}
+
+static stub_t *add_stub(translation_t *tr, stub_kind_t kind, u8 *from)
+{
+    stub_t *stub = &tr->stubs[tr->stub_count++];
+
+    *stub = (stub_t){kind, from, NULL, tr->insn->pc, tr->cycles, tr->done, false, 0, -1, false};
+    return stub;
+}
+
+// Leave for the interpreter before the current instruction if cc holds
+static void exit_if(translation_t *tr, int cc)
+{
+    add_stub(tr, STUB_EXIT, jcc(&tr->out, cc));
+}
+
+// Count what is still pending, then return to jit_run at pc (eax if dynamic)
+static void leave(translation_t *tr, const u8 *exit, bool dynamic, u16 pc, u32 cycles, u32 count)
+{
+    out_t *o = &tr->out;
+
+    add_count(o, CYCLES, cycles);
+    add_count(o, COUNT, count);
+    if (!dynamic)
+        mov_ri(o, RAX, pc);
+    jmp_to(o, exit);
+}
+
+static void flush(translation_t *tr)
+{
+    add_count(&tr->out, CYCLES, tr->cycles);
+    add_count(&tr->out, COUNT, tr->done);
+    tr->cycles = 0;
+    tr->done = 0;
+}
+
+// r10 = page of the address in eax
+static void page_of(out_t *o)
+{
+    mov_rr(o, R10, RAX);
+    shift_i(o, SH_SHR, R10, 8);
+}
+
+static void read_check(translation_t *tr)
+{
+    out_t *o = &tr->out;
+
+    page_of(o);
+    encode(o, W, 0x83, OP_CMP, MX(RBX, R10, 3, OFF(mem.read)));
+    put8(o, 0);
+    exit_if(tr, CC_E);
+}
+
+// Pages with translated code are watched, so stores there find no write
+// pointer; the stub lets them through as long as they miss the code itself
+static void store_check(translation_t *tr, bool dynamic, u16 address)
+{
+    out_t *o = &tr->out;
+
+    if (dynamic)
+    {
+        page_of(o);
+        encode(o, W, 0x83, OP_CMP, MX(RBX, R10, 3, OFF(mem.write)));
+    }
+    else
+    {
+        encode(o, W, 0x83, OP_CMP, M(RBX, OFF(mem.write) + (address >> 8) * 8));
+    }
+    put8(o, 0);
+
+    stub_t *stub = add_stub(tr, STUB_STORE, jcc(o, CC_E));
+    stub->back = o->p;
+    stub->dynamic = dynamic;
+    stub->address = address;
+}
+
+typedef struct
+{
+    enum { AT_IMMEDIATE, AT_STATIC, AT_DYNAMIC } kind;
+    u16 value; // Immediate or static address
+} operand_t;
+
+static rm_t operand_rm(operand_t at)
+{
+    return at.kind == AT_STATIC ? M(RBX, MEM + at.value) : MX(RBX, RAX, 0, MEM);
+}
+
+// Work out the operand of the current instruction, checking the pages the
+// native access needs. Dynamic addresses end up in eax. Page crossing
+// cycles are counted last, once nothing can leave for the interpreter
+static operand_t operand(translation_t *tr, bool load, bool store)
+{
+    const cpu_t *cpu = tr->cpu;
+    const insn_t *in = tr->insn;
+    const opcode_t *op = &opcodes[in->opcode];
+    out_t *o = &tr->out;
+    u16 value = in->operand;
+
+    switch (op->addr_mode)
+    {
+    case IMM:
+        return (operand_t){AT_IMMEDIATE, value};
+    case ZP:
+        return (operand_t){AT_STATIC, value};
+    case ZPX:
+    case ZPY:
+        encode(o, 0, 0x8D, RAX, M(op->addr_mode == ZPX ? REG_X : REG_Y, value));
+        movzx8(o, RAX, R(RAX));
+        return (operand_t){AT_DYNAMIC, 0};
+    case ABS:
+        if (store)
+            store_check(tr, false, value);
+        return (operand_t){AT_STATIC, value};
+    case ABX:
+    case ABY:
+    {
+        int index = op->addr_mode == ABX ? REG_X : REG_Y;
+        unsigned page = value >> 8;
+
+        encode(o, 0, 0x8D, RAX, M(index, value));
+        encode(o, 0, 0x0FB7, RAX, R(RAX));
+
+        if (store)
+            store_check(tr, true, 0);
+        else if (load && !(cpu->mem.read[page] && cpu->mem.read[(page + 1) & 0xFF]))
+            read_check(tr);
+
+        // Crosses when the low byte plus the index carries
+        if (op->xpage && (value & 0xFF))
+        {
+            alu_i(o, 0, OP_CMP, R(index), 0x100 - (value & 0xFF));
+            alu_i(o, W, OP_SBB, R(CYCLES), -1);
+        }
+        return (operand_t){AT_DYNAMIC, 0};
+    }
+    case IDX:
+        encode(o, 0, 0x8D, RAX, M(REG_X, value));
+        movzx8(o, RAX, R(RAX));
+        movzx8(o, RDX, MX(RBX, RAX, 0, MEM));
+        step8(o, RAX, false);
+        movzx8(o, RAX, MX(RBX, RAX, 0, MEM));
+        shift_i(o, SH_SHL, RAX, 8);
+        alu_r(o, 0, OP_OR, R(RAX), RDX);
+
+        if (store)
+            store_check(tr, true, 0);
+        else if (load)
+            read_check(tr);
+        return (operand_t){AT_DYNAMIC, 0};
+    case IDY:
+        if (value != 0xFF)
+        {
+            encode(o, 0, 0x0FB7, RAX, M(RBX, MEM + value));
+        }
+        else
+        {
+            movzx8(o, RAX, M(RBX, MEM + 0xFF));
+            movzx8(o, RDX, M(RBX, MEM));
+            shift_i(o, SH_SHL, RDX, 8);
+            alu_r(o, 0, OP_OR, R(RAX), RDX);
+        }
+        if (op->xpage)
+            mov_rr(o, R11, RAX);
+        alu_r(o, 0, OP_ADD, R(RAX), REG_Y);
+        encode(o, 0, 0x0FB7, RAX, R(RAX));
+
+        if (store)
+            store_check(tr, true, 0);
+        else if (load)
+            read_check(tr);
+
+        // Crosses when base and address differ above the low byte
+        if (op->xpage)
+        {
+            alu_r(o, 0, OP_XOR, R(R11), RAX);
+            alu_i(o, 0, OP_CMP, R(R11), 0x100);
+            alu_i(o, W, OP_SBB, R(CYCLES), -1);
+        }
+        return (operand_t){AT_DYNAMIC, 0};
+    default:
+        return (operand_t){AT_IMMEDIATE, 0};
+    }
+}
+
+// edx = the operand's value
+static void load(out_t *o, operand_t at)
+{
+    if (at.kind == AT_IMMEDIATE)
+        mov_ri(o, RDX, at.value);
+    else
+        movzx8(o, RDX, operand_rm(at));
+}
+
+// C = host flag cc
+static void set_carry(out_t *o, int cc)
+{
+    setcc(o, cc, R11);
+    movzx8(o, R11, R(R11));
+    alu_i(o, 0, OP_AND, R(REG_P), ~CARRY_FLAG);
+    alu_r(o, 0, OP_OR, R(REG_P), R11);
+}
+
+static int register_of(kind_t kind)
+{
+    switch (kind)
+    {
+    case K_LDX: case K_STX: case K_CPX: case K_INX: case K_DEX: case K_TXA:
+        return REG_X;
+    case K_LDY: case K_STY: case K_CPY: case K_INY: case K_DEY: case K_TYA:
+        return REG_Y;
+    default:
+        return REG_A;
+    }
+}
+
+// Flag masks: branch taken when (reg & mask) is nonzero, or zero
+static const struct
+{
+    int reg;
+    u32 mask;
+    int taken;
+} conditions[] = {
+    [K_BCC - K_BCC] = {REG_P, CARRY_FLAG, CC_E},     [K_BCS - K_BCC] = {REG_P, CARRY_FLAG, CC_NE},
+    [K_BEQ - K_BCC] = {REG_NZ, 0xFF, CC_E},          [K_BNE - K_BCC] = {REG_NZ, 0xFF, CC_NE},
+    [K_BMI - K_BCC] = {REG_NZ, 0x8000, CC_NE},       [K_BPL - K_BCC] = {REG_NZ, 0x8000, CC_E},
+    [K_BVC - K_BCC] = {REG_P, OVERFLOW_FLAG, CC_E},  [K_BVS - K_BCC] = {REG_P, OVERFLOW_FLAG, CC_NE},
+};
+
+// Goes to an instruction of the block, or leaves at target, once the
+// cycles and instructions up to there are counted
+static void jump(translation_t *tr, u8 *from, u32 cycles, u32 count)
+{
+    const insn_t *in = tr->insn;
+
+    if (in->inside >= 0)
+    {
+        stub_t *stub = add_stub(tr, STUB_JUMP, from);
+        stub->inside = in->inside;
+        stub->backward = tr->insns[in->inside].pc <= in->pc;
+        stub->pc = in->target;
+        stub->cycles = cycles;
+        stub->count = count;
+    }
+    else
+    {
+        stub_t *stub = add_stub(tr, STUB_EXIT, from);
+        stub->pc = in->target;
+        stub->cycles = cycles;
+        stub->count = count;
+    }
+}
+
+static void translate_insn(translation_t *tr, const u8 *exit)
+{
+    const insn_t *in = tr->insn;
+    const opcode_t *op = &opcodes[in->opcode];
+    out_t *o = &tr->out;
+    int reg = register_of(in->kind);
+    operand_t at;
+
+    switch (in->kind)
+    {
+    case K_LDA:
+    case K_LDX:
+    case K_LDY:
+        load(o, operand(tr, true, false));
+        mov_rr(o, reg, RDX);
+        set_nz(o, RDX);
+        break;
+
+    case K_STA:
+    case K_STX:
+    case K_STY:
+        at = operand(tr, false, true);
+        store8(o, operand_rm(at), reg);
+        break;
+
+    // Binary mode only: the decimal tables stay with the interpreter.
+    // SBC is A + ~M + C, which is the host's A - M - !C with the carry
+    // inverted; V is the host's overflow either way
+    case K_ADC:
+    case K_SBC:
+        test_i(o, REG_P, DECIMAL_FLAG);
+        exit_if(tr, CC_NE);
+        load(o, operand(tr, true, false));
+        carry_in(o);
+        if (in->kind == K_SBC)
+            put8(o, 0xF5); // cmc
+        alu_r(o, B8, in->kind == K_ADC ? OP_ADC : OP_SBB, R(REG_A), RDX);
+        setcc(o, CC_O, RDX);
+        set_carry(o, in->kind == K_ADC ? CC_B : CC_AE);
+        alu_i(o, 0, OP_AND, R(REG_P), ~OVERFLOW_FLAG);
+        movzx8(o, RDX, R(RDX));
+        shift_i(o, SH_SHL, RDX, 6);
+        alu_r(o, 0, OP_OR, R(REG_P), RDX);
+        set_nz(o, REG_A);
+        break;
+
+    case K_AND:
+    case K_ORA:
+    case K_EOR:
+        load(o, operand(tr, true, false));
+        alu_r(o, B8, in->kind == K_AND ? OP_AND : in->kind == K_ORA ? OP_OR : OP_XOR, R(REG_A), RDX);
+        set_nz(o, REG_A);
+        break;
+
+    case K_CMP:
+    case K_CPX:
+    case K_CPY:
+        load(o, operand(tr, true, false));
+        mov_rr(o, RAX, reg);
+        alu_r(o, B8, OP_SUB, R(RAX), RDX);
+        set_carry(o, CC_AE);
+        set_nz(o, RAX);
+        break;
+
+    // Z from A AND M, N and V from bits 7 and 6 of M
+    case K_BIT:
+        load(o, operand(tr, true, false));
+        alu_i(o, 0, OP_AND, R(REG_P), ~OVERFLOW_FLAG);
+        mov_rr(o, RAX, RDX);
+        alu_i(o, 0, OP_AND, R(RAX), OVERFLOW_FLAG);
+        alu_r(o, 0, OP_OR, R(REG_P), RAX);
+        mov_rr(o, RAX, RDX);
+        alu_r(o, 0, OP_AND, R(RAX), REG_A);
+        shift_i(o, SH_SHL, RDX, 8);
+        alu_r(o, 0, OP_OR, R(RAX), RDX);
+        mov_rr(o, REG_NZ, RAX);
+        break;
+
+    case K_INC:
+    case K_DEC:
+        at = operand(tr, true, true);
+        load(o, at);
+        step8(o, RDX, in->kind == K_DEC);
+        store8(o, operand_rm(at), RDX);
+        set_nz(o, RDX);
+        break;
+
+    case K_ASL:
+    case K_LSR:
+    case K_ROL:
+    case K_ROR:
+        at = operand(tr, true, true);
+        load(o, at);
+        if (in->kind == K_ROL || in->kind == K_ROR)
+            carry_in(o);
+        encode(o, B8, 0xD0, in->kind == K_ASL ? SH_SHL : in->kind == K_LSR ? SH_SHR : in->kind == K_ROL ? SH_RCL : SH_RCR,
+               R(RDX));
+        set_carry(o, CC_B);
+        store8(o, operand_rm(at), RDX);
+        set_nz(o, RDX);
+        break;
+
+    case K_ASL_A:
+    case K_LSR_A:
+    case K_ROL_A:
+    case K_ROR_A:
+        if (in->kind == K_ROL_A || in->kind == K_ROR_A)
+            carry_in(o);
+        encode(o, B8, 0xD0,
+               in->kind == K_ASL_A ? SH_SHL : in->kind == K_LSR_A ? SH_SHR : in->kind == K_ROL_A ? SH_RCL : SH_RCR,
+               R(REG_A));
+        set_carry(o, CC_B);
+        set_nz(o, REG_A);
+        break;
+
+    case K_INX:
+    case K_INY:
+    case K_DEX:
+    case K_DEY:
+        step8(o, reg, in->kind == K_DEX || in->kind == K_DEY);
+        set_nz(o, reg);
+        break;
+
+    case K_TAX:
+        mov_rr(o, REG_X, REG_A);
+        set_nz(o, REG_X);
+        break;
+    case K_TAY:
+        mov_rr(o, REG_Y, REG_A);
+        set_nz(o, REG_Y);
+        break;
+    case K_TXA:
+    case K_TYA:
+        mov_rr(o, REG_A, reg);
+        set_nz(o, REG_A);
+        break;
+    case K_TSX:
+        mov_rr(o, REG_X, REG_S);
+        set_nz(o, REG_X);
+        break;
+    case K_TXS:
+        mov_rr(o, REG_S, REG_X);
+        break;
+
+    case K_PHA:
+        store8(o, MX(RBX, REG_S, 0, STACK), REG_A);
+        step8(o, REG_S, true);
+        break;
+
+    // cpu_status with B set: P | B | bit 5, Z and N worked out of nz
+    case K_PHP:
+        mov_rr(o, RAX, REG_P);
+        alu_i(o, 0, OP_OR, R(RAX), BREAK_FLAG | 0x20);
+        test_i(o, REG_NZ, 0xFF);
+        setcc(o, CC_E, R11);
+        movzx8(o, R11, R(R11));
+        shift_i(o, SH_SHL, R11, 1);
+        alu_r(o, 0, OP_OR, R(RAX), R11);
+        mov_rr(o, RDX, REG_NZ);
+        shift_i(o, SH_SHR, RDX, 8);
+        alu_i(o, 0, OP_AND, R(RDX), NEGATIVE_FLAG);
+        alu_r(o, 0, OP_OR, R(RAX), RDX);
+        store8(o, MX(RBX, REG_S, 0, STACK), RAX);
+        step8(o, REG_S, true);
+        break;
+
+    case K_PLA:
+        step8(o, REG_S, false);
+        movzx8(o, REG_A, MX(RBX, REG_S, 0, STACK));
+        set_nz(o, REG_A);
+        break;
+
+    case K_CLC:
+        alu_i(o, 0, OP_AND, R(REG_P), ~CARRY_FLAG);
+        break;
+    case K_SEC:
+        alu_i(o, 0, OP_OR, R(REG_P), CARRY_FLAG);
+        break;
+    case K_CLD:
+        alu_i(o, 0, OP_AND, R(REG_P), ~DECIMAL_FLAG);
+        break;
+    case K_SED:
+        alu_i(o, 0, OP_OR, R(REG_P), DECIMAL_FLAG);
+        break;
+    case K_CLV:
+        alu_i(o, 0, OP_AND, R(REG_P), ~OVERFLOW_FLAG);
+        break;
+    case K_NOP:
+        break;
+
+    case K_BCC:
+    case K_BCS:
+    case K_BEQ:
+    case K_BNE:
+    case K_BMI:
+    case K_BPL:
+    case K_BVC:
+    case K_BVS:
+    {
+        u16 next = in->pc + 2;
+        u32 taken = (next ^ in->target) & 0xFF00 ? 2 : 1;
+
+        test_i(o, conditions[in->kind - K_BCC].reg, conditions[in->kind - K_BCC].mask);
+        jump(tr, jcc(o, conditions[in->kind - K_BCC].taken), tr->cycles + op->cycles + taken, tr->done + 1);
+        break;
+    }
+
+    case K_JMP:
+        if (in->inside >= 0)
+            jump(tr, jmp(o), tr->cycles + op->cycles, tr->done + 1);
+        else
+            leave(tr, exit, false, in->target, tr->cycles + op->cycles, tr->done + 1);
+        break;
+
+    case K_JSR:
+        encode(o, 0, 0xC6, 0, MX(RBX, REG_S, 0, STACK));
+        put8(o, (u16)(in->pc + 2) >> 8);
+        step8(o, REG_S, true);
+        encode(o, 0, 0xC6, 0, MX(RBX, REG_S, 0, STACK));
+        put8(o, (in->pc + 2) & 0xFF);
+        step8(o, REG_S, true);
+        leave(tr, exit, false, in->target, tr->cycles + op->cycles, tr->done + 1);
+        break;
+
+    case K_RTS:
+        step8(o, REG_S, false);
+        movzx8(o, RAX, MX(RBX, REG_S, 0, STACK));
+        step8(o, REG_S, false);
+        movzx8(o, RDX, MX(RBX, REG_S, 0, STACK));
+        shift_i(o, SH_SHL, RDX, 8);
+        alu_r(o, 0, OP_OR, R(RAX), RDX);
+        alu_i(o, 0, OP_ADD, R(RAX), 1);
+        encode(o, 0, 0x0FB7, RAX, R(RAX));
+        leave(tr, exit, true, 0, tr->cycles + op->cycles, tr->done + 1);
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void translate_stub(translation_t *tr, const stub_t *stub, const u8 *exit)
+{
+    out_t *o = &tr->out;
+    u8 *leave_at[4];
+    int leaves = 0;
+
+    patch(stub->from, o->p);
+
+    switch (stub->kind)
+    {
+    case STUB_EXIT:
+        break;
+
+    // Fine as long as the page is RAM and the byte isn't translated code
+    case STUB_STORE:
+        if (stub->dynamic)
+        {
+            encode(o, W, 0x83, OP_CMP, MX(RBX, R10, 3, OFF(mem.base_write)));
+            put8(o, 0);
+            leave_at[leaves++] = jcc(o, CC_E);
+            encode(o, W, 0x83, OP_CMP, MX(RBX, R10, 3, OFF(mem.device)));
+            put8(o, 0);
+            leave_at[leaves++] = jcc(o, CC_NE);
+        }
+        encode(o, W, 0x8B, RDX, M(RBX, OFF(jit)));
+        if (stub->dynamic)
+            encode(o, 0, 0x80, OP_CMP, MX(RDX, RAX, 0, (int32_t)offsetof(jit_t, cover)));
+        else
+            encode(o, 0, 0x80, OP_CMP, M(RDX, (int32_t)offsetof(jit_t, cover) + stub->address));
+        put8(o, 0);
+        leave_at[leaves++] = jcc(o, CC_NE);
+        jmp_to(o, stub->back);
+        break;
+
+    // Another pass has to fit in the budgets, or the interpreter takes
+    // over at the target
+    case STUB_JUMP:
+        add_count(o, CYCLES, stub->cycles);
+        add_count(o, COUNT, stub->count);
+        if (stub->backward)
+        {
+            encode(o, W, 0x8D, RAX, M(CYCLES, tr->pass_cycles));
+            encode(o, W, 0x39, R8, R(RAX));
+            leave_at[leaves++] = jcc(o, CC_AE);
+            encode(o, W, 0x8D, RAX, M(COUNT, tr->count));
+            encode(o, W, 0x39, R9, R(RAX));
+            leave_at[leaves++] = jcc(o, CC_A);
+        }
+        jmp_to(o, tr->insns[stub->inside].code);
+        for (int i = 0; i < leaves; i++)
+            patch(leave_at[i], o->p);
+        leave(tr, exit, false, stub->pc, 0, 0);
+        return;
+    }
+
+    for (int i = 0; i < leaves; i++)
+        patch(leave_at[i], o->p);
+    leave(tr, exit, false, stub->pc, stub->cycles, stub->count);
+}
+
+jit_status_t jit_translate(cpu_t *cpu, u16 pc, jit_block_t *block)
+{
+    jit_t *jit = cpu->jit;
+    translation_t *tr = calloc(1, sizeof(translation_t));
+
+    if (tr == NULL)
+        return JIT_UNSUPPORTED;
+
+    tr->cpu = cpu;
+    tr->count = identity_mapped(cpu) ? decode(tr, pc) : 0;
+
+    if (tr->count == 0)
+    {
+        free(tr);
+        return JIT_UNSUPPORTED;
+    }
+
+    for (u32 i = 0; i < tr->count; i++)
+        tr->pass_cycles += max_cycles(&tr->insns[i]);
+
+    u8 *start = jit->code + jit->code_used;
+    tr->out = (out_t){start, jit->code + JIT_CODE_SIZE, false};
+
+    const insn_t *last = &tr->insns[tr->count - 1];
+    bool falls_through = last->kind != K_JMP && last->kind != K_JSR && last->kind != K_RTS;
+
+    for (u32 i = 0; i < tr->count; i++)
+    {
+        insn_t *in = &tr->insns[i];
+
+        // Jumped to with everything counted
+        if (in->label)
+            flush(tr);
+        in->code = tr->out.p;
+
+        tr->insn = in;
+        translate_insn(tr, jit->exit);
+        tr->cycles += opcodes[in->opcode].cycles;
+        tr->done++;
+    }
+
+    if (falls_through)
+        leave(tr, jit->exit, false, last->pc + last->length, tr->cycles, tr->done);
+
+    for (u32 i = 0; i < tr->stub_count; i++)
+    {
+        tr->insn = NULL;
+        translate_stub(tr, &tr->stubs[i], jit->exit);
+    }
+
+    bool full = tr->out.full;
+    size_t size = tr->out.p - start;
+
+    block->code = start;
+    block->start = pc;
+    block->length = last->pc + last->length - pc;
+    block->cycles = tr->pass_cycles;
+    block->instructions = tr->count;
+    free(tr);
+
+    if (full)
+        return JIT_FULL;
+
+    jit->code_used += (size + 15) & ~(size_t)15;
+    return JIT_OK;
+}
+
+// u64 enter(cpu, cycles, instructions, code): load the registers and jump
+// into the block. The exit right after it stores them back, PC from eax
+bool jit_emit_entry(jit_t *jit)
+{
+    static const int saved[] = {RBX, RBP, R12, R13, R14, R15};
+    static const struct
+    {
+        int reg;
+        int32_t offset;
+    } registers[] = {
+        {REG_A, OFF(A)}, {REG_X, OFF(X)}, {REG_Y, OFF(Y)}, {REG_S, OFF(SP)}, {REG_P, OFF(P)},
+    };
+    out_t out = {jit->code, jit->code + JIT_CODE_SIZE, false};
+    out_t *o = &out;
+
+    for (int i = 0; i < 6; i++)
+    {
+        if (saved[i] & 8)
+            put8(o, 0x41);
+        put8(o, 0x50 + (saved[i] & 7));
+    }
+
+    encode(o, W, 0x89, RDI, R(RBX));
+    encode(o, W, 0x89, RSI, R(R8));
+    encode(o, W, 0x89, RDX, R(R9));
+    encode(o, W, 0x89, RCX, R(RAX));
+    for (int i = 0; i < 5; i++)
+        movzx8(o, registers[i].reg, M(RBX, registers[i].offset));
+    encode(o, 0, 0x0FB7, REG_NZ, M(RBX, OFF(nz)));
+    alu_r(o, 0, OP_XOR, R(CYCLES), CYCLES);
+    alu_r(o, 0, OP_XOR, R(COUNT), COUNT);
+    encode(o, 0, 0xFF, 4, R(RAX)); // jmp rax
+
+    while ((o->p - jit->code) & 15)
+        put8(o, 0xCC);
+    jit->exit = o->p;
+
+    encode(o, O16, 0x89, RAX, M(RBX, OFF(PC)));
+    for (int i = 0; i < 5; i++)
+        store8(o, M(RBX, registers[i].offset), registers[i].reg);
+    encode(o, O16, 0x89, REG_NZ, M(RBX, OFF(nz)));
+    encode(o, W, 0x01, CYCLES, M(RBX, OFF(global_cycles)));
+    encode(o, W, 0x89, COUNT, R(RAX));
+
+    for (int i = 5; i >= 0; i--)
+    {
+        if (saved[i] & 8)
+            put8(o, 0x41);
+        put8(o, 0x58 + (saved[i] & 7));
+    }
+    put8(o, 0xC3);
+
+    while ((o->p - jit->code) & 15)
+        put8(o, 0xCC);
+
+    jit->enter = (jit_entry_t)(void *)jit->code;
+    jit->code_base = o->p - jit->code;
+    return !o->full;
+}
+
+#else
+
+// Other hosts: no code generator, jit_create fails
+bool jit_emit_entry(jit_t *jit)
+{
+    (void)jit;
+    return false;
+}
+
+jit_status_t jit_translate(cpu_t *cpu, u16 pc, jit_block_t *block)
+{
+    (void)cpu;
+    (void)pc;
+    (void)block;
+    return JIT_UNSUPPORTED;
+}
+
+#endif
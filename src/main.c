@@ -1,52 +1,624 @@
 #include "cpu/cpu.h"
 #include "cpu/instruction.h"
+#include "cpu/sched.h"
+#include "hle/applesoft.h"
+#include "hle/console.h"
+#include "mem/loader.h"
+#include "mem/rom.h"
+#include "run/headless.h"
+#include "state/snapshot.h"
+#include "ui/terminal.h"
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [options] [program start_addr]\n", prog);
+    fprintf(stderr, "  -l image    Load a program image: [raw:|woz:|ihex:|prg:]file[@addr], repeatable\n");
+    fprintf(stderr, "  -g addr     Start running at addr (hex) instead of the reset vector\n");
+    fprintf(stderr, "  -r name=file Replace a built-in ROM (wozmon, a1basic, ...) with a file\n");
+    fprintf(stderr, "  -s speed    Clock multiple of the 1.023 MHz Apple-1 (default 1, 0 = unthrottled)\n");
+    fprintf(stderr, "  -M kb       RAM configuration: 4, 8, 32, 48 or 64 (default 64)\n");
+    fprintf(stderr, "  -B          Boot Applesoft instead of Wozmon (needs -M 32 or more)\n");
+    fprintf(stderr, "  -E          Run supported ROM routines natively (character I/O, Applesoft FP)\n");
+    fprintf(stderr, "  -J          Translate hot 6502 code to x86-64 machine code\n");
+    fprintf(stderr, "  -D          Cache decoded instructions by address (not with -J)\n");
+    fprintf(stderr, "  -T          Trap undocumented opcodes instead of emulating them\n");
+    fprintf(stderr, "  -R          Model the real Apple-1 display rate (~60 chars/sec)\n");
+    fprintf(stderr, "  -P file     Profile execution, write the report to file on exit and on F4 ('-' = stderr)\n");
+    fprintf(stderr, "  -S file     Symbol file used to annotate the profile\n");
+    fprintf(stderr, "  -t file     Record a binary execution trace (decode with bin/tracedump)\n");
+    fprintf(stderr, "  -F spec     Trace filter: pc=LO-HI,start=PC,stop=PC,after=CYCLES,limit=N,size=N\n");
+    fprintf(stderr, "  -a tape     Insert a cassette for the ACI (WAV or A1TAPE file)\n");
+    fprintf(stderr, "  -A tape     Record the ACI output, saved on exit (.wav or A1TAPE)\n");
+    fprintf(stderr, "  -X          Play tapes in real time instead of fast-loading them\n");
+    fprintf(stderr, "  -L file     Start from a saved machine state\n");
+    fprintf(stderr, "  -W file     Save the machine state to file on exit and on F5\n");
+    fprintf(stderr, "  -k file     Record keys, resets and idle time with their cycle to an input log\n");
+    fprintf(stderr, "  -K file     Replay an input log headless and check the final state (implies -H)\n");
+    fprintf(stderr, "  -H          Headless: no terminal UI, unthrottled, display output to stdout\n");
+    fprintf(stderr, "  -i file     Headless keyboard input (default stdin, '-' for stdin, implies -H)\n");
+    fprintf(stderr, "  -C cycles   Headless: stop after this many cycles\n");
+    fprintf(stderr, "  -n count    Headless: stop after this many instructions\n");
+    fprintf(stderr, "  -p addr     Headless: stop when PC reaches addr (hex)\n");
+    fprintf(stderr, "  -m text     Headless: stop once text has been printed\n");
+}
+
+#define MAX_IMAGES 16
+
+static bool parse_number(const char *str, int base, u64 max, u64 *out)
+{
+    char *end;
+    errno = 0;
+
+    unsigned long long parsed = strtoull(str, &end, base);
+
+    if (errno != 0 || *end != '\0' || end == str || parsed > max)
+    {
+        fprintf(stderr, "Invalid value: %s\n", str);
+        return false;
+    }
+
+    *out = parsed;
+    return true;
+}
+
+// [format:]path[@addr]
+static bool load_image(cpu_t *cpu, const char *spec, load_result_t *result)
+{
+    load_format_t format = LOAD_AUTO;
+    int address = LOADER_NO_ADDRESS;
+    char path[512];
+    char error[256];
+
+    const char *colon = strchr(spec, ':');
+    if (colon && colon - spec < 8)
+    {
+        char name[8];
+        snprintf(name, sizeof(name), "%.*s", (int)(colon - spec), spec);
+        if (loader_parse_format(name, &format))
+            spec = colon + 1;
+    }
+
+    snprintf(path, sizeof(path), "%s", spec);
+
+    char *at = strrchr(path, '@');
+    if (at)
+    {
+        u64 value;
+        *at = '\0';
+        if (!parse_number(at + 1, 16, UINT16_MAX, &value))
+            return false;
+        address = (int)value;
+    }
+
+    if (!loader_load(&cpu->mem, path, format, address, result, error, sizeof(error)))
+    {
+        fprintf(stderr, "Could not load %s\n", error);
+        return false;
+    }
+
+    fprintf(stderr, "Loaded %s (%s): %u bytes in %u segment%s, $%04X-$%04X\n", path,
+            loader_format_name(result->format), result->bytes, result->segments,
+            result->segments == 1 ? "" : "s", result->low, result->high);
+    return true;
+}
 
 int main(int argc, char *argv[])
 {
+    double speed = 1.0;
+    bool headless = false;
+    bool realtime_display = false;
+    bool trap_illegal = false;
+    bool applesoft = false;
+    bool native = false;
+    bool translate = false;
+    bool predecode = false;
+    u64 ram_kb = 64;
+    const char *input_path = NULL;
+    const char *profile_path = NULL;
+    const char *symbol_path = NULL;
+    const char *trace_path = NULL;
+    trace_config_t trace_config;
+    const char *load_state_path = NULL;
+    const char *save_state_path = NULL;
+    const char *tape_path = NULL;
+    const char *record_path = NULL;
+    const char *input_log_path = NULL;
+    const char *replay_path = NULL;
+    replay_t *replay = NULL;
+    bool fast_load = true;
+    char error[160];
+    const char *images[MAX_IMAGES];
+    int image_count = 0;
+    bool start_set = false;
+    u16 start_pc = 0;
+    headless_opts_t hl_opts = {0};
+    u64 value;
+    int opt;
+
+    trace_config_init(&trace_config);
+
+    while ((opt = getopt(argc, argv, "l:g:r:s:M:BEJDTRP:S:t:F:a:A:XL:W:k:K:Hi:C:n:p:m:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'l':
+            if (image_count == MAX_IMAGES) {
+                fprintf(stderr, "Too many images, at most %d\n", MAX_IMAGES);
+                return 1;
+            }
+            images[image_count++] = optarg;
+            break;
+        case 'g':
+            if (!parse_number(optarg, 16, UINT16_MAX, &value))
+                return 1;
+            start_set = true;
+            start_pc = (u16)value;
+            break;
+        case 'r':
+        {
+            char name[32];
+            const char *eq = strchr(optarg, '=');
+
+            if (eq == NULL || eq == optarg || eq - optarg >= (int)sizeof(name)) {
+                fprintf(stderr, "Invalid ROM override, expected name=file: %s\n", optarg);
+                return 1;
+            }
+            snprintf(name, sizeof(name), "%.*s", (int)(eq - optarg), optarg);
+
+            if (!rom_override(name, eq + 1, error, sizeof(error))) {
+                fprintf(stderr, "Could not replace ROM: %s\n", error);
+                return 1;
+            }
+            break;
+        }
+        case 's':
+        {
+            char *end;
+            speed = strtod(optarg, &end);
+            if (*end != '\0' || speed < 0) {
+                fprintf(stderr, "Invalid speed: %s\n", optarg);
+                return 1;
+            }
+            break;
+        }
+        case 'M':
+            if (!parse_number(optarg, 10, 64, &ram_kb))
+                return 1;
+            break;
+        case 'B':
+            applesoft = true;
+            break;
+        case 'E':
+            native = true;
+            break;
+        case 'J':
+            translate = true;
+            break;
+        case 'D':
+            predecode = true;
+            break;
+        case 'T':
+            trap_illegal = true;
+            break;
+        case 'R':
+            realtime_display = true;
+            break;
+        case 'P':
+            profile_path = optarg;
+            break;
+        case 'S':
+            symbol_path = optarg;
+            break;
+        case 't':
+            trace_path = optarg;
+            break;
+        case 'F':
+            if (!trace_config_parse(&trace_config, optarg))
+                return 1;
+            break;
+        case 'a':
+            tape_path = optarg;
+            break;
+        case 'A':
+            record_path = optarg;
+            break;
+        case 'X':
+            fast_load = false;
+            break;
+        case 'L':
+            load_state_path = optarg;
+            break;
+        case 'W':
+            save_state_path = optarg;
+            break;
+        case 'k':
+            input_log_path = optarg;
+            break;
+        case 'K':
+            replay_path = optarg;
+            headless = true;
+            break;
+        case 'H':
+            headless = true;
+            break;
+        case 'i':
+            input_path = optarg;
+            headless = true;
+            break;
+        case 'C':
+            if (!parse_number(optarg, 10, UINT64_MAX, &hl_opts.max_cycles))
+                return 1;
+            break;
+        case 'n':
+            if (!parse_number(optarg, 10, UINT64_MAX, &hl_opts.max_instructions))
+                return 1;
+            break;
+        case 'p':
+            if (!parse_number(optarg, 16, UINT16_MAX, &value))
+                return 1;
+            hl_opts.stop_on_pc = true;
+            hl_opts.stop_pc = (u16)value;
+            break;
+        case 'm':
+            if (strlen(optarg) == 0 || strlen(optarg) > HEADLESS_MAX_PATTERN) {
+                fprintf(stderr, "Invalid output pattern: %s\n", optarg);
+                return 1;
+            }
+            hl_opts.stop_output = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? EXIT_SUCCESS : 1;
+        }
+    }
+
+    // The log is the keyboard of a replay, and recording is for typed sessions
+    if (replay_path && input_path) {
+        fprintf(stderr, "-K and -i can't be combined\n");
+        return 1;
+    }
+    if (input_log_path && headless) {
+        fprintf(stderr, "-k records the terminal UI, headless runs are already repeatable\n");
+        return 1;
+    }
+
+    if (replay_path) {
+        replay = replay_open(replay_path, error, sizeof(error));
+        if (replay == NULL) {
+            fprintf(stderr, "Could not open input log %s\n", error);
+            return 1;
+        }
+    }
+
     // Initialize CPU
     cpu_t cpu;
     cpu_init(&cpu);
 
+    if (!cpu_map_memory(&cpu, (u32)ram_kb)) {
+        fprintf(stderr, "Unsupported RAM size: %lluK\n", (unsigned long long)ram_kb);
+        return 1;
+    }
+    cpu.display.realtime = realtime_display;
+    cpu.emulate_illegal = !trap_illegal;
+
     // Init WOZMON/Basic
     if (!init_software(&cpu)) {
         fprintf(stderr, "There was an error loading the Apple II Rom\n");
         cpu.running = false;
     }
 
-    // Load User Program, if it exists
-    if (argc == 3) {
-        char *end;
-        errno = 0;
+    if (applesoft && !init_applesoft(&cpu))
+        return 1;
 
-        unsigned long parsed = strtoul(argv[2], &end, 16);
+    // Translated code stores without the write watch the cache relies on
+    if (predecode && translate) {
+        fprintf(stderr, "-D and -J can't be combined\n");
+        return 1;
+    }
 
-        if (errno != 0 || *end != '\0' || parsed > UINT16_MAX) {
-            fprintf(stderr, "Invalid value: %s\n", argv[2]);
+    // Hooks check the code they replace against what is loaded now
+    if (native) {
+        cpu.hle = hle_create();
+        if (cpu.hle == NULL || !console_hle_install(&cpu) ||
+            (applesoft && !applesoft_hle_install(&cpu))) {
+            fprintf(stderr, "Could not set up native routines\n");
             return 1;
         }
+    }
 
-        u16 start_addr = (u16)parsed;
+    if (translate) {
+        cpu.jit = jit_create();
+        if (cpu.jit == NULL) {
+            fprintf(stderr, "Could not set up the JIT (needs an x86-64 host)\n");
+            return 1;
+        }
+    }
 
-        if (load_program(&cpu, argv[1], start_addr) != 0) {
+    if (predecode) {
+        cpu.decode = decode_create();
+        if (cpu.decode == NULL) {
+            fprintf(stderr, "Could not set up the instruction cache\n");
+            return 1;
+        }
+    }
+
+    cpu.aci.fast_load = fast_load;
+    cpu.aci.record = record_path != NULL;
+
+    if (tape_path && !aci_insert(&cpu.aci, tape_path, error, sizeof(error))) {
+        fprintf(stderr, "Could not load tape %s\n", error);
+        return 1;
+    }
+
+    if (symbol_path && !profile_path) {
+        fprintf(stderr, "-S needs profiling enabled with -P\n");
+        return 1;
+    }
+
+    if (profile_path) {
+        cpu.profile = profile_create();
+        if (cpu.profile == NULL) {
+            fprintf(stderr, "Could not allocate the profiler\n");
+            return 1;
+        }
+        if (symbol_path && !profile_load_symbols(cpu.profile, symbol_path)) {
+            fprintf(stderr, "Could not load symbols: %s\n", symbol_path);
+            return 1;
+        }
+    }
+
+    if (load_state_path && !snapshot_load(&cpu, load_state_path, error, sizeof(error))) {
+        fprintf(stderr, "Could not load state: %s\n", error);
+        return 1;
+    }
+
+    if (trace_path) {
+        cpu.trace = trace_open(trace_path, &trace_config);
+        if (cpu.trace == NULL) {
+            fprintf(stderr, "Could not create trace file: %s\n", trace_path);
+            return 1;
+        }
+    }
+
+    // Load User Program, if it exists
+    if (argc - optind == 2) {
+        if (!parse_number(argv[optind + 1], 16, UINT16_MAX, &value))
+            return 1;
+
+        u16 start_addr = (u16)value;
+
+        if (load_program(&cpu, argv[optind], start_addr) != 0) {
             fprintf(stderr, "Program was not loaded, booting into Wozmon...\n");
         }
     }
 
+    // Images go straight into memory; the last entry point found wins unless -g is given
+    for (int i = 0; i < image_count; i++) {
+        load_result_t result;
+
+        if (!load_image(&cpu, images[i], &result))
+            return 1;
+
+        if (result.has_entry && !start_set)
+            cpu.PC = result.entry;
+    }
+
+    if (start_set)
+        cpu.PC = start_pc;
+
+    // A replay only reproduces the session from the machine it started on
+    if (replay && snapshot_hash(&cpu) != replay->header.start_hash) {
+        fprintf(stderr, "%s was recorded from a different starting state, "
+                        "use the same -M, -B, -l, -g, -L and -a options\n", replay_path);
+        return 1;
+    }
+
+    if (headless) {
+        int status = EXIT_SUCCESS;
+
+        hl_opts.output = stdout;
+        hl_opts.input = replay ? NULL : stdin;
+        hl_opts.replay = replay;
+
+        if (input_path && strcmp(input_path, "-") != 0) {
+            hl_opts.input = fopen(input_path, "rb");
+            if (hl_opts.input == NULL) {
+                fprintf(stderr, "Could not open input: %s\n", input_path);
+                return 1;
+            }
+        }
+
+        headless_result_t result = headless_run(&cpu, &hl_opts);
+
+        if (cpu.halt) {
+            char message[80];
+            cpu_halt_message(&cpu, message, sizeof(message));
+            fprintf(stderr, "\n%s", message);
+        }
+
+        fprintf(stderr, "\nStopped (%s) after %llu instructions, %llu cycles",
+                headless_stop_name(result.reason),
+                (unsigned long long)result.instructions,
+                (unsigned long long)result.cycles);
+        if (result.idle_cycles)
+            fprintf(stderr, " (%llu skipped while idle)", (unsigned long long)result.idle_cycles);
+        fputc('\n', stderr);
+
+        if (replay) {
+            u64 hash = snapshot_hash(&cpu);
+
+            if (!replay->ended) {
+                fprintf(stderr, "Replay: stopped after %llu events, before the end of %s%s\n",
+                        (unsigned long long)replay->events, replay_path,
+                        replay->corrupt ? " (damaged)" : "");
+                status = 1;
+            } else if (hash != replay->end_hash) {
+                fprintf(stderr, "Replay: %llu events, final state differs (hash %016llx, recorded %016llx)\n",
+                        (unsigned long long)replay->events, (unsigned long long)hash,
+                        (unsigned long long)replay->end_hash);
+                status = 1;
+            } else {
+                fprintf(stderr, "Replay: %llu events, final state matches (hash %016llx)\n",
+                        (unsigned long long)replay->events, (unsigned long long)hash);
+            }
+            replay_close(replay);
+        }
+
+        if (hl_opts.input && hl_opts.input != stdin)
+            fclose(hl_opts.input);
+
+        if (cpu.aci.fast_loads)
+            fprintf(stderr, "Tape: %u block%s fast-loaded\n", cpu.aci.fast_loads,
+                    cpu.aci.fast_loads == 1 ? "" : "s");
+
+        if (cpu.interrupt.irqs || cpu.interrupt.nmis)
+            fprintf(stderr, "Interrupts: %llu IRQ, %llu NMI\n",
+                    (unsigned long long)cpu.interrupt.irqs,
+                    (unsigned long long)cpu.interrupt.nmis);
+
+        if (cpu.hle)
+            hle_report(cpu.hle, stderr);
+
+        if (cpu.jit)
+            jit_report(cpu.jit, stderr);
+
+        if (cpu.decode)
+            decode_report(cpu.decode, stderr);
+
+        if (record_path && !aci_save(&cpu.aci, record_path, error, sizeof(error)))
+            fprintf(stderr, "Could not save tape %s\n", error);
+
+        if (save_state_path) {
+            if (snapshot_save(&cpu, save_state_path, error, sizeof(error)))
+                fprintf(stderr, "State saved to %s\n", save_state_path);
+            else
+                fprintf(stderr, "Could not save state: %s\n", error);
+        }
+
+        if (cpu.profile) {
+            if (!profile_write(cpu.profile, profile_path))
+                fprintf(stderr, "Could not write profile: %s\n", profile_path);
+            profile_destroy(cpu.profile);
+        }
+        trace_close(cpu.trace);
+        hle_destroy(cpu.hle);
+        jit_destroy(cpu.jit);
+        decode_destroy(cpu.decode);
+        aci_free(&cpu.aci);
+        return status;
+    }
+
+    // Everything the session does to the machine from here on is logged
+    if (input_log_path) {
+        cpu.recording = recording_start(&cpu, input_log_path, error, sizeof(error));
+        if (cpu.recording == NULL) {
+            fprintf(stderr, "Could not create input log %s\n", error);
+            return 1;
+        }
+    }
+
     // Init Interface
-    initscr();
-    cbreak();
-    noecho();
-    nodelay(stdscr, TRUE); // make getch() non-blocking
-    keypad(stdscr, TRUE);  // handle special keys
-    scrollok(stdscr, TRUE);
-
-    // CPU Clock Cycle
+    terminal_init();
+
+    // CPU Clock: run one time slice, then sync to the host clock
+    sched_t sched;
+    sched_init(&sched, &cpu, speed);
+
+    halt_t shown_halt = HALT_NONE;
+
     while (cpu.running)
     {
-        cpu_cycle(&cpu);
-        poll_keyboard(&cpu);
+        sched_run_slice(&sched, &cpu);
+        terminal_flush(&cpu.display);
+        terminal_poll_keyboard(&cpu);
+
+        if (cpu.profile_dump)
+        {
+            char message[80];
+
+            if (cpu.profile == NULL)
+                snprintf(message, sizeof(message), "Profiling is off, start with -P file");
+            else if (strcmp(profile_path, "-") == 0)
+                snprintf(message, sizeof(message), "Profile goes to stderr on exit");
+            else if (profile_write(cpu.profile, profile_path))
+                snprintf(message, sizeof(message), "Profile written to %s", profile_path);
+            else
+                snprintf(message, sizeof(message), "Could not write profile: %s", profile_path);
+
+            terminal_status(&cpu.display, message);
+            cpu.profile_dump = false;
+        }
+
+        if (cpu.save_state)
+        {
+            char message[80];
+
+            if (save_state_path == NULL)
+                snprintf(message, sizeof(message), "No state file, start with -W file");
+            else if (snapshot_save(&cpu, save_state_path, error, sizeof(error)))
+                snprintf(message, sizeof(message), "State saved to %.60s", save_state_path);
+            else
+                snprintf(message, sizeof(message), "Could not save state: %.50s", error);
+
+            terminal_status(&cpu.display, message);
+            cpu.save_state = false;
+        }
+
+        // Keep the session alive on a halt: report it and wait for F1
+        if (cpu.halt != shown_halt)
+        {
+            char message[80] = "";
+
+            if (cpu.halt) {
+                cpu_halt_message(&cpu, message, sizeof(message));
+                strncat(message, " - F1 to reset", sizeof(message) - strlen(message) - 1);
+            }
+
+            terminal_status(&cpu.display, cpu.halt ? message : NULL);
+            shown_halt = cpu.halt;
+        }
+
+        // Screen is current: sleep until a key if the 6502 is only polling
+        sched_idle(&sched, &cpu, STDIN_FILENO);
+    }
+
+    terminal_end();
+
+    if (cpu.recording) {
+        u64 events = cpu.recording->events;
+
+        if (recording_finish(cpu.recording, &cpu, error, sizeof(error)))
+            fprintf(stderr, "Input log: %llu events written to %s\n",
+                    (unsigned long long)events + 1, input_log_path);
+        else
+            fprintf(stderr, "Could not write input log %s\n", error);
+        cpu.recording = NULL;
     }
 
-    endwin();
+    if (save_state_path && !snapshot_save(&cpu, save_state_path, error, sizeof(error)))
+        fprintf(stderr, "Could not save state: %s\n", error);
+
+    if (record_path && !aci_save(&cpu.aci, record_path, error, sizeof(error)))
+        fprintf(stderr, "Could not save tape %s\n", error);
+
+    fprintf(stderr, "Display: %llu characters, %llu refreshes (%llu saved)\n",
+            (unsigned long long)cpu.display.chars,
+            (unsigned long long)cpu.display.refreshes,
+            (unsigned long long)(cpu.display.chars > cpu.display.refreshes
+                                     ? cpu.display.chars - cpu.display.refreshes : 0));
+
+    fprintf(stderr, "Idle: %.1f s of emulated time spent waiting for keys\n",
+            (double)sched.idle_cycles / APPLE1_CLOCK_HZ);
+
+    if (cpu.profile) {
+        if (!profile_write(cpu.profile, profile_path))
+            fprintf(stderr, "Could not write profile: %s\n", profile_path);
+        profile_destroy(cpu.profile);
+    }
+    trace_close(cpu.trace);
+    hle_destroy(cpu.hle);
+    jit_destroy(cpu.jit);
+    decode_destroy(cpu.decode);
+    aci_free(&cpu.aci);
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -0,0 +1,433 @@
+#include "loader.h"
+
+#include <ctype.h>
+#include <strings.h>
+
+typedef struct
+{
+    memmap_t *map;
+    load_result_t *result;
+    u32 next; // Address following the last byte written
+    char *err;
+    size_t len;
+} loader_t;
+
+static const struct
+{
+    const char *name;
+    load_format_t format;
+} format_names[] = {
+    {"auto", LOAD_AUTO},
+    {"raw", LOAD_RAW},
+    {"woz", LOAD_WOZ},
+    {"ihex", LOAD_IHEX},
+    {"prg", LOAD_PRG},
+};
+
+bool loader_parse_format(const char *name, load_format_t *format)
+{
+    for (size_t i = 0; i < sizeof(format_names) / sizeof(format_names[0]); i++)
+    {
+        if (strcasecmp(name, format_names[i].name) == 0)
+        {
+            *format = format_names[i].format;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *loader_format_name(load_format_t format)
+{
+    for (size_t i = 0; i < sizeof(format_names) / sizeof(format_names[0]); i++)
+    {
+        if (format_names[i].format == format)
+            return format_names[i].name;
+    }
+    return "?";
+}
+
+// Images only go where the CPU sees RAM: not past $FFFF, not into ROM,
+// unmapped pages or a device's registers
+static bool loader_check(loader_t *loader, u32 address, size_t size)
+{
+    const memmap_t *map = loader->map;
+
+    if (address + size > MEMORY_SIZE)
+    {
+        snprintf(loader->err, loader->len, "%zu bytes at $%04X run past $FFFF", size, address);
+        return false;
+    }
+
+    for (u32 at = address; at < address + size; at++)
+    {
+        unsigned page = at >> 8;
+        const mem_device_t *device = map->device[page];
+
+        if (device && at >= device->start && at <= device->end)
+            snprintf(loader->err, loader->len, "$%04X is in the %s registers", at, device->name);
+        else if (map->base_write[page] == NULL && map->base_read[page])
+            snprintf(loader->err, loader->len, "$%04X is ROM (replace ROMs with -r)", at);
+        else if (map->base_write[page] == NULL)
+            snprintf(loader->err, loader->len, "$%04X is not mapped in this RAM configuration", at);
+        else
+            continue;
+        return false;
+    }
+    return true;
+}
+
+// Store one run of bytes through the page table
+static bool loader_write(loader_t *loader, u32 address, const u8 *data, size_t size)
+{
+    load_result_t *result = loader->result;
+
+    if (size == 0)
+        return true;
+
+    if (!loader_check(loader, address, size))
+        return false;
+
+    for (size_t i = 0; i < size; i++)
+        mem_write(loader->map, (u16)(address + i), data[i]);
+
+    if (result->bytes == 0 || address != loader->next)
+        result->segments++;
+
+    if (result->bytes == 0 || address < result->low)
+        result->low = (u16)address;
+    if (result->bytes == 0 || address + size - 1 > result->high)
+        result->high = (u16)(address + size - 1);
+
+    result->bytes += (u32)size;
+    loader->next = address + (u32)size;
+    return true;
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// Parse up to max_digits hex digits, returns the number of digits read
+static int parse_hex(const char **text, int max_digits, u32 *value)
+{
+    int digits = 0;
+    *value = 0;
+
+    while (hex_value(**text) >= 0)
+    {
+        if (++digits > max_digits)
+            return -1;
+        *value = (*value << 4) | hex_value(**text);
+        (*text)++;
+    }
+
+    return digits;
+}
+
+static const char *skip_space(const char *text)
+{
+    while (*text == ' ' || *text == '\t')
+        text++;
+    return text;
+}
+
+// Woz monitor syntax as typed at the '\' prompt:
+//   0280: A9 00 AA     store from $0280
+//   : 20 EF FF         continue after the last byte
+//   0280R              entry point
+// Blank lines and ';' / '#' comments are ignored
+static bool load_woz(loader_t *loader, char *text)
+{
+    u32 address = 0;
+    bool have_address = false;
+    int line_number = 0;
+    char *save;
+
+    for (char *line = strtok_r(text, "\n", &save); line; line = strtok_r(NULL, "\n", &save))
+    {
+        const char *p = skip_space(line);
+        line_number++;
+
+        if (*p == '\0' || *p == '\r' || *p == ';' || *p == '#')
+            continue;
+
+        u32 value;
+        int digits = parse_hex(&p, 4, &value);
+
+        const char *rest = digits > 0 && (*p == 'R' || *p == 'r') ? skip_space(p + 1) : NULL;
+        if (rest && (*rest == '\0' || *rest == '\r'))
+        {
+            loader->result->has_entry = true;
+            loader->result->entry = (u16)value;
+            continue;
+        }
+
+        if (digits > 0)
+        {
+            address = value;
+            have_address = true;
+        }
+
+        p = skip_space(p);
+        if (digits < 0 || *p != ':' || !have_address)
+        {
+            snprintf(loader->err, loader->len, "line %d: expected 'ADDR: XX XX ...'", line_number);
+            return false;
+        }
+        p++;
+
+        u8 bytes[256];
+        size_t count = 0;
+
+        for (p = skip_space(p); *p && *p != '\r' && *p != ';'; p = skip_space(p))
+        {
+            if (parse_hex(&p, 2, &value) <= 0 || count == sizeof(bytes))
+            {
+                snprintf(loader->err, loader->len, "line %d: bad byte value", line_number);
+                return false;
+            }
+            bytes[count++] = (u8)value;
+        }
+
+        if (!loader_write(loader, address, bytes, count))
+            return false;
+        address += (u32)count;
+    }
+
+    return true;
+}
+
+// Intel HEX records 00 (data), 01 (end), 02/04 (extended address, must stay
+// below 64K) and 03/05 (start address, used as the entry point)
+// Data bytes an address or start record has to carry, -1 for any number
+static int ihex_fixed_size(u8 type)
+{
+    switch (type)
+    {
+    case 0x02:
+    case 0x04:
+        return 2;
+    case 0x03:
+    case 0x05:
+        return 4;
+    default:
+        return -1;
+    }
+}
+
+static bool load_ihex(loader_t *loader, char *text)
+{
+    u32 base = 0;
+    int line_number = 0;
+    char *save;
+
+    for (char *line = strtok_r(text, "\n", &save); line; line = strtok_r(NULL, "\n", &save))
+    {
+        const char *p = skip_space(line);
+        line_number++;
+
+        if (*p == '\0' || *p == '\r')
+            continue;
+
+        if (*p++ != ':')
+        {
+            snprintf(loader->err, loader->len, "line %d: record does not start with ':'", line_number);
+            return false;
+        }
+
+        u8 record[5 + 255];
+        size_t count = 0;
+        u32 value;
+
+        while (count < sizeof(record) && hex_value(p[0]) >= 0 && hex_value(p[1]) >= 0)
+        {
+            parse_hex(&p, 2, &value);
+            record[count++] = (u8)value;
+        }
+
+        if (count < 5 || count != 5u + record[0])
+        {
+            snprintf(loader->err, loader->len, "line %d: bad record length", line_number);
+            return false;
+        }
+
+        u8 checksum = 0;
+        for (size_t i = 0; i < count; i++)
+            checksum += record[i];
+
+        if (checksum != 0)
+        {
+            snprintf(loader->err, loader->len, "line %d: checksum mismatch", line_number);
+            return false;
+        }
+
+        u8 size = record[0];
+        u32 offset = (record[1] << 8) | record[2];
+        const u8 *data = record + 4;
+        int fixed = ihex_fixed_size(record[3]);
+
+        if (fixed >= 0 && size != fixed)
+        {
+            snprintf(loader->err, loader->len, "line %d: bad record length", line_number);
+            return false;
+        }
+
+        switch (record[3])
+        {
+        case 0x00:
+            if (!loader_write(loader, base + offset, data, size))
+                return false;
+            break;
+        case 0x01:
+            return true;
+        case 0x02:
+            base = ((data[0] << 8) | data[1]) << 4;
+            break;
+        case 0x04:
+            base = (u32)((data[0] << 8) | data[1]) << 16;
+            break;
+        case 0x03:
+        case 0x05:
+            loader->result->has_entry = true;
+            loader->result->entry = (data[2] << 8) | data[3];
+            break;
+        default:
+            snprintf(loader->err, loader->len, "line %d: unknown record type %02X", line_number, record[3]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static load_format_t guess_format(const char *path, const char *data, size_t size)
+{
+    const char *ext = strrchr(path, '.');
+
+    if (ext)
+    {
+        if (!strcasecmp(ext, ".hex") || !strcasecmp(ext, ".ihx") || !strcasecmp(ext, ".ihex"))
+            return LOAD_IHEX;
+        if (!strcasecmp(ext, ".prg"))
+            return LOAD_PRG;
+        if (!strcasecmp(ext, ".woz") || !strcasecmp(ext, ".mon") || !strcasecmp(ext, ".txt"))
+            return LOAD_WOZ;
+        if (!strcasecmp(ext, ".bin") || !strcasecmp(ext, ".rom"))
+            return LOAD_RAW;
+    }
+
+    // Text formats start with ':' or with a hex address and ':'
+    size_t i = 0;
+    while (i < size && isspace((unsigned char)data[i]))
+        i++;
+
+    if (i < size && data[i] == ':')
+        return LOAD_IHEX;
+
+    size_t digits = 0;
+    while (i < size && hex_value(data[i]) >= 0)
+        i++, digits++;
+    while (i < size && (data[i] == ' ' || data[i] == '\t'))
+        i++;
+
+    if (digits > 0 && digits <= 4 && i < size && data[i] == ':')
+        return LOAD_WOZ;
+
+    return LOAD_RAW;
+}
+
+static bool loader_parse(loader_t *loader, load_format_t format, int address, char *data, size_t size)
+{
+    switch (format)
+    {
+    case LOAD_RAW:
+        if (address == LOADER_NO_ADDRESS)
+        {
+            snprintf(loader->err, loader->len, "raw image needs a load address");
+            return false;
+        }
+        return loader_write(loader, (u32)address, (const u8 *)data, size);
+    case LOAD_PRG:
+        if (size < 2)
+        {
+            snprintf(loader->err, loader->len, "missing .prg load address");
+            return false;
+        }
+        if (address == LOADER_NO_ADDRESS)
+            address = (u8)data[0] | ((u8)data[1] << 8);
+        return loader_write(loader, (u32)address, (const u8 *)data + 2, size - 2);
+    case LOAD_WOZ:
+        return load_woz(loader, data);
+    case LOAD_IHEX:
+        return load_ihex(loader, data);
+    default:
+        snprintf(loader->err, loader->len, "unknown format");
+        return false;
+    }
+}
+
+// Load a program image straight into the 64K backing store. address is the
+// load address for raw images and overrides the header of .prg files
+bool loader_load(memmap_t *map, const char *path, load_format_t format, int address,
+                 load_result_t *result, char *err, size_t len)
+{
+    load_result_t scratch;
+    if (result == NULL)
+        result = &scratch;
+    memset(result, 0, sizeof(*result));
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        snprintf(err, len, "%s: %s", path, strerror(errno));
+        return false;
+    }
+
+    // Anything that fits in 64K is at most a few hundred KB as text
+    size_t capacity = 4 * MEMORY_SIZE;
+    char *data = malloc(capacity + 1);
+    if (data == NULL)
+    {
+        snprintf(err, len, "%s: out of memory", path);
+        fclose(file);
+        return false;
+    }
+
+    size_t size = fread(data, 1, capacity, file);
+    bool too_large = size == capacity && fgetc(file) != EOF;
+    fclose(file);
+    data[size] = '\0';
+
+    if (format == LOAD_AUTO)
+        format = guess_format(path, data, size);
+    result->format = format;
+
+    char message[128] = "";
+    loader_t loader = {map, result, 0, message, sizeof(message)};
+    bool ok = false;
+
+    if (too_large)
+        snprintf(message, sizeof(message), "file too large");
+    else if (address != LOADER_NO_ADDRESS && format != LOAD_RAW && format != LOAD_PRG)
+        snprintf(message, sizeof(message), "a load address only applies to raw and .prg images");
+    else if (!loader_parse(&loader, format, address, data, size))
+        ; // message set by the parser
+    else if (result->bytes == 0)
+        snprintf(message, sizeof(message), "nothing was loaded");
+    else
+        ok = true;
+
+    if (!ok)
+        snprintf(err, len, "%s: %s", path, message);
+
+    free(data);
+    return ok;
+}
@@ -0,0 +1,34 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include "utils/util.h"
+#include "mem/memory.h"
+
+#define LOADER_NO_ADDRESS -1
+
+typedef enum
+{
+    LOAD_AUTO, // Pick by extension, then by content
+    LOAD_RAW,  // Plain bytes, needs a load address
+    LOAD_WOZ,  // Woz monitor dump: "0280: A9 00 ..." lines
+    LOAD_IHEX, // Intel HEX
+    LOAD_PRG   // Two byte little-endian load address, then the bytes
+} load_format_t;
+
+typedef struct
+{
+    load_format_t format; // Format actually used
+    u32 segments;         // Contiguous runs of bytes written
+    u32 bytes;
+    u16 low;              // Lowest and highest address written
+    u16 high;
+    bool has_entry;       // File names an entry point (Woz "xxxxR", Intel HEX start record)
+    u16 entry;
+} load_result_t;
+
+bool loader_load(memmap_t *map, const char *path, load_format_t format, int address,
+                 load_result_t *result, char *err, size_t len);
+bool loader_parse_format(const char *name, load_format_t *format);
+const char *loader_format_name(load_format_t format);
+
+#endif
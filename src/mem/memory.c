@@ -0,0 +1,131 @@
+#include "memory.h"
+
+void mem_init(memmap_t *map)
+{
+    memset(map, 0, sizeof(*map));
+}
+
+// Refresh the fast path pointers of a page after its mapping changed
+static void mem_update_page(memmap_t *map, unsigned page)
+{
+    if (map->device[page])
+    {
+        map->read[page] = NULL;
+        map->write[page] = NULL;
+        return;
+    }
+
+    map->read[page] = map->base_read[page];
+    map->write[page] = map->watched[page] ? NULL : map->base_write[page];
+}
+
+// storage points at the byte that appears at address 'start'
+static void mem_map_pages(memmap_t *map, u8 *storage, u16 start, u32 size, bool writable)
+{
+    unsigned first = start / MEM_PAGE_SIZE;
+    unsigned count = (size + MEM_PAGE_SIZE - 1) / MEM_PAGE_SIZE;
+
+    for (unsigned i = 0; i < count && first + i < MEM_PAGES; i++)
+    {
+        unsigned page = first + i;
+        u8 *ptr = storage ? storage + i * MEM_PAGE_SIZE : NULL;
+
+        map->base_read[page] = ptr;
+        map->base_write[page] = writable ? ptr : NULL;
+        mem_update_page(map, page);
+    }
+}
+
+void mem_map_ram(memmap_t *map, u8 *storage, u16 start, u32 size)
+{
+    mem_map_pages(map, storage, start, size, true);
+}
+
+// Writes to ROM pages take the slow path and are dropped
+void mem_map_rom(memmap_t *map, u8 *storage, u16 start, u32 size)
+{
+    mem_map_pages(map, storage, start, size, false);
+}
+
+void mem_unmap(memmap_t *map, u16 start, u32 size)
+{
+    mem_map_pages(map, NULL, start, size, false);
+}
+
+bool mem_map_device(memmap_t *map, const mem_device_t *device)
+{
+    unsigned first = device->start / MEM_PAGE_SIZE;
+    unsigned last = device->end / MEM_PAGE_SIZE;
+
+    if (device->end < device->start)
+        return false;
+
+    for (unsigned page = first; page <= last; page++)
+    {
+        if (map->device[page] && map->device[page] != device)
+            return false; // One device per page
+    }
+
+    for (unsigned page = first; page <= last; page++)
+    {
+        map->device[page] = device;
+        mem_update_page(map, page);
+    }
+    return true;
+}
+
+// Send the writes to a page through watch_write, or stop doing so. Every
+// watch has to be matched by an unwatch before the page goes direct again
+void mem_watch(memmap_t *map, unsigned page, bool on)
+{
+    if (on)
+        map->watched[page]++;
+    else
+        map->watched[page]--;
+    mem_update_page(map, page);
+}
+
+u8 mem_read_slow(memmap_t *map, u16 address)
+{
+    unsigned page = address >> 8;
+    const mem_device_t *device = map->device[page];
+
+    if (device && address >= device->start && address <= device->end)
+        return device->read ? device->read(device->ctx, address) : 0;
+
+    // Rest of a device page, or open bus
+    if (map->base_read[page])
+        return map->base_read[page][address & 0xFF];
+
+    return 0;
+}
+
+// Debugger view of memory: RAM/ROM only, devices are never touched
+u8 mem_peek(const memmap_t *map, u16 address)
+{
+    unsigned page = address >> 8;
+    const u8 *base = map->read[page] ? map->read[page] : map->base_read[page];
+
+    return base ? base[address & 0xFF] : 0;
+}
+
+void mem_write_slow(memmap_t *map, u16 address, u8 value)
+{
+    unsigned page = address >> 8;
+    const mem_device_t *device = map->device[page];
+
+    if (device && address >= device->start && address <= device->end)
+    {
+        if (device->write)
+            device->write(device->ctx, address, value);
+        return;
+    }
+
+    // ROM and unmapped pages ignore writes
+    if (map->base_write[page])
+    {
+        map->base_write[page][address & 0xFF] = value;
+        if (map->watched[page])
+            map->watch_write(map->watch_ctx, address);
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include "utils/util.h"
+
+#define MEM_PAGE_SIZE 0x100
+#define MEM_PAGES (MEMORY_SIZE / MEM_PAGE_SIZE)
+
+// A device claims an address range; the pages it touches leave the fast path
+typedef struct
+{
+    const char *name;
+    u16 start;
+    u16 end; // Inclusive
+    u8 (*read)(void *ctx, u16 address);
+    void (*write)(void *ctx, u16 address, u8 value);
+    void *ctx;
+} mem_device_t;
+
+// 256-entry page table. A page with a direct pointer is plain RAM/ROM and is
+// accessed without any further checks; a NULL entry sends the access to the
+// page's device slot, or to open bus if nothing is mapped there
+typedef struct
+{
+    u8 *read[MEM_PAGES];
+    u8 *write[MEM_PAGES];
+    u8 *base_read[MEM_PAGES];  // RAM/ROM underneath a device page
+    u8 *base_write[MEM_PAGES];
+    const mem_device_t *device[MEM_PAGES];
+
+    // Pages whose writes someone needs to see (translated code, see jit.c,
+    // and predecoded instructions, see decode.c), by how many watch them:
+    // they take the slow path, which stores the byte as usual and then
+    // calls watch_write
+    u8 watched[MEM_PAGES];
+    void (*watch_write)(void *ctx, u16 address);
+    void *watch_ctx;
+} memmap_t;
+
+void mem_init(memmap_t *map);
+void mem_map_ram(memmap_t *map, u8 *storage, u16 start, u32 size);
+void mem_map_rom(memmap_t *map, u8 *storage, u16 start, u32 size);
+void mem_unmap(memmap_t *map, u16 start, u32 size);
+bool mem_map_device(memmap_t *map, const mem_device_t *device);
+void mem_watch(memmap_t *map, unsigned page, bool on);
+u8 mem_read_slow(memmap_t *map, u16 address);
+void mem_write_slow(memmap_t *map, u16 address, u8 value);
+u8 mem_peek(const memmap_t *map, u16 address);
+
+static inline u8 mem_read(memmap_t *map, u16 address)
+{
+    const u8 *page = map->read[address >> 8];
+
+    if (__builtin_expect(page != NULL, 1))
+        return page[address & 0xFF];
+
+    return mem_read_slow(map, address);
+}
+
+static inline void mem_write(memmap_t *map, u16 address, u8 value)
+{
+    u8 *page = map->write[address >> 8];
+
+    if (__builtin_expect(page != NULL, 1))
+    {
+        page[address & 0xFF] = value;
+        return;
+    }
+
+    mem_write_slow(map, address, value);
+}
+
+#endif
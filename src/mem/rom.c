@@ -0,0 +1,69 @@
+#include "rom.h"
+
+// Images replaced from disk on the command line. Set up once at startup,
+// read-only afterwards
+static rom_image_t overrides[ROM_MAX_OVERRIDES];
+static size_t override_count;
+
+const rom_image_t *rom_find(const char *name)
+{
+    for (size_t i = 0; i < override_count; i++)
+    {
+        if (strcmp(overrides[i].name, name) == 0)
+            return &overrides[i];
+    }
+
+    for (size_t i = 0; i < rom_image_count; i++)
+    {
+        if (strcmp(rom_images[i].name, name) == 0)
+            return &rom_images[i];
+    }
+
+    return NULL;
+}
+
+// Use the contents of path instead of the built-in image called name
+bool rom_override(const char *name, const char *path, char *err, size_t len)
+{
+    size_t known = 0;
+    while (known < rom_image_count && strcmp(rom_images[known].name, name) != 0)
+        known++;
+
+    if (known == rom_image_count)
+    {
+        // Nothing would ever load it: list the names that do exist
+        int used = snprintf(err, len, "unknown ROM: %s (built-in:", name);
+        for (size_t i = 0; i < rom_image_count && used >= 0 && (size_t)used < len; i++)
+            used += snprintf(err + used, len - used, "%s %s", i ? "," : "", rom_images[i].name);
+        if (used >= 0 && (size_t)used < len)
+            snprintf(err + used, len - used, ")");
+        return false;
+    }
+
+    if (override_count == ROM_MAX_OVERRIDES)
+    {
+        snprintf(err, len, "too many ROM overrides");
+        return false;
+    }
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        snprintf(err, len, "%s: %s", path, strerror(errno));
+        return false;
+    }
+
+    u8 *data = malloc(MEMORY_SIZE);
+    size_t size = data ? fread(data, 1, MEMORY_SIZE, file) : 0;
+    fclose(file);
+
+    if (size == 0)
+    {
+        snprintf(err, len, "%s: empty or unreadable", path);
+        free(data);
+        return false;
+    }
+
+    overrides[override_count++] = (rom_image_t){strdup(name), data, size};
+    return true;
+}
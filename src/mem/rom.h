@@ -0,0 +1,23 @@
+#ifndef ROM_H
+#define ROM_H
+
+#include "utils/util.h"
+
+#define ROM_MAX_OVERRIDES 8
+
+// ROM images compiled into the binary from roms/*.bin (see the Makefile),
+// named after the file without its extension
+typedef struct
+{
+    const char *name;
+    const u8 *data;
+    size_t size;
+} rom_image_t;
+
+extern const rom_image_t rom_images[];
+extern const size_t rom_image_count;
+
+const rom_image_t *rom_find(const char *name);
+bool rom_override(const char *name, const char *path, char *err, size_t len);
+
+#endif
@@ -0,0 +1,253 @@
+#include "batch.h"
+#include "state/snapshot.h"
+
+#include <pthread.h>
+
+// Every worker owns a slice of the job list as a double-ended queue: it
+// takes jobs from the back of its own slice and, once that is empty, steals
+// from the front of the others. Jobs are whole emulator runs, so a mutex
+// per queue costs nothing next to the work it hands out
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    size_t head;
+    size_t tail;
+} batch_queue_t;
+
+typedef struct batch_worker_t
+{
+    struct batch_pool_t *pool;
+    unsigned id;
+    batch_queue_t queue;
+    u64 steals;
+    pthread_t thread;
+} batch_worker_t;
+
+typedef struct batch_pool_t
+{
+    batch_job_t *jobs;
+    const batch_opts_t *opts;
+    batch_worker_t *workers;
+    unsigned count;
+} batch_pool_t;
+
+static u64 batch_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ULL + (u64)ts.tv_nsec;
+}
+
+static bool queue_pop_back(batch_queue_t *queue, size_t *job)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->head < queue->tail)
+    {
+        *job = --queue->tail;
+        found = true;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+static bool queue_pop_front(batch_queue_t *queue, size_t *job)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->head < queue->tail)
+    {
+        *job = queue->head++;
+        found = true;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+// Own queue first, then the others starting with the next worker. No job is
+// ever added, so finding every queue empty means the batch is done
+static bool batch_next(batch_worker_t *worker, size_t *job)
+{
+    batch_pool_t *pool = worker->pool;
+
+    if (queue_pop_back(&worker->queue, job))
+        return true;
+
+    for (unsigned i = 1; i < pool->count; i++)
+    {
+        batch_worker_t *victim = &pool->workers[(worker->id + i) % pool->count];
+
+        if (queue_pop_front(&victim->queue, job))
+        {
+            worker->steals++;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void batch_run_job(cpu_t *cpu, batch_job_t *job, const batch_opts_t *opts)
+{
+    headless_opts_t run = opts->limits;
+    FILE *capture = NULL;
+
+    job->failed = true;
+
+    cpu_init(cpu);
+    cpu->emulate_illegal = opts->emulate_illegal;
+
+    if (!cpu_map_memory(cpu, opts->ram_kb))
+    {
+        snprintf(job->error, sizeof(job->error), "unsupported RAM size: %uK", opts->ram_kb);
+        return;
+    }
+    if (!init_software(cpu))
+    {
+        snprintf(job->error, sizeof(job->error), "could not install the ROMs");
+        return;
+    }
+    if (opts->state_path && !snapshot_load(cpu, opts->state_path, job->error, sizeof(job->error)))
+        return;
+
+    run.input = NULL;
+    if (job->input_path)
+    {
+        run.input = fopen(job->input_path, "rb");
+        if (run.input == NULL)
+        {
+            snprintf(job->error, sizeof(job->error), "%s", strerror(errno));
+            return;
+        }
+    }
+
+    run.output = job->output;
+    if (run.output == NULL)
+    {
+        capture = open_memstream(&job->output_buf, &job->output_len);
+        if (capture == NULL)
+        {
+            snprintf(job->error, sizeof(job->error), "cannot capture output: %s", strerror(errno));
+            if (run.input)
+                fclose(run.input);
+            return;
+        }
+        run.output = capture;
+    }
+
+    u64 start = batch_now_ns();
+    job->result = headless_run(cpu, &run);
+    job->ns = batch_now_ns() - start;
+    job->failed = false;
+
+    if (run.input)
+        fclose(run.input);
+    if (capture)
+        fclose(capture);
+}
+
+static void *batch_worker(void *arg)
+{
+    batch_worker_t *worker = arg;
+    batch_pool_t *pool = worker->pool;
+    size_t job;
+
+    // cpu_t carries the 64K backing store, keep it off the thread stack
+    cpu_t *cpu = malloc(sizeof(cpu_t));
+    if (cpu == NULL)
+        return NULL;
+
+    while (batch_next(worker, &job))
+    {
+        pool->jobs[job].worker = worker->id;
+        batch_run_job(cpu, &pool->jobs[job], pool->opts);
+
+        // Tapes from the snapshot or recorded by the job, on every outcome
+        aci_free(&cpu->aci);
+    }
+
+    free(cpu);
+    return NULL;
+}
+
+// Run every job on a pool of worker threads. Jobs share nothing but the
+// read-only ROM images, so results do not depend on the thread count
+bool batch_run(batch_job_t *jobs, size_t count, const batch_opts_t *opts, batch_stats_t *stats)
+{
+    unsigned threads = opts->threads;
+
+    if (threads == 0)
+    {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (unsigned)online : 1;
+    }
+    if (threads > BATCH_MAX_THREADS)
+        threads = BATCH_MAX_THREADS;
+    if (threads > count)
+        threads = count ? (unsigned)count : 1;
+
+    batch_worker_t *workers = calloc(threads, sizeof(batch_worker_t));
+    if (workers == NULL)
+        return false;
+
+    batch_pool_t pool = {jobs, opts, workers, threads};
+
+    for (size_t i = 0; i < count; i++)
+    {
+        jobs[i].failed = true;
+        snprintf(jobs[i].error, sizeof(jobs[i].error), "not run");
+        jobs[i].output_buf = NULL;
+        jobs[i].output_len = 0;
+    }
+
+    // Contiguous slices, so stealing from the front takes the jobs their
+    // owner would have reached last
+    for (unsigned i = 0; i < threads; i++)
+    {
+        batch_worker_t *worker = &workers[i];
+
+        worker->pool = &pool;
+        worker->id = i;
+        worker->queue.head = count * i / threads;
+        worker->queue.tail = count * (i + 1) / threads;
+        pthread_mutex_init(&worker->queue.lock, NULL);
+    }
+
+    u64 start = batch_now_ns();
+    unsigned started = 0;
+
+    for (; started < threads; started++)
+    {
+        if (pthread_create(&workers[started].thread, NULL, batch_worker, &workers[started]) != 0)
+            break;
+    }
+
+    // Whoever did start steals the slices of threads that could not
+    bool ok = started > 0;
+    for (unsigned i = 0; i < started; i++)
+        pthread_join(workers[i].thread, NULL);
+
+    memset(stats, 0, sizeof(*stats));
+    stats->threads = started;
+    stats->ns = batch_now_ns() - start;
+
+    for (unsigned i = 0; i < threads; i++)
+    {
+        stats->steals += workers[i].steals;
+        pthread_mutex_destroy(&workers[i].queue.lock);
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!jobs[i].failed)
+        {
+            stats->instructions += jobs[i].result.instructions;
+            stats->cycles += jobs[i].result.cycles;
+        }
+    }
+
+    free(workers);
+    return ok;
+}
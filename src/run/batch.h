@@ -0,0 +1,45 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "utils/util.h"
+#include "run/headless.h"
+
+#define BATCH_MAX_THREADS 256
+
+// One headless emulator run: a fresh machine, its own keyboard script and
+// its own output stream
+typedef struct
+{
+    const char *input_path; // Keyboard script, NULL for none
+    FILE *output;           // Display output, NULL to capture it in output_buf
+
+    char *output_buf;       // Captured output (malloc'd, caller frees)
+    size_t output_len;
+    bool failed;            // Could not start; see error
+    char error[160];
+    headless_result_t result;
+    u64 ns;                 // Wall time of the run
+    unsigned worker;        // Thread that ran the job
+} batch_job_t;
+
+typedef struct
+{
+    headless_opts_t limits; // Stop conditions; input and output come from the job
+    u32 ram_kb;
+    bool emulate_illegal;
+    const char *state_path; // Start every job from this snapshot, NULL to boot
+    unsigned threads;       // 0 = one per online CPU
+} batch_opts_t;
+
+typedef struct
+{
+    unsigned threads;
+    u64 steals;             // Jobs taken from another worker's queue
+    u64 instructions;
+    u64 cycles;
+    u64 ns;
+} batch_stats_t;
+
+bool batch_run(batch_job_t *jobs, size_t count, const batch_opts_t *opts, batch_stats_t *stats);
+
+#endif
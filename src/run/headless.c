@@ -0,0 +1,236 @@
+#include "headless.h"
+
+typedef struct
+{
+    const headless_opts_t *opts;
+    size_t pattern_len;
+    char window[HEADLESS_MAX_PATTERN]; // Last pattern_len characters printed
+    size_t window_pos;
+    size_t window_fill;
+    bool matched;
+    u8 col;
+} headless_t;
+
+static bool window_matches(headless_t *hl)
+{
+    const char *pattern = hl->opts->stop_output;
+
+    for (size_t i = 0; i < hl->pattern_len; i++)
+    {
+        if (hl->window[(hl->window_pos + i) % hl->pattern_len] != pattern[i])
+            return false;
+    }
+    return true;
+}
+
+static void headless_display_out(cpu_t *cpu, u8 value)
+{
+    headless_t *hl = cpu->host;
+    u8 ch = value & 0x7F;
+
+    if (ch == '\n' || ch == '\r')
+    {
+        hl->col = 0;
+        ch = '\n';
+    }
+    else if (ch >= 0x20 && ch <= 0x7E)
+    {
+        hl->col++;
+    }
+    else
+    {
+        return;
+    }
+
+    fputc(ch, hl->opts->output);
+
+    // Wrap like the 40 column display does
+    if (ch != '\n' && hl->col >= DISPLAY_COLS)
+    {
+        hl->col = 0;
+        fputc('\n', hl->opts->output);
+    }
+
+    if (hl->pattern_len)
+    {
+        hl->window[hl->window_pos] = ch;
+        hl->window_pos = (hl->window_pos + 1) % hl->pattern_len;
+        if (hl->window_fill < hl->pattern_len)
+            hl->window_fill++;
+
+        if (hl->window_fill == hl->pattern_len && window_matches(hl))
+        {
+            hl->matched = true;
+            cpu->yield |= CPU_YIELD_HOST;
+        }
+    }
+}
+
+// Top up the key queue from the input file, false once the input is exhausted
+static bool feed_keyboard(cpu_t *cpu, FILE *input)
+{
+    unsigned space = keyboard_space(&cpu->keyboard);
+
+    while (space)
+    {
+        int ch = fgetc(input);
+        if (ch == EOF)
+            return false;
+
+        ch = keyboard_ascii(ch);
+        if (ch < 0)
+            continue;
+
+        keyboard_push(&cpu->keyboard, (u8)ch);
+        space--;
+    }
+    return true;
+}
+
+headless_result_t headless_run(cpu_t *cpu, const headless_opts_t *opts)
+{
+    headless_t hl = {0};
+    headless_result_t result = {HEADLESS_STOP_HALT, 0, 0, 0};
+    FILE *input = opts->input;
+
+    hl.opts = opts;
+    if (opts->stop_output)
+    {
+        hl.pattern_len = strlen(opts->stop_output);
+        if (hl.pattern_len > HEADLESS_MAX_PATTERN)
+            hl.pattern_len = HEADLESS_MAX_PATTERN;
+    }
+
+    cpu->display_out = headless_display_out;
+    cpu->host = &hl;
+
+    u64 start_cycles = cpu->global_cycles;
+    u64 cycle_limit = opts->max_cycles ? start_cycles + opts->max_cycles : UINT64_MAX;
+
+    replay_t *replay = opts->replay;
+
+    while (cpu->running)
+    {
+        // Events are applied at the cycle they were recorded at, and the log
+        // ending ends the run
+        if (replay && !replay_apply(replay, cpu))
+        {
+            result.reason = HEADLESS_STOP_REPLAY;
+            break;
+        }
+
+        if (input && !feed_keyboard(cpu, input))
+            input = NULL;
+
+        if (opts->stop_on_pc || opts->opcode_counts)
+        {
+            // PC breakpoints and the instruction mix need single stepping
+            if (!cpu->halt)
+                interrupt_service(cpu);
+
+            u8 opcode = read_memory(cpu, cpu->PC);
+
+            if (cpu_cycle(cpu))
+            {
+                result.instructions++;
+                if (opts->opcode_counts)
+                    opts->opcode_counts[opcode]++;
+            }
+        }
+        else
+        {
+            // Run in chunks so the key queue is topped up while input remains
+            u64 target = cycle_limit;
+            if (input && cycle_limit - cpu->global_cycles > HEADLESS_CHUNK_CYCLES)
+                target = cpu->global_cycles + HEADLESS_CHUNK_CYCLES;
+            if (replay && replay->next_cycles < target)
+                target = replay->next_cycles;
+
+            u64 budget = opts->max_instructions ? opts->max_instructions - result.instructions
+                                                : UINT64_MAX;
+            result.instructions += cpu_run(cpu, target, budget);
+        }
+
+        // A recorded halt is followed by the time the frontend let pass,
+        // or a reset, due right away
+        if (cpu->halt && !(replay && replay->next_cycles <= cpu->global_cycles))
+        {
+            result.reason = HEADLESS_STOP_TRAP;
+            break;
+        }
+        if (hl.matched)
+        {
+            result.reason = HEADLESS_STOP_OUTPUT;
+            break;
+        }
+        if (opts->stop_on_pc && cpu->PC == opts->stop_pc)
+        {
+            result.reason = HEADLESS_STOP_PC;
+            break;
+        }
+        if (opts->max_instructions && result.instructions >= opts->max_instructions)
+        {
+            result.reason = HEADLESS_STOP_INSTRUCTIONS;
+            break;
+        }
+        if (cpu->idle)
+        {
+            // Waiting on a keyboard that will stay empty: only a timer can
+            // still interrupt the wait, so jump straight to its next expiry
+            // or the cycle limit
+            cpu->idle = false;
+            if (replay == NULL && input == NULL && keyboard_empty(&cpu->keyboard))
+            {
+                u64 wake = cpu->next_event < cycle_limit ? cpu->next_event : cycle_limit;
+
+                if (wake == UINT64_MAX)
+                {
+                    result.reason = HEADLESS_STOP_IDLE;
+                    break;
+                }
+                if (wake > cpu->global_cycles)
+                {
+                    result.idle_cycles += wake - cpu->global_cycles;
+                    cpu->global_cycles = wake;
+                }
+            }
+        }
+        if (cpu->global_cycles >= cycle_limit)
+        {
+            result.reason = HEADLESS_STOP_CYCLES;
+            break;
+        }
+    }
+
+    result.cycles = cpu->global_cycles - start_cycles;
+    cpu->yield = 0;
+    fflush(opts->output);
+
+    cpu->display_out = NULL;
+    cpu->host = NULL;
+    return result;
+}
+
+const char *headless_stop_name(headless_stop_t reason)
+{
+    switch (reason)
+    {
+    case HEADLESS_STOP_HALT:
+        return "halt";
+    case HEADLESS_STOP_CYCLES:
+        return "cycles";
+    case HEADLESS_STOP_INSTRUCTIONS:
+        return "instructions";
+    case HEADLESS_STOP_PC:
+        return "pc";
+    case HEADLESS_STOP_OUTPUT:
+        return "output";
+    case HEADLESS_STOP_TRAP:
+        return "trap";
+    case HEADLESS_STOP_IDLE:
+        return "idle";
+    case HEADLESS_STOP_REPLAY:
+        return "replay end";
+    }
+    return "unknown";
+}
@@ -0,0 +1,46 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include "utils/util.h"
+#include "cpu/cpu.h"
+
+#define HEADLESS_MAX_PATTERN 256
+#define HEADLESS_CHUNK_CYCLES 10000 // Run length between key queue refills
+
+typedef enum
+{
+    HEADLESS_STOP_HALT,         // CPU stopped by itself
+    HEADLESS_STOP_CYCLES,       // max_cycles reached
+    HEADLESS_STOP_INSTRUCTIONS, // max_instructions reached
+    HEADLESS_STOP_PC,           // PC reached stop_pc
+    HEADLESS_STOP_OUTPUT,       // stop_output was printed
+    HEADLESS_STOP_TRAP,         // CPU halted by JAM or an undocumented opcode
+    HEADLESS_STOP_IDLE,         // Waiting for a key after the input ran out
+    HEADLESS_STOP_REPLAY        // The input log ended (or could not be read on)
+} headless_stop_t;
+
+typedef struct
+{
+    FILE *input;             // Keyboard input, NULL for none
+    FILE *output;            // Receives everything written to 0xD012
+    u64 max_cycles;          // 0 = no limit
+    u64 max_instructions;    // 0 = no limit
+    bool stop_on_pc;
+    u16 stop_pc;
+    const char *stop_output; // Stop once this text is printed, NULL for none
+    u64 *opcode_counts;      // If set (256 entries), single step and count opcodes
+    replay_t *replay;        // Input log to drive the machine with, NULL for none
+} headless_opts_t;
+
+typedef struct
+{
+    headless_stop_t reason;
+    u64 cycles;
+    u64 instructions;
+    u64 idle_cycles;            // Skipped while waiting for input that never came
+} headless_result_t;
+
+headless_result_t headless_run(cpu_t *cpu, const headless_opts_t *opts);
+const char *headless_stop_name(headless_stop_t reason);
+
+#endif
@@ -0,0 +1,246 @@
+#include "replay.h"
+#include "snapshot.h"
+
+static void put_byte(recording_t *rec, u8 value)
+{
+    if (fputc(value, rec->file) == EOF)
+        rec->failed = true;
+}
+
+static void put_varint(recording_t *rec, u64 value)
+{
+    do
+    {
+        u8 byte = value & 0x7F;
+        value >>= 7;
+        put_byte(rec, byte | (value ? 0x80 : 0));
+    } while (value);
+}
+
+static void put_event(recording_t *rec, const cpu_t *cpu, u8 code)
+{
+    put_varint(rec, cpu->global_cycles - rec->last_cycles);
+    put_byte(rec, code);
+    rec->last_cycles = cpu->global_cycles;
+    rec->events++;
+}
+
+// Start logging with the machine as it is now, which a replay has to
+// start from too
+recording_t *recording_start(cpu_t *cpu, const char *path, char *err, size_t len)
+{
+    recording_t *rec = calloc(1, sizeof(recording_t));
+    if (rec == NULL)
+    {
+        snprintf(err, len, "%s: out of memory", path);
+        return NULL;
+    }
+
+    rec->file = fopen(path, "wb");
+    if (rec->file == NULL)
+    {
+        snprintf(err, len, "%s: %s", path, strerror(errno));
+        free(rec);
+        return NULL;
+    }
+
+    replay_header_t header = {0};
+    memcpy(header.magic, REPLAY_MAGIC, sizeof(header.magic));
+    header.version = REPLAY_VERSION;
+    header.header_size = sizeof(replay_header_t);
+    header.start_cycles = cpu->global_cycles;
+    header.start_hash = snapshot_hash(cpu);
+
+    if (fwrite(&header, sizeof(header), 1, rec->file) != 1)
+        rec->failed = true;
+
+    rec->path = path;
+    rec->last_cycles = cpu->global_cycles;
+    return rec;
+}
+
+void recording_key(recording_t *rec, const cpu_t *cpu, u8 key)
+{
+    put_event(rec, cpu, key & 0x7F);
+}
+
+void recording_reset(recording_t *rec, const cpu_t *cpu)
+{
+    put_event(rec, cpu, REPLAY_RESET);
+}
+
+void recording_clear(recording_t *rec, const cpu_t *cpu)
+{
+    put_event(rec, cpu, REPLAY_CLEAR);
+}
+
+// Called before the host moves global_cycles on by cycles
+void recording_skip(recording_t *rec, const cpu_t *cpu, u64 cycles)
+{
+    if (cycles == 0)
+        return;
+
+    put_event(rec, cpu, REPLAY_SKIP);
+    put_varint(rec, cycles);
+}
+
+// Close the log with the end of the session and the final state hash
+bool recording_finish(recording_t *rec, cpu_t *cpu, char *err, size_t len)
+{
+    u64 hash = snapshot_hash(cpu);
+
+    put_event(rec, cpu, REPLAY_END);
+    if (fwrite(&hash, sizeof(hash), 1, rec->file) != 1)
+        rec->failed = true;
+    if (fclose(rec->file) != 0)
+        rec->failed = true;
+
+    bool ok = !rec->failed;
+    if (!ok)
+        snprintf(err, len, "%s: write failed", rec->path);
+
+    free(rec);
+    return ok;
+}
+
+static bool get_varint(replay_t *rp, u64 *value)
+{
+    *value = 0;
+
+    for (unsigned shift = 0; shift < 64; shift += 7)
+    {
+        if (rp->pos >= rp->size)
+            return false;
+
+        u8 byte = rp->data[rp->pos++];
+        *value |= (u64)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// Read the timestamp of the next event
+static void replay_next(replay_t *rp, u64 last)
+{
+    u64 delta;
+
+    if (!get_varint(rp, &delta) || rp->pos >= rp->size)
+    {
+        rp->corrupt = true;
+        rp->next_cycles = UINT64_MAX;
+        return;
+    }
+    rp->next_cycles = last + delta;
+}
+
+replay_t *replay_open(const char *path, char *err, size_t len)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        snprintf(err, len, "%s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    replay_t *rp = calloc(1, sizeof(replay_t));
+    long size = -1;
+
+    if (rp && fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) >= 0 && fseek(file, 0, SEEK_SET) == 0)
+    {
+        rp->size = (size_t)size;
+        rp->data = malloc(rp->size ? rp->size : 1);
+    }
+
+    if (rp == NULL || rp->data == NULL || fread(rp->data, 1, rp->size, file) != rp->size)
+    {
+        snprintf(err, len, "%s: could not read the input log", path);
+        fclose(file);
+        replay_close(rp);
+        return NULL;
+    }
+    fclose(file);
+
+    if (rp->size < sizeof(replay_header_t))
+    {
+        snprintf(err, len, "%s: not an input log", path);
+        replay_close(rp);
+        return NULL;
+    }
+
+    memcpy(&rp->header, rp->data, sizeof(replay_header_t));
+    if (memcmp(rp->header.magic, REPLAY_MAGIC, sizeof(rp->header.magic)) != 0 ||
+        rp->header.version != REPLAY_VERSION || rp->header.header_size != sizeof(replay_header_t))
+    {
+        snprintf(err, len, "%s: not a version %d input log", path, REPLAY_VERSION);
+        replay_close(rp);
+        return NULL;
+    }
+
+    rp->pos = sizeof(replay_header_t);
+    replay_next(rp, rp->header.start_cycles);
+    return rp;
+}
+
+void replay_close(replay_t *rp)
+{
+    if (rp == NULL)
+        return;
+
+    free(rp->data);
+    free(rp);
+}
+
+// Apply every event due by now. False once the log has ended (or turned
+// out to be damaged): the session is over
+bool replay_apply(replay_t *rp, cpu_t *cpu)
+{
+    while (!rp->ended && !rp->corrupt && rp->next_cycles <= cpu->global_cycles)
+    {
+        u64 at = rp->next_cycles;
+        u8 code = rp->data[rp->pos++];
+        u64 cycles;
+
+        switch (code)
+        {
+        case REPLAY_RESET:
+            cpu_reset(cpu);
+            break;
+        case REPLAY_CLEAR:
+            display_clear(&cpu->display);
+            break;
+        case REPLAY_SKIP:
+            if (!get_varint(rp, &cycles))
+            {
+                rp->corrupt = true;
+                return false;
+            }
+            cpu->global_cycles += cycles;
+            break;
+        case REPLAY_END:
+            if (rp->size - rp->pos < sizeof(rp->end_hash))
+            {
+                rp->corrupt = true;
+                return false;
+            }
+            memcpy(&rp->end_hash, rp->data + rp->pos, sizeof(rp->end_hash));
+            rp->ended = true;
+            rp->next_cycles = UINT64_MAX;
+            rp->events++;
+            return false;
+        default:
+            if (code & 0x80)
+            {
+                rp->corrupt = true;
+                return false;
+            }
+            keyboard_push(&cpu->keyboard, code);
+            break;
+        }
+
+        rp->events++;
+        replay_next(rp, at);
+    }
+
+    return !rp->ended && !rp->corrupt;
+}
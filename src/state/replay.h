@@ -0,0 +1,73 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "utils/util.h"
+
+struct cpu_t;
+
+#define REPLAY_MAGIC "A1INPUT"
+#define REPLAY_VERSION 1
+
+// Input log of a session: everything the host did to the machine that
+// does not follow from global_cycles, in order, each stamped with the cycle
+// it happened at. After the header, every event is the cycles since the
+// one before as a LEB128 varint, then a code byte:
+//
+//   0x00-0x7F  key pushed into the keyboard queue
+//   0x80       RESET (F1)
+//   0x81       screen cleared (F2)
+//   0x82       global_cycles moved on by a varint (idle waits, halted slices)
+//   0x83       end of the session, then the 64-bit hash of the final state
+//
+// Given the same starting state, the same events at the same cycles make
+// the same machine, down to the end hash
+#define REPLAY_RESET 0x80
+#define REPLAY_CLEAR 0x81
+#define REPLAY_SKIP 0x82
+#define REPLAY_END 0x83
+
+typedef struct
+{
+    char magic[8];
+    u32 version;
+    u32 header_size;
+    u64 start_cycles;
+    u64 start_hash; // snapshot_hash of the machine when recording started
+} replay_header_t;
+
+// Recording side, fed by the frontend
+typedef struct recording_t
+{
+    FILE *file;
+    const char *path;
+    u64 last_cycles; // Cycle of the previous event
+    u64 events;
+    bool failed;     // A write went wrong, reported when the log is closed
+} recording_t;
+
+recording_t *recording_start(struct cpu_t *cpu, const char *path, char *err, size_t len);
+void recording_key(recording_t *rec, const struct cpu_t *cpu, u8 key);
+void recording_reset(recording_t *rec, const struct cpu_t *cpu);
+void recording_clear(recording_t *rec, const struct cpu_t *cpu);
+void recording_skip(recording_t *rec, const struct cpu_t *cpu, u64 cycles);
+bool recording_finish(recording_t *rec, struct cpu_t *cpu, char *err, size_t len);
+
+// Replay side: the whole log in memory, applied by headless_run
+typedef struct
+{
+    replay_header_t header;
+    u8 *data;
+    size_t size;
+    size_t pos;        // Start of the next event's code byte
+    u64 next_cycles;   // When the next event is due, UINT64_MAX after the end
+    u64 events;        // Applied so far
+    bool ended;        // The end event was reached
+    bool corrupt;      // The log stopped making sense
+    u64 end_hash;
+} replay_t;
+
+replay_t *replay_open(const char *path, char *err, size_t len);
+void replay_close(replay_t *rp);
+bool replay_apply(replay_t *rp, struct cpu_t *cpu);
+
+#endif
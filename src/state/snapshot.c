@@ -0,0 +1,289 @@
+#include "snapshot.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static void snapshot_capture(cpu_t *cpu, snapshot_header_t *header)
+{
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic));
+    header->version = SNAPSHOT_VERSION;
+    header->header_size = sizeof(snapshot_header_t);
+
+    header->global_cycles = cpu->global_cycles;
+    header->PC = cpu->PC;
+    header->A = cpu->A;
+    header->X = cpu->X;
+    header->Y = cpu->Y;
+    header->SP = cpu->SP;
+    header->P = cpu_status(cpu) | BREAK_FLAG;
+    header->BRK_LOC = cpu->BRK_LOC;
+    header->RESET_LOC = cpu->RESET_LOC;
+    header->NMI_LOC = cpu->NMI_LOC;
+    header->ram_kb = cpu->ram_kb;
+
+    header->halt = cpu->halt;
+    header->halt_pc = cpu->halt_pc;
+    header->halt_opcode = cpu->halt_opcode;
+
+    header->irq_lines = cpu->interrupt.irq_lines;
+    header->nmi_lines = cpu->interrupt.nmi_lines;
+    header->nmi_pending = cpu->interrupt.nmi_pending;
+    header->irq_i_before = cpu->interrupt.i_before;
+    header->irq_i_until = cpu->interrupt.i_until;
+    header->timer_period = cpu->timer.period;
+    header->timer_control = cpu->timer.control;
+    header->timer_status = cpu->timer.status;
+    header->timer_deadline = cpu->timer.deadline;
+
+    header->key_ready = cpu->key_ready;
+    header->key_value = cpu->key_value;
+    header->queued_keys = keyboard_peek_all(&cpu->keyboard, header->keys);
+    header->idle_polls = cpu->idle_polls;
+    header->last_poll = cpu->last_poll;
+
+    header->row = cpu->display.row;
+    header->col = cpu->display.col;
+    header->busy_until = cpu->display.busy_until;
+    memcpy(header->screen, cpu->display.screen, sizeof(header->screen));
+    header->display_chars = cpu->display.chars;
+    header->display_refreshes = cpu->display.refreshes;
+
+    header->tape_playing = cpu->aci.playing;
+    header->tape_in_level = cpu->aci.in_level;
+    header->tape_out_level = cpu->aci.out_level;
+    header->tape_out_started = cpu->aci.out_started;
+    header->tape_position = cpu->aci.position;
+    header->tape_next_edge = cpu->aci.next_edge;
+    header->tape_last_toggle = cpu->aci.last_toggle;
+    header->tape_fast_loads = cpu->aci.fast_loads;
+    header->tape_input_halves = cpu->aci.input.count;
+    header->tape_output_halves = cpu->aci.output.count;
+}
+
+static bool snapshot_load_tape(tape_t *tape, const u32 *halves, size_t count)
+{
+    tape_free(tape);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!tape_append(tape, halves[i]))
+            return false;
+    }
+    return true;
+}
+
+// The tapes come from the file only when it holds one: a snapshot taken
+// with no tape in keeps the tape inserted with -a, rewound
+static bool snapshot_restore(cpu_t *cpu, const snapshot_header_t *header, const u32 *tapes)
+{
+    aci_t *aci = &cpu->aci;
+
+    if (header->tape_input_halves &&
+        !snapshot_load_tape(&aci->input, tapes, header->tape_input_halves))
+        return false;
+    if (!snapshot_load_tape(&aci->output, tapes + header->tape_input_halves,
+                            header->tape_output_halves))
+        return false;
+
+    aci->playing = header->tape_input_halves && header->tape_playing;
+    aci->in_level = header->tape_input_halves && header->tape_in_level;
+    aci->position = header->tape_input_halves ? header->tape_position : 0;
+    aci->next_edge = header->tape_next_edge;
+    aci->out_level = header->tape_out_level;
+    aci->out_started = header->tape_out_started;
+    aci->last_toggle = header->tape_last_toggle;
+    aci->fast_loads = header->tape_fast_loads;
+
+    cpu->global_cycles = header->global_cycles;
+    cpu->PC = header->PC;
+    cpu->A = header->A;
+    cpu->X = header->X;
+    cpu->Y = header->Y;
+    cpu->SP = header->SP;
+
+    cpu_set_status(cpu, header->P);
+
+    cpu->BRK_LOC = header->BRK_LOC;
+    cpu->RESET_LOC = header->RESET_LOC;
+    cpu->NMI_LOC = header->NMI_LOC;
+
+    cpu->halt = header->halt;
+    cpu->halt_pc = header->halt_pc;
+    cpu->halt_opcode = header->halt_opcode;
+
+    cpu->interrupt.irq_lines = header->irq_lines;
+    cpu->interrupt.nmi_lines = header->nmi_lines;
+    cpu->interrupt.nmi_pending = header->nmi_pending;
+    cpu->interrupt.i_before = header->irq_i_before;
+    cpu->interrupt.i_until = header->irq_i_until;
+    cpu->timer.period = header->timer_period;
+    cpu->timer.control = header->timer_control;
+    cpu->timer.status = header->timer_status;
+    cpu->timer.deadline = header->timer_deadline;
+    cpu->next_event = cpu->timer.control & TIMER_RUN ? cpu->timer.deadline : UINT64_MAX;
+
+    cpu->key_ready = header->key_ready;
+    cpu->key_value = header->key_value;
+    keyboard_clear(&cpu->keyboard);
+    for (unsigned i = 0; i < header->queued_keys; i++)
+        keyboard_push(&cpu->keyboard, header->keys[i]);
+    cpu->idle_polls = header->idle_polls;
+    cpu->last_poll = header->last_poll;
+
+    cpu->display.row = header->row;
+    cpu->display.col = header->col;
+    cpu->display.busy_until = header->busy_until;
+    memcpy(cpu->display.screen, header->screen, sizeof(cpu->display.screen));
+    cpu->display.dirty_rows = DISPLAY_ALL_ROWS;
+    cpu->display.chars = header->display_chars;
+    cpu->display.refreshes = header->display_refreshes;
+
+    cpu->temp_cycles = 0;
+    cpu->yield = 0;
+    return true;
+}
+
+static bool snapshot_valid(const snapshot_header_t *header)
+{
+    return memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) == 0 &&
+           header->version == SNAPSHOT_VERSION &&
+           header->header_size == sizeof(snapshot_header_t);
+}
+
+// Write the machine state to a new file next to path, then rename it over
+// path: an interrupted save leaves the previous snapshot as it was
+bool snapshot_save(cpu_t *cpu, const char *path, char *err, size_t len)
+{
+    char temp[PATH_MAX];
+    if (snprintf(temp, sizeof(temp), "%s.tmp", path) >= (int)sizeof(temp))
+    {
+        snprintf(err, len, "%s: path too long", path);
+        return false;
+    }
+
+    snapshot_header_t header;
+    snapshot_capture(cpu, &header);
+
+    const tape_t *input = &cpu->aci.input;
+    const tape_t *output = &cpu->aci.output;
+    size_t size = SNAPSHOT_TAPE_OFFSET + (input->count + output->count) * sizeof(u32);
+
+    int fd = open(temp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        snprintf(err, len, "%s: %s", temp, strerror(errno));
+        return false;
+    }
+
+    u8 *map = MAP_FAILED;
+    if (ftruncate(fd, (off_t)size) == 0)
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    bool ok = map != MAP_FAILED;
+    if (ok)
+    {
+        memcpy(map, &header, sizeof(header));
+        memcpy(map + SNAPSHOT_MEMORY_OFFSET, cpu->memory, MEMORY_SIZE);
+
+        u32 *tapes = (u32 *)(map + SNAPSHOT_TAPE_OFFSET);
+        if (input->count)
+            memcpy(tapes, input->halves, input->count * sizeof(u32));
+        if (output->count)
+            memcpy(tapes + input->count, output->halves, output->count * sizeof(u32));
+
+        ok = msync(map, size, MS_SYNC) == 0;
+        munmap(map, size);
+    }
+
+    if (close(fd) != 0 || !ok || rename(temp, path) != 0)
+    {
+        snprintf(err, len, "%s: %s", path, strerror(errno));
+        unlink(temp);
+        return false;
+    }
+    return true;
+}
+
+// Replace the machine state with a snapshot. Host side settings (hooks,
+// profiler, trace, display mode, opcode policy, tape fast-load and
+// recording) are kept; the page table is rebuilt for the saved RAM size
+bool snapshot_load(cpu_t *cpu, const char *path, char *err, size_t len)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        snprintf(err, len, "%s: %s", path, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < SNAPSHOT_TAPE_OFFSET)
+    {
+        snprintf(err, len, "%s: not a snapshot file", path);
+        close(fd);
+        return false;
+    }
+
+    size_t size = (size_t)st.st_size;
+    const u8 *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED)
+    {
+        snprintf(err, len, "%s: %s", path, strerror(errno));
+        return false;
+    }
+
+    const snapshot_header_t *header = (const snapshot_header_t *)map;
+    bool ok = false;
+
+    if (!snapshot_valid(header))
+        snprintf(err, len, "%s: not a version %d snapshot", path, SNAPSHOT_VERSION);
+    else if ((size - SNAPSHOT_TAPE_OFFSET) % sizeof(u32) != 0 ||
+             header->tape_input_halves > (size - SNAPSHOT_TAPE_OFFSET) / sizeof(u32) ||
+             header->tape_output_halves != (size - SNAPSHOT_TAPE_OFFSET) / sizeof(u32) -
+                                               header->tape_input_halves)
+        snprintf(err, len, "%s: tape data does not match the header", path);
+    else if (!cpu_map_memory(cpu, header->ram_kb))
+        snprintf(err, len, "%s: unsupported RAM size %uK", path, header->ram_kb);
+    else
+    {
+        memcpy(cpu->memory, map + SNAPSHOT_MEMORY_OFFSET, MEMORY_SIZE);
+        ok = snapshot_restore(cpu, header, (const u32 *)(map + SNAPSHOT_TAPE_OFFSET));
+        if (!ok)
+            snprintf(err, len, "%s: out of memory for the tapes", path);
+    }
+
+    munmap((void *)map, size);
+    return ok;
+}
+
+static u64 hash_bytes(u64 hash, const void *data, size_t size)
+{
+    const u8 *bytes = data;
+
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+    return hash;
+}
+
+// FNV-1a over what a snapshot would hold, except the terminal refresh
+// count, which depends on the host: two machines with the same hash would
+// save the same file
+u64 snapshot_hash(cpu_t *cpu)
+{
+    snapshot_header_t header;
+    u64 hash = 0xCBF29CE484222325ull;
+
+    snapshot_capture(cpu, &header);
+    header.display_refreshes = 0;
+
+    hash = hash_bytes(hash, &header, sizeof(header));
+    hash = hash_bytes(hash, cpu->memory, MEMORY_SIZE);
+    hash = hash_bytes(hash, cpu->aci.input.halves, cpu->aci.input.count * sizeof(u32));
+    hash = hash_bytes(hash, cpu->aci.output.halves, cpu->aci.output.count * sizeof(u32));
+    return hash;
+}
@@ -0,0 +1,83 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "utils/util.h"
+#include "cpu/cpu.h"
+
+#define SNAPSHOT_MAGIC "A1STATE"
+#define SNAPSHOT_VERSION 4
+
+// Memory image starts on its own host page, so a snapshot can be mapped
+// and compared page by page
+#define SNAPSHOT_MEMORY_OFFSET 4096
+
+// The ACI tapes follow the memory image as u32 half waves: the input tape,
+// then what has been recorded so far
+#define SNAPSHOT_TAPE_OFFSET (SNAPSHOT_MEMORY_OFFSET + MEMORY_SIZE)
+
+// Machine state that is not in the memory image. Fields are written one by
+// one, never as a copy of cpu_t, so the layout only changes with the version
+typedef struct
+{
+    char magic[8];
+    u32 version;
+    u32 header_size;
+
+    u64 global_cycles;
+    u16 PC;
+    u8 A, X, Y, SP;
+    u8 P;                 // Flags as pushed by PHP, B included
+    u16 BRK_LOC, RESET_LOC, NMI_LOC;
+    u32 ram_kb;
+
+    u8 halt;
+    u16 halt_pc;
+    u8 halt_opcode;
+
+    // Interrupt lines and the timer
+    u32 irq_lines;
+    u32 nmi_lines;
+    u8 nmi_pending;
+    u8 irq_i_before;
+    u64 irq_i_until;
+    u16 timer_period;
+    u8 timer_control;
+    u8 timer_status;
+    u64 timer_deadline;
+
+    // PIA
+    u8 key_ready;
+    u8 key_value;
+    u16 queued_keys;
+    u8 keys[KEYBOARD_QUEUE_SIZE];
+    u32 idle_polls;
+    u64 last_poll;
+
+    // Display
+    u8 row;
+    u8 col;
+    u64 busy_until;
+    char screen[DISPLAY_ROWS][DISPLAY_COLS];
+    u64 display_chars;
+    u64 display_refreshes;
+
+    // ACI playback and recording
+    u8 tape_playing;
+    u8 tape_in_level;
+    u8 tape_out_level;
+    u8 tape_out_started;
+    u64 tape_position;
+    u64 tape_next_edge;
+    u64 tape_last_toggle;
+    u32 tape_fast_loads;
+    u64 tape_input_halves;  // Length of the input tape in the file
+    u64 tape_output_halves; // Length of the recording in the file
+} snapshot_header_t;
+
+_Static_assert(sizeof(snapshot_header_t) <= SNAPSHOT_MEMORY_OFFSET, "snapshot header overlaps memory");
+
+bool snapshot_save(cpu_t *cpu, const char *path, char *err, size_t len);
+bool snapshot_load(cpu_t *cpu, const char *path, char *err, size_t len);
+u64 snapshot_hash(cpu_t *cpu);
+
+#endif
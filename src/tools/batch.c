@@ -0,0 +1,209 @@
+#include "run/batch.h"
+#include "mem/rom.h"
+
+#include <libgen.h>
+
+// Run many headless emulators in parallel, one per keyboard script
+
+#define BATCH_DEFAULT_CYCLES 1000000000ULL
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [options] script...\n", prog);
+    fprintf(stderr, "  -j threads  Worker threads (default: one per CPU)\n");
+    fprintf(stderr, "  -o dir      Write each job's display output to dir/<script>.out\n");
+    fprintf(stderr, "              (default: print all outputs to stdout in script order)\n");
+    fprintf(stderr, "  -L file     Start every job from a saved machine state\n");
+    fprintf(stderr, "  -r name=file Replace a built-in ROM with a file\n");
+    fprintf(stderr, "  -M kb       RAM configuration: 4, 8, 32, 48 or 64 (default 64)\n");
+    fprintf(stderr, "  -T          Trap undocumented opcodes instead of emulating them\n");
+    fprintf(stderr, "  -C cycles   Stop each job after this many cycles (default %llu, 0 = no limit)\n",
+            BATCH_DEFAULT_CYCLES);
+    fprintf(stderr, "  -n count    Stop each job after this many instructions\n");
+    fprintf(stderr, "  -p addr     Stop when PC reaches addr (hex)\n");
+    fprintf(stderr, "  -m text     Stop once text has been printed\n");
+    fprintf(stderr, "  -q          Only print the summary\n");
+}
+
+static bool parse_number(const char *str, int base, u64 max, u64 *out)
+{
+    char *end;
+    errno = 0;
+
+    unsigned long long parsed = strtoull(str, &end, base);
+
+    if (errno != 0 || *end != '\0' || end == str || parsed > max)
+    {
+        fprintf(stderr, "Invalid value: %s\n", str);
+        return false;
+    }
+
+    *out = parsed;
+    return true;
+}
+
+// dir/<basename of script>.out
+static FILE *open_output(const char *dir, const char *script)
+{
+    char copy[512];
+    char path[1024];
+
+    snprintf(copy, sizeof(copy), "%s", script);
+    snprintf(path, sizeof(path), "%s/%s.out", dir, basename(copy));
+
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+        fprintf(stderr, "Could not create %s: %s\n", path, strerror(errno));
+    return file;
+}
+
+int main(int argc, char *argv[])
+{
+    batch_opts_t opts = {0};
+    const char *output_dir = NULL;
+    bool quiet = false;
+    char error[160];
+    u64 value;
+    int opt;
+
+    opts.ram_kb = 64;
+    opts.emulate_illegal = true;
+    opts.limits.max_cycles = BATCH_DEFAULT_CYCLES;
+
+    while ((opt = getopt(argc, argv, "j:o:L:r:M:TC:n:p:m:qh")) != -1)
+    {
+        switch (opt)
+        {
+        case 'j':
+            if (!parse_number(optarg, 10, BATCH_MAX_THREADS, &value))
+                return 1;
+            opts.threads = (unsigned)value;
+            break;
+        case 'o':
+            output_dir = optarg;
+            break;
+        case 'L':
+            opts.state_path = optarg;
+            break;
+        case 'r':
+        {
+            char name[32];
+            const char *eq = strchr(optarg, '=');
+
+            if (eq == NULL || eq == optarg || eq - optarg >= (int)sizeof(name)) {
+                fprintf(stderr, "Invalid ROM override, expected name=file: %s\n", optarg);
+                return 1;
+            }
+            snprintf(name, sizeof(name), "%.*s", (int)(eq - optarg), optarg);
+
+            if (!rom_override(name, eq + 1, error, sizeof(error))) {
+                fprintf(stderr, "Could not replace ROM: %s\n", error);
+                return 1;
+            }
+            break;
+        }
+        case 'M':
+            if (!parse_number(optarg, 10, 64, &value))
+                return 1;
+            opts.ram_kb = (u32)value;
+            break;
+        case 'T':
+            opts.emulate_illegal = false;
+            break;
+        case 'C':
+            if (!parse_number(optarg, 10, UINT64_MAX, &opts.limits.max_cycles))
+                return 1;
+            break;
+        case 'n':
+            if (!parse_number(optarg, 10, UINT64_MAX, &opts.limits.max_instructions))
+                return 1;
+            break;
+        case 'p':
+            if (!parse_number(optarg, 16, UINT16_MAX, &value))
+                return 1;
+            opts.limits.stop_on_pc = true;
+            opts.limits.stop_pc = (u16)value;
+            break;
+        case 'm':
+            if (strlen(optarg) == 0 || strlen(optarg) > HEADLESS_MAX_PATTERN) {
+                fprintf(stderr, "Invalid output pattern: %s\n", optarg);
+                return 1;
+            }
+            opts.limits.stop_output = optarg;
+            break;
+        case 'q':
+            quiet = true;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? EXIT_SUCCESS : 1;
+        }
+    }
+
+    size_t count = (size_t)(argc - optind);
+    if (count == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    batch_job_t *jobs = calloc(count, sizeof(batch_job_t));
+    if (jobs == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        jobs[i].input_path = argv[optind + i];
+        if (output_dir) {
+            jobs[i].output = open_output(output_dir, jobs[i].input_path);
+            if (jobs[i].output == NULL)
+                return 1;
+        }
+    }
+
+    batch_stats_t stats;
+    if (!batch_run(jobs, count, &opts, &stats)) {
+        fprintf(stderr, "Could not start the worker threads\n");
+        return 1;
+    }
+
+    size_t failed = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        batch_job_t *job = &jobs[i];
+
+        if (job->output)
+            fclose(job->output);
+
+        if (job->failed) {
+            fprintf(stderr, "%s: %s\n", job->input_path, job->error);
+            failed++;
+            continue;
+        }
+
+        if (!output_dir && !quiet) {
+            printf("==> %s <==\n", job->input_path);
+            fwrite(job->output_buf, 1, job->output_len, stdout);
+            if (job->output_len && job->output_buf[job->output_len - 1] != '\n')
+                putchar('\n');
+        }
+        free(job->output_buf);
+
+        if (!quiet)
+            fprintf(stderr, "%s: %s after %llu instructions, %llu cycles, %.1f ms (worker %u)\n",
+                    job->input_path, headless_stop_name(job->result.reason),
+                    (unsigned long long)job->result.instructions,
+                    (unsigned long long)job->result.cycles,
+                    job->ns / 1e6, job->worker);
+    }
+
+    double seconds = stats.ns / 1e9;
+    fprintf(stderr, "%zu jobs (%zu failed) on %u threads, %llu steals: "
+            "%llu instructions in %.3f s, %.1f MIPS aggregate\n",
+            count, failed, stats.threads, (unsigned long long)stats.steals,
+            (unsigned long long)stats.instructions, seconds,
+            seconds > 0 ? stats.instructions / seconds / 1e6 : 0.0);
+
+    free(jobs);
+    return failed ? 1 : EXIT_SUCCESS;
+}
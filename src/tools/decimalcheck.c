@@ -0,0 +1,121 @@
+#include "cpu/cpu.h"
+#include "cpu/decimal.h"
+#include "cpu/instruction.h"
+
+// Exhaustive check of decimal mode ADC/SBC: every A, operand and carry is
+// run through the emulated instruction and compared with the sequences from
+// Bruce Clark's "Decimal Mode" tutorial (Appendix A, NMOS 6502), which are a
+// different formulation from the one the tables are built with
+
+#define OPERAND 0x0200
+#define MAX_REPORTED 10
+
+typedef struct
+{
+    u8 result;
+    u8 flags;
+} expect_t;
+
+static expect_t reference_adc(u8 a, u8 b, u8 c)
+{
+    // Sequence 1: accumulator and carry
+    int al = (a & 0x0F) + (b & 0x0F) + c;
+    if (al >= 0x0A)
+        al = ((al + 0x06) & 0x0F) + 0x10;
+
+    int sum = (a & 0xF0) + (b & 0xF0) + al;
+    if (sum >= 0xA0)
+        sum += 0x60;
+
+    // Sequence 2: N and V from the same sum with signed high nibbles
+    int sum2 = (i8)(a & 0xF0) + (i8)(b & 0xF0) + al;
+
+    expect_t e = {(u8)sum, 0};
+    if (sum >= 0x100)
+        e.flags |= CARRY_FLAG;
+    if (((a + b + c) & 0xFF) == 0)
+        e.flags |= ZERO_FLAG;
+    if (sum2 & 0x80)
+        e.flags |= NEGATIVE_FLAG;
+    if (sum2 < -128 || sum2 > 127)
+        e.flags |= OVERFLOW_FLAG;
+    return e;
+}
+
+static expect_t reference_sbc(u8 a, u8 b, u8 c)
+{
+    // Sequence 3: accumulator; flags are those of binary mode
+    int al = (a & 0x0F) - (b & 0x0F) + c - 1;
+    if (al < 0)
+        al = ((al - 0x06) & 0x0F) - 0x10;
+
+    int diff = (a & 0xF0) - (b & 0xF0) + al;
+    if (diff < 0)
+        diff -= 0x60;
+
+    int binary = a - b + c - 1;
+    int signed_diff = (i8)a - (i8)b + c - 1;
+
+    expect_t e = {(u8)diff, 0};
+    if (binary >= 0)
+        e.flags |= CARRY_FLAG;
+    if ((binary & 0xFF) == 0)
+        e.flags |= ZERO_FLAG;
+    if (binary & 0x80)
+        e.flags |= NEGATIVE_FLAG;
+    if (signed_diff < -128 || signed_diff > 127)
+        e.flags |= OVERFLOW_FLAG;
+    return e;
+}
+
+static u8 cpu_flags(cpu_t *cpu)
+{
+    return cpu_status(cpu) & DECIMAL_FLAGS;
+}
+
+static u32 check(cpu_t *cpu, const char *name, void (*operation)(cpu_t *, u16),
+                 expect_t (*reference)(u8, u8, u8))
+{
+    u32 mismatches = 0;
+
+    for (unsigned c = 0; c < 2; c++)
+    {
+        for (unsigned a = 0; a < 256; a++)
+        {
+            for (unsigned b = 0; b < 256; b++)
+            {
+                cpu->A = a;
+                cpu_set_status(cpu, DECIMAL_FLAG | c);
+                write_memory(cpu, OPERAND, b);
+
+                operation(cpu, OPERAND);
+
+                expect_t e = reference(a, b, c);
+                if (cpu->A == e.result && cpu_flags(cpu) == e.flags)
+                    continue;
+
+                if (++mismatches <= MAX_REPORTED)
+                    printf("%s A=%02X M=%02X C=%u: got %02X flags %02X, expected %02X flags %02X\n",
+                           name, a, b, c, cpu->A, cpu_flags(cpu), e.result, e.flags);
+            }
+        }
+    }
+
+    printf("%s: %u cases, %u mismatches\n", name, 2 * 256 * 256, mismatches);
+    return mismatches;
+}
+
+int main(void)
+{
+    cpu_t *cpu = malloc(sizeof(cpu_t));
+    if (cpu == NULL)
+        return 1;
+
+    cpu_init(cpu);
+
+    u32 mismatches = check(cpu, "ADC", ADC, reference_adc) +
+                     check(cpu, "SBC", SBC, reference_sbc);
+
+    free(cpu);
+    return mismatches ? 1 : EXIT_SUCCESS;
+}
@@ -0,0 +1,231 @@
+#include "cpu/cpu.h"
+#include "hle/applesoft.h"
+
+// Randomized check of the native Applesoft floating point: every hooked
+// entry point is called on random and edge case operands, once with the
+// ROM code and once native, and the whole machine is compared afterwards:
+// all of memory, the registers, the flags and the cycle count
+//
+// Usage: fpcheck [cases per entry point] [seed]
+
+#define OPERAND 0x0300   // Packed number for the (A,Y) entry points
+#define RETURN 0x0400    // Where the routine returns to
+#define ERROR 0x62C0     // Applesoft's error handler
+#define MAX_CYCLES 200000
+#define MAX_REPORTED 10
+
+#define FAC 0x9D   // Exponent, 4 mantissa bytes, sign
+#define ARG 0xA5
+#define FAC_EXTENSION 0xAC
+
+static const struct
+{
+    const char *name;
+    u16 address;
+    bool operand; // Takes a packed number at (A,Y)
+} entry_points[] = {
+    {"FSUB", 0x7451, true},   {"FSUBT", 0x7454, false}, {"FADD", 0x7468, true},
+    {"FADDT", 0x746B, false}, {"LOG", 0x75EB, false},   {"FMULT", 0x7629, true},
+    {"FMULTT", 0x762C, false}, {"MUL10", 0x76DE, false}, {"DIV10", 0x76FA, false},
+    {"FDIV", 0x770B, true},   {"FDIVT", 0x770E, false}, {"INT", 0x78C5, false},
+    {"SQR", 0x7B2D, false},   {"FPWRT", 0x7B37, false}, {"EXP", 0x7BA8, false},
+};
+
+static u64 rng_state;
+
+static u32 rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (u32)(rng_state >> 32);
+}
+
+// Mostly ordinary numbers, with zero, the exponent extremes and the
+// mantissa patterns that carry all the way through thrown in
+static void random_number(u8 *number, u8 near_exponent)
+{
+    u32 kind = rng() % 16;
+
+    number[0] = kind < 6 ? (u8)(near_exponent + rng() % 9 - 4)
+              : kind < 8 ? (u8)(0x78 + rng() % 16)
+              : kind == 8 ? 0
+              : kind == 9 ? (u8)(rng() % 2 ? 0x01 + rng() % 4 : 0xFF - rng() % 4)
+              : (u8)rng();
+
+    for (int i = 1; i < 5; i++)
+        number[i] = (u8)rng();
+
+    if (kind == 10)
+        memset(number + 1, rng() % 2 ? 0x00 : 0xFF, 4);
+    if (kind == 11)
+        number[4] = 0xFF;
+}
+
+static void setup(cpu_t *cpu, const cpu_t *boot, u16 entry, bool operand)
+{
+    memcpy(cpu->memory, boot->memory, MEMORY_SIZE);
+
+    for (u16 address = 0; address < 0x200; address++)
+        cpu->memory[address] = (u8)rng();
+
+    // FAC and ARG: exponent, mantissa with the top bit set, sign
+    u8 fac[5], arg[5];
+    random_number(fac, (u8)(0x80 + rng() % 16));
+    random_number(arg, fac[0]);
+
+    cpu->memory[FAC] = fac[0];
+    cpu->memory[FAC + 1] = fac[1] | 0x80;
+    memcpy(cpu->memory + FAC + 2, fac + 2, 3);
+    cpu->memory[FAC + 5] = rng() % 3 ? (rng() % 2 ? 0x00 : 0xFF) : (u8)rng();
+    cpu->memory[FAC_EXTENSION] = rng() % 2 ? 0 : (u8)rng();
+
+    cpu->memory[ARG] = arg[0];
+    cpu->memory[ARG + 1] = arg[1] | 0x80;
+    memcpy(cpu->memory + ARG + 2, arg + 2, 3);
+    cpu->memory[ARG + 5] = rng() % 3 ? (rng() % 2 ? 0x00 : 0xFF) : (u8)rng();
+    cpu->memory[ARG + 6] = cpu->memory[ARG + 5] ^ cpu->memory[FAC + 5];
+
+    random_number(cpu->memory + OPERAND, cpu->memory[FAC]);
+
+    cpu->A = operand ? OPERAND & 0xFF : (u8)rng();
+    cpu->Y = operand ? OPERAND >> 8 : (u8)rng();
+    cpu->X = (u8)rng();
+    cpu->SP = (u8)(0x40 + rng() % 0xC0);
+
+    // The T entry points test Z, set by the caller from the FAC exponent
+    cpu_set_status(cpu, (u8)(rng() & ~DECIMAL_FLAG));
+    if (!operand && rng() % 4)
+        cpu_set_nz(cpu, cpu->memory[FAC]);
+
+    // Two frames: the EXP underflow exit returns from its caller as well
+    for (int i = 0; i < 2; i++)
+    {
+        cpu->memory[0x100 | cpu->SP--] = (RETURN - 1) >> 8;
+        cpu->memory[0x100 | cpu->SP--] = (RETURN - 1) & 0xFF;
+    }
+
+    cpu->PC = entry;
+    cpu->global_cycles = 0;
+    cpu->halt = HALT_NONE;
+}
+
+// Until the routine returns or reaches the error handler
+static bool run(cpu_t *cpu)
+{
+    while (cpu->PC != RETURN && cpu->PC != ERROR)
+    {
+        if (cpu->global_cycles > MAX_CYCLES || (!cpu_cycle(cpu) && cpu->halt))
+            return false;
+    }
+    return true;
+}
+
+static bool same(const cpu_t *a, const cpu_t *b, char *what, size_t len)
+{
+    if (a->PC != b->PC || a->A != b->A || a->X != b->X || a->Y != b->Y || a->SP != b->SP ||
+        cpu_status(a) != cpu_status(b))
+    {
+        snprintf(what, len, "registers PC=%04X A=%02X X=%02X Y=%02X SP=%02X P=%02X",
+                 b->PC, b->A, b->X, b->Y, b->SP, cpu_status(b));
+        return false;
+    }
+
+    if (a->global_cycles != b->global_cycles)
+    {
+        snprintf(what, len, "%llu cycles", (unsigned long long)b->global_cycles);
+        return false;
+    }
+
+    for (u32 address = 0; address < MEMORY_SIZE; address++)
+    {
+        if (a->memory[address] != b->memory[address])
+        {
+            snprintf(what, len, "$%04X=%02X", address, b->memory[address]);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void describe(const cpu_t *cpu, char *out, size_t len)
+{
+    const u8 *m = cpu->memory;
+    snprintf(out, len, "PC=%04X A=%02X X=%02X Y=%02X SP=%02X P=%02X FAC=%02X %02X%02X%02X%02X %02X",
+             cpu->PC, cpu->A, cpu->X, cpu->Y, cpu->SP, cpu_status(cpu),
+             m[FAC], m[FAC + 1], m[FAC + 2], m[FAC + 3], m[FAC + 4], m[FAC + 5]);
+}
+
+int main(int argc, char *argv[])
+{
+    u32 cases = argc > 1 ? (u32)strtoul(argv[1], NULL, 10) : 2000;
+    rng_state = argc > 2 ? strtoull(argv[2], NULL, 10) : 0x9E3779B97F4A7C15ull;
+    if (rng_state == 0)
+        rng_state = 1;
+
+    cpu_t *boot = malloc(sizeof(cpu_t));
+    cpu_t *rom = malloc(sizeof(cpu_t));
+    cpu_t *native = malloc(sizeof(cpu_t));
+    if (boot == NULL || rom == NULL || native == NULL)
+        return 1;
+
+    cpu_init(boot);
+    if (!init_software(boot) || !init_applesoft(boot))
+        return 1;
+
+    cpu_init(rom);
+    cpu_init(native);
+    memcpy(native->memory, boot->memory, MEMORY_SIZE);
+    native->hle = hle_create();
+    if (native->hle == NULL || !applesoft_hle_install(native))
+        return 1;
+
+    u32 mismatches = 0;
+
+    for (size_t e = 0; e < sizeof(entry_points) / sizeof(entry_points[0]); e++)
+    {
+        u32 errors = 0, runaways = 0, failed = 0;
+
+        for (u32 i = 0; i < cases; i++)
+        {
+            u64 seed = rng_state;
+            setup(rom, boot, entry_points[e].address, entry_points[e].operand);
+            rng_state = seed;
+            setup(native, boot, entry_points[e].address, entry_points[e].operand);
+
+            char before[128], what[96];
+            describe(rom, before, sizeof(before));
+
+            // Underflow in EXP called from FPWRT unwinds more than the frames
+            // set up here, and the ROM runs off into the stack contents. The
+            // native side then has to run off to the same place
+            bool rom_done = run(rom);
+            bool native_done = run(native);
+            errors += rom_done && rom->PC == ERROR;
+            runaways += !rom_done;
+
+            if (rom_done == native_done && same(rom, native, what, sizeof(what)))
+                continue;
+
+            if (rom_done != native_done)
+                snprintf(what, sizeof(what), "the native code %s", rom_done ? "did not return" : "returned");
+
+            failed++;
+            if (++mismatches <= MAX_REPORTED)
+            {
+                char expected[128];
+                describe(rom, expected, sizeof(expected));
+                printf("%s %s\n  expected %s\n  got %s\n", entry_points[e].name, before, expected, what);
+            }
+        }
+
+        printf("%-7s %u cases (%u errors, %u runaways), %u mismatches\n", entry_points[e].name, cases,
+               errors, runaways, failed);
+    }
+
+    hle_destroy(native->hle);
+    free(boot);
+    free(rom);
+    free(native);
+    return mismatches ? 1 : EXIT_SUCCESS;
+}
@@ -0,0 +1,123 @@
+#include "cpu/cpu.h"
+#include "run/headless.h"
+
+// Headless check of when a held IRQ is taken around the instructions that
+// change I. On the NMOS 6502 CLI, SEI and PLP change I after the interrupt
+// poll of their last cycle: a held IRQ gets in one instruction after CLI or
+// PLP, and CLI; SEI still lets it in, after the SEI, with I set in the pushed
+// status. RTI restores I before the poll, so it lets the IRQ in at once.
+// Every case runs single stepped and in bursts, plain, predecoded and
+// translated; the handler saves the pushed status and return address
+//
+// Usage: irqcheck
+
+#define CODE_START 0x0300
+#define SAVED 0xF0 // Pushed P, PCL, PCH
+#define TEST_SOURCE (1u << 7)
+
+typedef struct
+{
+    const char *name;
+    u8 code[16];
+    u8 size;
+    u16 return_pc; // Where the IRQ has to come back to
+    bool pushed_i; // I in the pushed status
+} irq_case_t;
+
+static const irq_case_t cases[] = {
+    {"CLI; SEI", {0x58, 0x78, 0xEA, 0x4C, 0x03, 0x03}, 6, 0x0302, true},
+    {"CLI; NOP", {0x58, 0xEA, 0xEA, 0x4C, 0x03, 0x03}, 6, 0x0302, false},
+    {"PLP; NOP", {0xA9, 0x00, 0x48, 0x28, 0xEA, 0xEA, 0x4C, 0x06, 0x03}, 9, 0x0305, false},
+    {"RTI", {0xA9, 0x03, 0x48, 0xA9, 0x0C, 0x48, 0xA9, 0x00, 0x48, 0x40, 0x02, 0x02,
+             0xEA, 0x4C, 0x0C, 0x03}, 16, 0x030C, false},
+};
+
+// TSX; LDA $0101,X; STA SAVED; LDA $0102,X; STA SAVED+1; LDA $0103,X;
+// STA SAVED+2; JAM
+static const u8 handler[] = {0xBA, 0xBD, 0x01, 0x01, 0x85, SAVED, 0xBD, 0x02, 0x01,
+                             0x85, SAVED + 1, 0xBD, 0x03, 0x01, 0x85, SAVED + 2, 0x02};
+
+typedef enum
+{
+    RUN_STEPPED,
+    RUN_BURST,
+    RUN_PREDECODED,
+    RUN_TRANSLATED,
+    RUN_MODES
+} run_mode_t;
+
+static const char *const mode_names[RUN_MODES] = {"stepped", "burst", "predecoded", "translated"};
+
+static bool run_case(cpu_t *cpu, const irq_case_t *c, run_mode_t mode)
+{
+    cpu_init(cpu);
+    if (!init_software(cpu))
+        return false;
+
+    u16 vector = read_memory(cpu, BRK_LOW_ADDR) | (read_memory(cpu, BRK_HIGH_ADDR) << 8);
+    for (u32 i = 0; i < sizeof(handler); i++)
+        write_memory(cpu, (u16)(vector + i), handler[i]);
+    for (u32 i = 0; i < c->size; i++)
+        write_memory(cpu, (u16)(CODE_START + i), c->code[i]);
+
+    if (mode == RUN_PREDECODED)
+        cpu->decode = decode_create();
+    if (mode == RUN_TRANSLATED && (cpu->jit = jit_create()) == NULL)
+    {
+        printf("  %-10s %-10s skipped, no JIT on this host\n", c->name, mode_names[mode]);
+        return true;
+    }
+
+    cpu->PC = CODE_START;
+    interrupt_set_irq(cpu, TEST_SOURCE, true);
+
+    headless_opts_t opts = {0};
+    opts.output = stdout;
+    opts.max_cycles = 10000;
+    if (mode == RUN_STEPPED)
+    {
+        opts.stop_on_pc = true;
+        opts.stop_pc = 0xFFF0; // Never reached, only forces single stepping
+    }
+
+    headless_result_t result = headless_run(cpu, &opts);
+
+    u16 return_pc = cpu->memory[SAVED + 1] | (cpu->memory[SAVED + 2] << 8);
+    bool pushed_i = cpu->memory[SAVED] & INTERRUPT_FLAG;
+    bool ok = result.reason == HEADLESS_STOP_TRAP && cpu->interrupt.irqs == 1 &&
+              return_pc == c->return_pc && pushed_i == c->pushed_i;
+
+    printf("  %-10s %-10s %s", c->name, mode_names[mode], ok ? "ok" : "MISMATCH");
+    if (!ok)
+        printf(": %llu IRQs, returns to $%04X with I %s, expected $%04X with I %s",
+               (unsigned long long)cpu->interrupt.irqs, return_pc, pushed_i ? "set" : "clear",
+               c->return_pc, c->pushed_i ? "set" : "clear");
+    putchar('\n');
+
+    jit_destroy(cpu->jit);
+    decode_destroy(cpu->decode);
+    return ok;
+}
+
+int main(void)
+{
+    cpu_t *cpu = malloc(sizeof(cpu_t));
+    if (cpu == NULL)
+        return 1;
+
+    u32 failed = 0;
+
+    printf("IRQ timing around CLI, SEI, PLP and RTI:\n");
+    for (u32 i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        for (int mode = 0; mode < RUN_MODES; mode++)
+        {
+            if (!run_case(cpu, &cases[i], (run_mode_t)mode))
+                failed++;
+        }
+    }
+
+    printf("%u failed\n", failed);
+    free(cpu);
+    return failed ? 1 : EXIT_SUCCESS;
+}
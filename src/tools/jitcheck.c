@@ -0,0 +1,240 @@
+#include "cpu/cpu.h"
+#include "cpu/instruction.h"
+
+// Randomized check of the JIT and the predecoded instruction cache against
+// the interpreter: random code, data, registers and RAM size on three
+// machines, one plain, one predecoding and one translating. Each program is
+// run in bursts from random entry points with random cycle and instruction
+// budgets, so its loops get hot, translated code stops at all sorts of
+// boundaries and the program's stores hit its own code now and then. After
+// every burst the whole machine is compared: all of memory, the registers,
+// the flags, the cycle count and the instructions run
+//
+// Usage: jitcheck [programs] [seed]
+
+#define CODE_START 0x0300
+#define CODE_END 0x0C00
+#define BURSTS 300
+#define MAX_REPORTED 10
+#define CHECKED 2 // Machines compared with the plain interpreter
+
+static u64 rng_state;
+
+static u32 rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (u32)(rng_state >> 32);
+}
+
+// Mostly the program and its data, sometimes a device or anywhere at all
+static u16 random_address(void)
+{
+    static const u16 devices[] = {0xC000, 0xC100, 0xC200, 0xD010};
+    u32 kind = rng() % 10;
+
+    if (kind < 7)
+        return 0x0200 + rng() % (0x1000 - 0x0200);
+    if (kind == 7)
+        return devices[rng() % 4] + rng() % 4;
+    return (u16)rng();
+}
+
+// Documented opcodes, with the odd undocumented one and few BRKs
+static u8 random_opcode(void)
+{
+    for (;;)
+    {
+        u8 opcode = (u8)rng();
+
+        if (opcodes[opcode].illegal && rng() % 64)
+            continue;
+        if (opcode == 0x00 && rng() % 8)
+            continue;
+        return opcode;
+    }
+}
+
+static void random_program(cpu_t *cpu)
+{
+    for (u32 address = 0; address < MEMORY_SIZE; address++)
+        cpu->memory[address] = (u8)rng();
+
+    // Half the zero page pointers lead into the program's own memory
+    for (u16 address = 0; address < 0x100; address += 2)
+    {
+        if (rng() % 2)
+            cpu->memory[address + 1] = 0x02 + rng() % 0x0E;
+    }
+
+    u16 pc = CODE_START;
+
+    while (pc < CODE_END - 3)
+    {
+        u8 opcode = random_opcode();
+        u16 operand;
+
+        switch (opcodes[opcode].addr_mode)
+        {
+        case ABS:
+        case ABX:
+        case ABY:
+            operand = opcodes[opcode].operation == JMP || opcodes[opcode].operation == JSR
+                          ? CODE_START + rng() % (CODE_END - CODE_START)
+                          : random_address();
+            break;
+        case IND:
+            operand = random_address();
+            break;
+        case REL:
+            operand = (u8)(rng() % 4 ? -(int)(rng() % 24) : (int)(rng() % 12));
+            break;
+        default:
+            operand = (u8)rng();
+            break;
+        }
+
+        cpu->memory[pc++] = opcode;
+        for (u8 i = 1; i < addr_mode_lengths[opcodes[opcode].addr_mode]; i++)
+        {
+            cpu->memory[pc++] = operand & 0xFF;
+            operand >>= 8;
+        }
+    }
+
+    cpu->A = (u8)rng();
+    cpu->X = (u8)rng();
+    cpu->Y = (u8)rng();
+    cpu->SP = (u8)rng();
+    cpu_set_status(cpu, (u8)(rng() & (rng() % 4 ? ~DECIMAL_FLAG : 0xFF)));
+}
+
+static bool same(const cpu_t *a, const cpu_t *b, char *what, size_t len)
+{
+    if (a->PC != b->PC || a->A != b->A || a->X != b->X || a->Y != b->Y || a->SP != b->SP ||
+        a->P != b->P || a->nz != b->nz || a->halt != b->halt)
+    {
+        snprintf(what, len, "registers PC=%04X A=%02X X=%02X Y=%02X SP=%02X P=%02X nz=%04X",
+                 b->PC, b->A, b->X, b->Y, b->SP, cpu_status(b), b->nz);
+        return false;
+    }
+
+    if (a->global_cycles != b->global_cycles)
+    {
+        snprintf(what, len, "%llu cycles", (unsigned long long)b->global_cycles);
+        return false;
+    }
+
+    for (u32 address = 0; address < MEMORY_SIZE; address++)
+    {
+        if (a->memory[address] != b->memory[address])
+        {
+            snprintf(what, len, "$%04X=%02X", address, b->memory[address]);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    static const u32 sizes[] = {4, 8, 32, 48, 64};
+    static const char *const names[CHECKED] = {"predecoded", "translated"};
+
+    u32 programs = argc > 1 ? (u32)strtoul(argv[1], NULL, 10) : 200;
+    rng_state = argc > 2 ? strtoull(argv[2], NULL, 10) : 0x9E3779B97F4A7C15ull;
+    if (rng_state == 0)
+        rng_state = 1;
+
+    cpu_t *interpreted = malloc(sizeof(cpu_t));
+    cpu_t *checked[CHECKED];
+    decode_t *decode = decode_create();
+    jit_t *jit = jit_create();
+    for (int m = 0; m < CHECKED; m++)
+        checked[m] = malloc(sizeof(cpu_t));
+
+    if (interpreted == NULL || checked[0] == NULL || checked[1] == NULL || decode == NULL || jit == NULL)
+    {
+        fprintf(stderr, "Could not set up the JIT\n");
+        return 1;
+    }
+
+    u32 mismatches = 0;
+    u64 instructions = 0;
+
+    for (u32 p = 0; p < programs; p++)
+    {
+        u32 ram_kb = sizes[rng() % 5];
+        u64 seed = rng_state;
+        bool failed[CHECKED] = {false};
+
+        cpu_init(interpreted);
+        cpu_map_memory(interpreted, ram_kb);
+        random_program(interpreted);
+
+        for (int m = 0; m < CHECKED; m++)
+        {
+            cpu_init(checked[m]);
+            checked[m]->decode = m == 0 ? decode : NULL;
+            checked[m]->jit = m == 1 ? jit : NULL;
+            cpu_map_memory(checked[m], ram_kb);
+            rng_state = seed;
+            random_program(checked[m]);
+        }
+
+        for (u32 burst = 0; burst < BURSTS; burst++)
+        {
+            // Mostly from the top of some instruction sequence, sometimes
+            // carrying on from wherever the last burst stopped
+            if (rng() % 8)
+            {
+                u16 entry = CODE_START + rng() % (CODE_END - CODE_START);
+                interpreted->PC = checked[0]->PC = checked[1]->PC = entry;
+            }
+            interpreted->halt = checked[0]->halt = checked[1]->halt = HALT_NONE;
+
+            u64 target = interpreted->global_cycles + 1 + rng() % 20000;
+            u64 max = 1 + rng() % 5000;
+            u16 entry = interpreted->PC;
+
+            u64 expected = cpu_run(interpreted, target, max);
+            instructions += expected;
+
+            for (int m = 0; m < CHECKED; m++)
+            {
+                if (failed[m])
+                    continue;
+
+                u64 got = cpu_run(checked[m], target, max);
+                char what[96];
+
+                if (expected == got && same(interpreted, checked[m], what, sizeof(what)))
+                    continue;
+
+                if (expected != got)
+                    snprintf(what, sizeof(what), "%llu instructions instead of %llu",
+                             (unsigned long long)got, (unsigned long long)expected);
+
+                if (++mismatches <= MAX_REPORTED)
+                    printf("%s program %u (%uK), burst %u from $%04X: expected PC=%04X A=%02X X=%02X Y=%02X "
+                           "SP=%02X P=%02X nz=%04X, got %s\n",
+                           names[m], p, ram_kb, burst, entry, interpreted->PC, interpreted->A, interpreted->X,
+                           interpreted->Y, interpreted->SP, cpu_status(interpreted), interpreted->nz, what);
+                failed[m] = true;
+            }
+        }
+    }
+
+    printf("%u programs, %llu instructions, %u mismatches\n", programs, (unsigned long long)instructions,
+           mismatches);
+    decode_report(decode, stdout);
+    jit_report(jit, stdout);
+
+    decode_destroy(decode);
+    jit_destroy(jit);
+    free(interpreted);
+    for (int m = 0; m < CHECKED; m++)
+        free(checked[m]);
+    return mismatches ? 1 : EXIT_SUCCESS;
+}
@@ -0,0 +1,93 @@
+// posix_openpt and friends
+#define _XOPEN_SOURCE 600
+
+#include "cpu/cpu.h"
+#include "ui/terminal.h"
+
+#include <fcntl.h>
+#include <ncurses.h>
+
+// Check of the terminal key path: a paste much longer than the key queue is
+// written into a pseudo terminal, and the frontend polls it while a slow
+// reader takes a few keys per time slice. Every key has to come out once and
+// in order, so a full queue must leave the rest of the paste with curses
+//
+// Usage: keycheck [keys]
+
+#define KEYS_PER_SLICE 7
+#define MAX_SLICES 100000
+
+int main(int argc, char *argv[])
+{
+    u32 keys = argc > 1 ? (u32)strtoul(argv[1], NULL, 10) : 1000;
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0 ||
+        fcntl(master, F_SETFL, O_NONBLOCK) != 0)
+    {
+        fprintf(stderr, "Could not open a pseudo terminal\n");
+        return 1;
+    }
+
+    FILE *tty = fopen(ptsname(master), "r+");
+    cpu_t *cpu = malloc(sizeof(cpu_t));
+    SCREEN *screen = tty ? newterm("vt100", tty, tty) : NULL;
+    if (screen == NULL || cpu == NULL)
+    {
+        fprintf(stderr, "Could not set up the terminal\n");
+        return 1;
+    }
+
+    // The same modes as terminal_init, on the pseudo terminal
+    set_term(screen);
+    cbreak();
+    noecho();
+    nodelay(stdscr, TRUE);
+    keypad(stdscr, TRUE);
+
+    cpu_init(cpu);
+
+    // Upper case letters and digits, which reach the queue unchanged
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    char *paste = malloc(keys);
+    if (paste == NULL)
+        return 1;
+    for (u32 i = 0; i < keys; i++)
+        paste[i] = alphabet[i % (sizeof(alphabet) - 1)];
+
+    u32 written = 0;
+    u32 received = 0;
+    u32 mismatches = 0;
+
+    for (u32 slice = 0; slice < MAX_SLICES && received < keys; slice++)
+    {
+        // Keep the paste flowing as fast as the pseudo terminal takes it
+        if (written < keys)
+        {
+            ssize_t n = write(master, paste + written, keys - written);
+            if (n > 0)
+                written += (u32)n;
+        }
+
+        terminal_poll_keyboard(cpu);
+
+        u8 key;
+        for (int i = 0; i < KEYS_PER_SLICE && keyboard_pop(&cpu->keyboard, &key); i++)
+        {
+            if (key != (u8)paste[received] && mismatches++ < 10)
+                fprintf(stderr, "key %u: got '%c', expected '%c'\n", received, key, paste[received]);
+            received++;
+        }
+    }
+
+    endwin();
+    delscreen(screen);
+    fclose(tty);
+    close(master);
+
+    printf("%u keys pasted, %u received, %u out of order\n", keys, received, mismatches);
+
+    free(paste);
+    free(cpu);
+    return received == keys && mismatches == 0 ? EXIT_SUCCESS : 1;
+}
@@ -0,0 +1,101 @@
+#include "cpu/cpu.h"
+#include "cpu/trace.h"
+
+// Offline decoder for trace files written by apple1 -t
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-f text|nestest] [-n count] trace_file\n", prog);
+    fprintf(stderr, "  -f format   text (default) or nestest\n");
+    fprintf(stderr, "  -n count    Only decode the last count records\n");
+}
+
+int main(int argc, char *argv[])
+{
+    bool nestest = false;
+    u64 last = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:n:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'f':
+            if (strcmp(optarg, "nestest") == 0)
+                nestest = true;
+            else if (strcmp(optarg, "text") != 0) {
+                fprintf(stderr, "Unknown format: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'n':
+        {
+            char *end;
+            last = strtoull(optarg, &end, 10);
+            if (*end != '\0' || end == optarg) {
+                fprintf(stderr, "Invalid count: %s\n", optarg);
+                return 1;
+            }
+            break;
+        }
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? EXIT_SUCCESS : 1;
+        }
+    }
+
+    if (argc - optind != 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    FILE *file = fopen(argv[optind], "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open %s\n", argv[optind]);
+        return 1;
+    }
+
+    trace_header_t header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0) {
+        fprintf(stderr, "%s is not a trace file\n", argv[optind]);
+        fclose(file);
+        return 1;
+    }
+
+    if (header.version != TRACE_VERSION || header.record_size != sizeof(trace_record_t) ||
+        header.capacity == 0 || (header.capacity & (header.capacity - 1)) != 0) {
+        fprintf(stderr, "Unsupported trace format (version %u, %u byte records)\n",
+                header.version, header.record_size);
+        fclose(file);
+        return 1;
+    }
+
+    // Oldest surviving record first
+    u64 available = header.count < header.capacity ? header.count : header.capacity;
+    if (last && last < available)
+        available = last;
+
+    trace_record_t *ring = malloc(header.capacity * sizeof(trace_record_t));
+    if (ring == NULL || fread(ring, sizeof(trace_record_t), header.capacity, file) != header.capacity) {
+        fprintf(stderr, "Trace file is truncated\n");
+        free(ring);
+        fclose(file);
+        return 1;
+    }
+    fclose(file);
+
+    if (header.count > header.capacity && !last)
+        fprintf(stderr, "Ring wrapped: showing the last %llu of %llu records\n",
+                (unsigned long long)available, (unsigned long long)header.count);
+
+    char line[160];
+    for (u64 n = header.count - available; n < header.count; n++)
+    {
+        trace_format(&ring[n & (header.capacity - 1)], nestest, line, sizeof(line));
+        puts(line);
+    }
+
+    free(ring);
+    return EXIT_SUCCESS;
+}
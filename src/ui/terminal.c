@@ -0,0 +1,108 @@
+#include "terminal.h"
+
+#include <ncurses.h>
+
+void terminal_init(void)
+{
+    initscr();
+    cbreak();
+    noecho();
+    nodelay(stdscr, TRUE); // make getch() non-blocking
+    keypad(stdscr, TRUE);  // handle special keys
+}
+
+void terminal_end(void)
+{
+    endwin();
+}
+
+void terminal_poll_keyboard(cpu_t *cpu)
+{
+    // Called once per time slice: take what the terminal has buffered, as far
+    // as the key queue has room. The rest stays with curses for the next slice
+    int key_hit;
+
+    while (keyboard_space(&cpu->keyboard) && (key_hit = getch()) != ERR)
+    {
+        switch (key_hit) {
+            case KEY_F(1):
+                if (cpu->recording)
+                    recording_reset(cpu->recording, cpu);
+                cpu_reset(cpu);
+                continue; // Don't queue control keys
+            case KEY_F(2):
+                clear(); // Clears terminal screen
+                if (cpu->recording)
+                    recording_clear(cpu->recording, cpu);
+                display_clear(&cpu->display);
+                continue;
+            case KEY_F(3):
+                cpu->running = false;
+                return; // Immediately exit Emulator
+            case KEY_F(4):
+                cpu->profile_dump = true;
+                continue;
+            case KEY_F(5):
+                cpu->save_state = true;
+                continue;
+            case KEY_ENTER:
+                key_hit = '\r';
+                break;
+            case KEY_BACKSPACE:
+                key_hit = '_';
+                break;
+        }
+
+        key_hit = keyboard_ascii(key_hit);
+        if (key_hit < 0)
+            continue;
+
+        // Only keys that made it into the queue change the machine
+        if (keyboard_push(&cpu->keyboard, (u8)key_hit) && cpu->recording)
+            recording_key(cpu->recording, cpu, (u8)key_hit);
+    }
+}
+
+// Draw the changed rows and refresh the terminal once, false if nothing changed
+bool terminal_flush(display_t *display)
+{
+    if (!display->dirty_rows)
+        return false;
+
+    for (int row = 0; row < DISPLAY_ROWS; row++)
+    {
+        if (display->dirty_rows & (1u << row))
+            mvaddnstr(row, 0, display->screen[row], DISPLAY_COLS);
+    }
+
+    move(display->row, display->col);
+    refresh();
+
+    display->dirty_rows = 0;
+    display->refreshes++;
+    return true;
+}
+
+// Host status line below the Apple-1 screen (or over its last row on a
+// 24 line terminal); NULL clears it
+void terminal_status(display_t *display, const char *message)
+{
+    int row = LINES > DISPLAY_ROWS ? DISPLAY_ROWS : LINES - 1;
+
+    move(row, 0);
+    clrtoeol();
+
+    if (message)
+    {
+        attron(A_REVERSE);
+        addnstr(message, COLS);
+        attroff(A_REVERSE);
+    }
+    else if (row < DISPLAY_ROWS)
+    {
+        display->dirty_rows |= 1u << row;
+    }
+
+    move(display->row, display->col);
+    refresh();
+}
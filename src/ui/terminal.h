@@ -0,0 +1,16 @@
+#ifndef TERMINAL_H
+#define TERMINAL_H
+
+#include "utils/util.h"
+#include "cpu/cpu.h"
+
+// ncurses frontend of the interactive emulator. Nothing else in the tree
+// touches the terminal, so the core builds into libapple1 without ncurses
+
+void terminal_init(void);
+void terminal_end(void);
+void terminal_poll_keyboard(cpu_t *cpu);
+bool terminal_flush(display_t *display);
+void terminal_status(display_t *display, const char *message);
+
+#endif
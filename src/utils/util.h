@@ -2,7 +2,6 @@
 #define UTIL_H
 
 #include <errno.h>
-#include <ncurses.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -13,6 +12,7 @@
 
 typedef uint8_t u8;
 typedef uint16_t u16;
+typedef uint32_t u32;
 typedef uint64_t u64;
 typedef int8_t i8;
 typedef int16_t i16;
@@ -20,6 +20,9 @@ typedef int16_t i16;
 // CPU Defines
 #define MEMORY_SIZE 0x10000
 
+// Apple-1 clock: 14.31818 MHz crystal divided by 14
+#define APPLE1_CLOCK_HZ 1022727
+
 #define NMI_LOW_ADDR 0xFFFA
 #define NMI_HIGH_ADDR 0xFFFB
 #define RESET_LOW_ADDR 0xFFFC